@@ -0,0 +1,114 @@
+// Fan-out latency micro-benchmark for WsHandler's broadcast path.
+//
+// Measures the time from "broadcast called" until the last recipient's
+// send() has run, for varying member counts, comparing:
+//   per-conn : one cross-thread task (and message copy) per recipient —
+//              what drogon's WebSocketConnection::send does off-loop
+//   per-loop : fanOutByLoop — one task per owning IO loop, shared bytes
+//
+// Build: cmake -DBUILD_BENCHMARKS=ON ... && ./bench/bench_fanout [io_threads]
+#include "ws/ConnRegistry.h"
+#include "ws/LoopFanout.h"
+#include <trantor/net/EventLoopThreadPool.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Stand-in for a WebSocket connection: send() just counts bytes.
+struct FakeConn {
+    size_t bytes = 0;
+    void send(const std::string& m) { bytes += m.size(); }
+};
+using ConnPtr = std::shared_ptr<FakeConn>;
+using Entry   = LoopBound<ConnPtr>;
+
+struct Latch {
+    std::atomic<long> remaining{0};
+    std::mutex mu;
+    std::condition_variable cv;
+    Clock::time_point done;
+
+    void arm(long n) { remaining = n; }
+    void hit() {
+        if (remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lk(mu);
+            done = Clock::now();
+            cv.notify_one();
+        }
+    }
+    void wait() {
+        std::unique_lock<std::mutex> lk(mu);
+        cv.wait(lk, [this] { return remaining.load() == 0; });
+    }
+};
+
+double percentile(std::vector<double> v, double p) {
+    std::sort(v.begin(), v.end());
+    return v[static_cast<size_t>(p * (v.size() - 1))];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const size_t ioThreads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4;
+    const int    rounds    = 200;
+    const std::string payload(512, 'x');  // typical chat message frame
+
+    trantor::EventLoopThreadPool pool(ioThreads, "bench-io");
+    pool.start();
+
+    std::printf("io_threads=%zu rounds=%d payload=%zuB\n", ioThreads, rounds, payload.size());
+    std::printf("%8s  %14s %14s  %14s %14s\n",
+                "members", "per-conn p50", "per-conn p99", "per-loop p50", "per-loop p99");
+
+    for (size_t members : {10, 100, 1000, 5000, 20000}) {
+        ConnRegistry<Entry> reg;
+        for (size_t i = 0; i < members; ++i)
+            reg.add(1, Entry{std::make_shared<FakeConn>(), pool.getNextLoop()});
+        auto list = reg.snapshot(1);
+
+        Latch latch;
+        std::vector<double> perConn, perLoop;
+
+        for (int r = 0; r < rounds; ++r) {
+            // Baseline: one queued task + one payload copy per recipient
+            latch.arm(static_cast<long>(members));
+            auto t0 = Clock::now();
+            for (const auto& e : *list) {
+                e.loop->queueInLoop([c = e.conn, m = payload, &latch] {
+                    c->send(m);
+                    latch.hit();
+                });
+            }
+            latch.wait();
+            perConn.push_back(std::chrono::duration<double, std::micro>(latch.done - t0).count());
+
+            // Grouped: one task per loop, shared payload
+            latch.arm(static_cast<long>(members));
+            t0 = Clock::now();
+            fanOutByLoop(list, std::make_shared<const std::string>(payload),
+                         [&latch](const ConnPtr& c, const std::string& m) {
+                             c->send(m);
+                             latch.hit();
+                         });
+            latch.wait();
+            perLoop.push_back(std::chrono::duration<double, std::micro>(latch.done - t0).count());
+        }
+
+        std::printf("%8zu  %12.1fus %12.1fus  %12.1fus %12.1fus\n", members,
+                    percentile(perConn, 0.50), percentile(perConn, 0.99),
+                    percentile(perLoop, 0.50), percentile(perLoop, 0.99));
+    }
+    return 0;
+}
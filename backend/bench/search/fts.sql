@@ -0,0 +1,6 @@
+-- Current message search: idx_messages_chat_fts (V25)
+SELECT m.id FROM messages m
+WHERE m.chat_id = :chat AND m.message_type = 'text'
+  AND to_tsvector('simple', COALESCE(m.content, '')) @@ messages_search_query(:word)
+  AND m.is_deleted = FALSE
+ORDER BY m.created_at DESC, m.id DESC LIMIT 20;
@@ -0,0 +1,5 @@
+-- Previous message search: substring scan over the chat
+SELECT m.id FROM messages m
+WHERE m.chat_id = :chat AND m.message_type = 'text' AND m.content ILIKE '%' || :word || '%'
+  AND m.is_deleted = FALSE
+ORDER BY m.created_at DESC, m.id DESC LIMIT 20;
@@ -0,0 +1,38 @@
+#!/usr/bin/env bash
+# Message search latency: ILIKE substring scan vs the V25 full-text index,
+# for a rare and a common word, on a seeded chat of BENCH_ROWS messages.
+#
+#   PGHOST=... PGUSER=... PGDATABASE=messenger ./run.sh [seconds] [clients]
+#
+# BENCH_ROWS (default 2000000) and BENCH_USERS (default 200000) size the
+# fixture; set BENCH_KEEP=1 to reuse an existing one. Bench rows are
+# removed at the end unless BENCH_KEEP is set.
+set -euo pipefail
+cd "$(dirname "$0")"
+
+DURATION=${1:-20}
+CLIENTS=${2:-4}
+ROWS=${BENCH_ROWS:-2000000}
+USERS=${BENCH_USERS:-200000}
+
+if [ -n "${BENCH_KEEP:-}" ] && [ -n "$(psql -X -At -c "SELECT 1 FROM chats WHERE name = 'bench_search'")" ]; then
+    read -r CHAT _ < <(psql -X -At -c "SELECT id || ' ' || owner_id FROM chats WHERE name = 'bench_search'")
+else
+    read -r CHAT _ < <(psql -X -q -At -v ON_ERROR_STOP=1 -v rows="$ROWS" -v users="$USERS" -f seed.sql | tail -n1)
+fi
+
+printf '%-6s %-8s %8s %14s %10s\n' query word clients latency_ms tps
+for word in w4242 w1; do
+    for q in ilike fts; do
+        out=$(pgbench -n -M prepared -T "$DURATION" -c "$CLIENTS" -j "$CLIENTS" \
+                      -D chat="$CHAT" -D word="$word" -f "$q.sql" 2>&1)
+        lat=$(sed -n 's/^latency average = \([0-9.]*\) ms$/\1/p' <<<"$out")
+        tps=$(sed -n 's/^tps = \([0-9.]*\) .*/\1/p' <<<"$out")
+        printf '%-6s %-8s %8s %14s %10s\n' "$q" "$word" "$CLIENTS" "$lat" "$tps"
+    done
+done
+
+if [ -z "${BENCH_KEEP:-}" ]; then
+    psql -X -q -v ON_ERROR_STOP=1 -c "DELETE FROM chats WHERE name = 'bench_search'" \
+         -c "DELETE FROM users WHERE username LIKE 'bench_search_%'"
+fi
@@ -0,0 +1,38 @@
+-- Fixture for the search benchmark: one chat with :rows messages built
+-- from a 5000-word vocabulary, spread over the last 12 months, and
+-- :users users. Idempotent; rerun to reset. Expect a few minutes at 5M rows.
+DELETE FROM chats WHERE name = 'bench_search';
+DELETE FROM users WHERE username LIKE 'bench_search_%';
+
+INSERT INTO users (username, email, password_hash, display_name)
+SELECT 'bench_search_' || g, 'bench_search_' || g || '@bench.local', 'x',
+       'Bench ' || md5(g::text)
+FROM generate_series(1, :users) g;
+
+INSERT INTO chats (type, name, owner_id)
+SELECT 'group', 'bench_search', MIN(id) FROM users WHERE username LIKE 'bench_search_%';
+
+INSERT INTO chat_members (chat_id, user_id, role)
+SELECT c.id, u.id, 'member'
+FROM chats c, (SELECT id FROM users WHERE username LIKE 'bench_search_%' ORDER BY id LIMIT 100) u
+WHERE c.name = 'bench_search';
+
+-- Words are "w<n>", so "w4242" is rare and "w1" is common
+INSERT INTO messages (chat_id, sender_id, content, message_type, created_at)
+SELECT c.id, s.id,
+       (SELECT string_agg('w' || (1 + floor(power(random(), 3) * 5000))::int, ' ')
+        FROM generate_series(1, 8 + (g % 5))),
+       'text',
+       NOW() - (random() * INTERVAL '365 days')
+FROM generate_series(1, :rows) g
+CROSS JOIN (SELECT id FROM chats WHERE name = 'bench_search') c
+CROSS JOIN LATERAL (SELECT id FROM chat_members WHERE chat_id = c.id LIMIT 1) s;
+
+-- Rows older than the existing partitions landed in messages_default
+SELECT messages_ensure_partitions(3) \g /dev/null
+
+ANALYZE messages;
+ANALYZE users;
+
+-- run.sh reads this line: <chat_id> <member_id>
+SELECT c.id || ' ' || c.owner_id FROM chats c WHERE c.name = 'bench_search';
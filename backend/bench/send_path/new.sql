@@ -0,0 +1,30 @@
+-- Current send path: kSendMessageSql from MessagesController.cpp, one round trip.
+-- Keep in step with it; parameters are bound to a plain text message with no
+-- sticker, file or reply ($5..$8 = 0).
+\set chat random(:first_chat, :first_chat + :chats - 1)
+WITH perm AS (
+  SELECT cm.role, (c.type <> 'channel' OR cm.role IN ('owner', 'admin')) AS can_post
+  FROM chat_members cm JOIN chats c ON c.id = cm.chat_id
+  WHERE cm.chat_id = :chat AND cm.user_id = :sender
+), chk AS (
+  SELECT p.role, p.can_post,
+         (0::BIGINT = 0 OR EXISTS (SELECT 1 FROM stickers WHERE id = 0::BIGINT)) AS sticker_ok
+  FROM (SELECT 1) one LEFT JOIN perm p ON TRUE
+), reply AS (
+  SELECT created_at FROM messages
+  WHERE 0::BIGINT > 0 AND chat_id = :chat AND id = 0::BIGINT LIMIT 1
+), ins AS (
+  INSERT INTO messages (chat_id, sender_id, content, message_type, sticker_id,
+                        file_id, duration_seconds, reply_to_message_id, reply_to_created_at)
+  SELECT :chat, :sender, 'bench message'::TEXT, 'text'::TEXT, NULLIF(0::BIGINT, 0),
+         NULLIF(0::BIGINT, 0), NULLIF(0::INTEGER, 0), NULLIF(0::BIGINT, 0),
+         (SELECT created_at FROM reply)
+  FROM chk WHERE chk.can_post AND chk.sticker_ok
+  RETURNING id, created_at, (EXTRACT(EPOCH FROM created_at) * 1000000)::BIGINT AS created_us
+), touch AS (
+  UPDATE chats SET updated_at = NOW()
+  WHERE id = :chat AND EXISTS (SELECT 1 FROM ins)
+)
+SELECT chk.role, COALESCE(chk.can_post, FALSE) AS can_post, chk.sticker_ok,
+       ins.id, ins.created_at, ins.created_us
+FROM chk LEFT JOIN ins ON TRUE;
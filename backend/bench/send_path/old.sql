@@ -0,0 +1,15 @@
+-- Previous send path: one round trip per statement, as sendMessage issued
+-- them before the single-statement rewrite (membership check, role check,
+-- insert, chat touch, sender read mark).
+\set chat random(:first_chat, :first_chat + :chats - 1)
+SELECT 1 FROM chat_members WHERE chat_id = :chat AND user_id = :sender;
+SELECT c.type::TEXT AS type, cm.role FROM chat_members cm JOIN chats c ON c.id = cm.chat_id
+ WHERE cm.chat_id = :chat AND cm.user_id = :sender;
+INSERT INTO messages (chat_id, sender_id, content, message_type, reply_to_message_id)
+ VALUES (:chat, :sender, 'bench message', 'text', NULLIF(0::BIGINT, 0)) RETURNING id, created_at;
+UPDATE chats SET updated_at = NOW() WHERE id = :chat;
+INSERT INTO chat_last_read (user_id, chat_id, last_read_msg_id, read_at)
+ VALUES (:sender, :chat, (SELECT last_msg_id FROM chat_summary WHERE chat_id = :chat), NOW())
+ ON CONFLICT (user_id, chat_id) DO UPDATE SET
+   last_read_msg_id = GREATEST(chat_last_read.last_read_msg_id, EXCLUDED.last_read_msg_id),
+   read_at = NOW();
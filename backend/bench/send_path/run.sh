@@ -0,0 +1,34 @@
+#!/usr/bin/env bash
+# Send-path latency: the old multi-statement sequence vs the single CTE,
+# at increasing client counts. Each statement in old.sql is its own round
+# trip, as it was from the API; run against a migrated database, ideally
+# from another host so network latency is included.
+#
+#   PGHOST=... PGUSER=... PGDATABASE=messenger ./run.sh [seconds] [clients...]
+#
+# Reports pgbench's average latency and TPS per script and client count.
+# Bench rows (bench_send_* users/chats and their messages) are removed at the end.
+set -euo pipefail
+cd "$(dirname "$0")"
+
+DURATION=${1:-20}
+shift || true
+if [ $# -gt 0 ]; then CLIENTS=("$@"); else CLIENTS=(1 8 32 64); fi
+CHATS=${BENCH_CHATS:-200}
+
+read -r FIRST_CHAT SENDER < <(psql -X -q -At -v ON_ERROR_STOP=1 -v chats="$CHATS" -f setup.sql | tail -n1)
+
+printf '%-6s %8s %14s %10s\n' path clients latency_ms tps
+for c in "${CLIENTS[@]}"; do
+    for path in old new; do
+        out=$(pgbench -n -M prepared -T "$DURATION" -c "$c" -j "$(( c < 8 ? c : 8 ))" \
+                      -D first_chat="$FIRST_CHAT" -D sender="$SENDER" -D chats="$CHATS" \
+                      -f "$path.sql" 2>&1)
+        lat=$(sed -n 's/^latency average = \([0-9.]*\) ms$/\1/p' <<<"$out")
+        tps=$(sed -n 's/^tps = \([0-9.]*\) .*/\1/p' <<<"$out")
+        printf '%-6s %8s %14s %10s\n' "$path" "$c" "$lat" "$tps"
+    done
+done
+
+psql -X -q -v ON_ERROR_STOP=1 -c "DELETE FROM chats WHERE name LIKE 'bench_send_%'" \
+     -c "DELETE FROM users WHERE username LIKE 'bench_send_%'"
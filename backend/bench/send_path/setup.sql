@@ -0,0 +1,21 @@
+-- Fixture for the send-path benchmark: :chats group chats, each with
+-- the sender and a few other members. Idempotent; rerun to reset.
+DELETE FROM chats WHERE name LIKE 'bench_send_%';
+DELETE FROM users WHERE username LIKE 'bench_send_%';
+
+INSERT INTO users (username, email, password_hash)
+SELECT 'bench_send_' || g, 'bench_send_' || g || '@bench.local', 'x'
+FROM generate_series(1, 5) g;
+
+INSERT INTO chats (type, name, owner_id)
+SELECT 'group', 'bench_send_' || g, (SELECT id FROM users WHERE username = 'bench_send_1')
+FROM generate_series(1, :chats) g;
+
+INSERT INTO chat_members (chat_id, user_id, role)
+SELECT c.id, u.id, CASE WHEN u.username = 'bench_send_1' THEN 'owner' ELSE 'member' END
+FROM chats c CROSS JOIN users u
+WHERE c.name LIKE 'bench_send_%' AND u.username LIKE 'bench_send_%';
+
+-- run.sh reads this line: <first_chat> <sender>
+SELECT MIN(c.id) || ' ' || (SELECT id FROM users WHERE username = 'bench_send_1')
+FROM chats c WHERE c.name LIKE 'bench_send_%';
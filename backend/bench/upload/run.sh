@@ -0,0 +1,67 @@
+#!/usr/bin/env bash
+# Upload throughput through POST /files at increasing concurrency. Run it
+# once against a build from before the pooled MinIO client and once after;
+# ideally from another host, with API_THREADS fixed on the server.
+#
+#   API=http://api:8080 TOKEN=<access token> ./run.sh [uploads] [size_kb] [concurrency...]
+#
+# Reports wall time, uploads/s, MB/s and mean/p95 request latency per
+# concurrency level. With MINIO_HOST=host:port and SSH_API=user@api-host it
+# also counts TIME_WAIT sockets from the API host to MinIO after each level.
+# Uploaded objects are left in the uploads bucket.
+#
+# Every upload must carry content the server has not seen: POST /files
+# deduplicates by SHA-256, so repeating one payload would measure a single
+# store followed by database lookups. Each request therefore sends a shared
+# random body behind a unique 64-byte header (run id, level, sequence number).
+set -euo pipefail
+
+: "${API:?set API, e.g. http://localhost:8080}"
+: "${TOKEN:?set TOKEN to an access token}"
+UPLOADS=${1:-200}
+SIZE_KB=${2:-512}
+shift 2 || shift $# || true
+if [ $# -gt 0 ]; then CONCURRENCY=("$@"); else CONCURRENCY=(1 8 32); fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+# SIZE_KB in total, header included
+head -c $((SIZE_KB * 1024 - 64)) /dev/urandom > "$WORK/payload.bin"
+RUN=$(head -c 8 /dev/urandom | od -An -tx1 | tr -d ' \n')
+
+# upload <concurrency level> <sequence number>
+upload() {
+    { printf '%-63s\n' "bench $RUN $1 $2"; cat "$WORK/payload.bin"; } |
+    curl -sS -o /dev/null -w '%{http_code} %{time_total}\n' \
+         -H "Authorization: Bearer $TOKEN" \
+         -F "file=@-;filename=bench.bin;type=application/octet-stream" \
+         "$API/files"
+}
+export -f upload
+export API TOKEN WORK RUN
+
+time_wait() {
+    if [ -n "${SSH_API:-}" ] && [ -n "${MINIO_HOST:-}" ]; then
+        ssh "$SSH_API" "ss -tan state time-wait dst $MINIO_HOST | tail -n +2 | wc -l"
+    else
+        echo -
+    fi
+}
+
+printf '%6s %8s %10s %10s %8s %8s %10s\n' conc wall_s uploads/s MB/s mean_ms p95_ms time_wait
+for c in "${CONCURRENCY[@]}"; do
+    start=$(date +%s.%N)
+    seq "$UPLOADS" | xargs -P "$c" -I{} bash -c 'upload "$1" "$2"' _ "$c" {} > "$WORK/out.txt"
+    end=$(date +%s.%N)
+
+    failed=$(awk '$1 != 201' "$WORK/out.txt" | wc -l)
+    [ "$failed" -eq 0 ] || echo "warning: $failed uploads did not return 201" >&2
+
+    wall=$(echo "$end - $start" | bc -l)
+    read -r mean p95 < <(awk '{print $2 * 1000}' "$WORK/out.txt" | sort -n |
+        awk '{v[NR] = $1; s += $1} END {i = int(NR * 0.95); if (i < 1) i = 1; printf "%.1f %.1f\n", s / NR, v[i]}')
+    printf '%6s %8.2f %10.1f %10.1f %8s %8s %10s\n' "$c" "$wall" \
+        "$(echo "$UPLOADS / $wall" | bc -l)" \
+        "$(echo "$UPLOADS * $SIZE_KB / 1024 / $wall" | bc -l)" \
+        "$mean" "$p95" "$(time_wait)"
+done
@@ -16,6 +16,8 @@ struct Config {
     std::string redisHost;
     int         redisPort;
     std::string redisPass;
+    int         redisSubConnections; // pooled pub/sub sockets shared by all WS channels
+    int         redisUnsubGraceSec;  // delay before UNSUBSCRIBE once a channel has no local subscribers
 
     // MinIO
     std::string minioEndpoint;       // internal Docker endpoint, e.g. "minio:9000"
@@ -28,6 +30,14 @@ struct Config {
     std::string minioUploadsBucket;  // bh-uploads
     std::string minioStickersBucket; // bh-stickers
     // Presigned URL config
+    int         minioPartSizeMb;     // uploads larger than this go up as S3 multipart, one part in memory at a time
+    int         minioClientsPerLoop;     // keep-alive MinIO connections per IO loop
+    int         minioPipelining;         // requests pipelined on one connection (0 = off)
+    int         minioMaxInflightPerLoop; // outstanding MinIO requests per IO loop before queueing
+    int         minioRequestTimeoutSec;  // 0 = no timeout
+    int         minioHealthIntervalSec;  // health probe of idle clients; 0 disables
+    int         uploadUrlTtl;        // presigned PUT URLs for direct uploads, seconds
+    int         uploadSweepIntervalSec;  // reap pending uploads this long after their URLs expire; 0 disables
     int         presignTtl;          // seconds (default 900)
     std::string minioPublicUrl;      // public-facing base URL for presigned URLs
                                      // e.g. "https://behappy.rest/minio" in prod
@@ -37,12 +47,49 @@ struct Config {
     std::string jwtSecret;
     int         jwtAccessTtl;   // seconds
     int         jwtRefreshTtl;  // seconds
+    int         jwtCacheSize;   // verified tokens kept in memory (0 disables)
 
     // Server
     int  apiPort;
     int  apiThreads;
     long maxFileSizeMb;
 
+    // Password hashing worker pool
+    int  cryptoThreads;       // PBKDF2 workers, separate from API_THREADS
+    int  cryptoQueueMax;      // queued hash jobs before login/register answer 503
+
+    // Image variant workers (ImagePipeline)
+    int  imageThreads;        // WebP resize workers; 0 disables variants
+    int  imageQueueMax;       // images waiting for a worker before new ones are skipped
+    int  imageMaxSourceMb;    // larger originals get no variants
+    int  imageThumbPx;        // longest side of the "thumb" variant
+    int  imagePreviewPx;      // longest side of the "preview" variant
+    int  imageWebpQuality;    // 1–100
+
+    // Chat membership cache (MembershipCache)
+    int  membershipCacheSize;    // cached (chat, user) entries; 0 disables
+    int  membershipCacheTtlSec;  // backstop expiry in case an invalidation is lost
+
+    // presence (PresenceService)
+    int  presenceTtlSec;             // a node's presence:<user_id> entry lapses this long after its last heartbeat
+    int  presenceBatchMs;            // presence changes are flushed to observers this often
+    int  presenceObserverCacheSize;  // max users with a cached observer set; 0 disables
+    int  presenceObserverTtlSec;     // backstop expiry for observer sets
+    int  presenceStatusCacheMs;      // cluster-wide online answers are reused this long; 0 disables
+
+    // messages partition maintenance (PartitionManager)
+    int         partitionMaintIntervalSec;  // 0 disables
+    int         partitionMonthsAhead;       // future monthly partitions to keep created
+    int         partitionRetentionMonths;   // retire partitions older than this; 0 keeps all
+    std::string partitionRetentionMode;     // "detach" (keep as archive table) | "drop"
+
+    // WebSocket fan-out
+    int  wsOutboundMaxBytes;  // per-connection output-buffer watermark before backpressure kicks in
+    int  wsSlowConsumerSec;   // evict a connection that stays over the watermark this long
+    int  wsTypingThrottleMs;  // publish at most one typing report per (chat, user) this often
+    int  wsTypingTtlMs;       // a typist leaves the chat's typing set after this long without a report
+    int  wsTypingTickMs;      // batched typing-set delivery interval
+
     // ----------------------------------------------------------------
     static Config fromEnv() {
         Config c;
@@ -55,6 +102,8 @@ struct Config {
         c.redisHost     = getenv_or("REDIS_HOST",       "localhost");
         c.redisPort     = getenv_int("REDIS_PORT",       6379);
         c.redisPass     = getenv_or("REDIS_PASS",       "");
+        c.redisSubConnections = getenv_int("REDIS_SUB_CONNECTIONS", 2);
+        c.redisUnsubGraceSec  = getenv_int("REDIS_UNSUB_GRACE_SEC", 30);
 
         c.minioEndpoint      = getenv_or("MINIO_ENDPOINT",        "localhost:9000");
         c.minioAccessKey     = getenv_or("MINIO_ACCESS_KEY",      "minioadmin");
@@ -64,17 +113,56 @@ struct Config {
         c.minioAvatarsBucket = getenv_or("MINIO_AVATARS_BUCKET",  "bh-avatars");
         c.minioUploadsBucket = getenv_or("MINIO_UPLOADS_BUCKET",  "bh-uploads");
         c.minioStickersBucket= getenv_or("MINIO_STICKERS_BUCKET", "bh-stickers");
+        c.minioPartSizeMb    = getenv_int("MINIO_PART_SIZE_MB",    8);
+        c.minioClientsPerLoop     = getenv_int("MINIO_CLIENTS_PER_LOOP",      2);
+        c.minioPipelining         = getenv_int("MINIO_PIPELINING",            0);
+        c.minioMaxInflightPerLoop = getenv_int("MINIO_MAX_INFLIGHT_PER_LOOP", 16);
+        c.minioRequestTimeoutSec  = getenv_int("MINIO_REQUEST_TIMEOUT_SEC",   120);
+        c.minioHealthIntervalSec  = getenv_int("MINIO_HEALTH_INTERVAL_SEC",   15);
+        c.uploadUrlTtl       = getenv_int("MINIO_UPLOAD_URL_TTL",  3600);
+        c.uploadSweepIntervalSec  = getenv_int("UPLOAD_SWEEP_INTERVAL_SEC",   600);
         c.presignTtl         = getenv_int("MINIO_PRESIGN_TTL",     900);
         c.minioPublicUrl     = getenv_or("MINIO_PUBLIC_URL",       "");
 
         c.jwtSecret     = getenv_or("JWT_SECRET",       "change-me");
         c.jwtAccessTtl  = getenv_int("JWT_ACCESS_TTL",  3600);
         c.jwtRefreshTtl = getenv_int("JWT_REFRESH_TTL", 604800);
+        c.jwtCacheSize  = getenv_int("JWT_CACHE_SIZE",  16384);
 
         c.apiPort       = getenv_int("API_PORT",         8080);
         c.apiThreads    = getenv_int("API_THREADS",      0);
         c.maxFileSizeMb = getenv_int("MAX_FILE_SIZE_MB", 50);
 
+        c.cryptoThreads  = getenv_int("CRYPTO_THREADS",   2);
+        c.cryptoQueueMax = getenv_int("CRYPTO_QUEUE_MAX", 64);
+
+        c.imageThreads     = getenv_int("IMAGE_THREADS",       2);
+        c.imageQueueMax    = getenv_int("IMAGE_QUEUE_MAX",     256);
+        c.imageMaxSourceMb = getenv_int("IMAGE_MAX_SOURCE_MB", 25);
+        c.imageThumbPx     = getenv_int("IMAGE_THUMB_PX",      160);
+        c.imagePreviewPx   = getenv_int("IMAGE_PREVIEW_PX",    1024);
+        c.imageWebpQuality = getenv_int("IMAGE_WEBP_QUALITY",  80);
+
+        c.membershipCacheSize   = getenv_int("MEMBERSHIP_CACHE_SIZE",    100000);
+        c.membershipCacheTtlSec = getenv_int("MEMBERSHIP_CACHE_TTL_SEC", 60);
+
+        c.presenceTtlSec            = getenv_int("PRESENCE_TTL_SEC",              90);
+        c.presenceBatchMs           = getenv_int("PRESENCE_BATCH_MS",             1000);
+        c.presenceObserverCacheSize = getenv_int("PRESENCE_OBSERVER_CACHE_SIZE",  50000);
+        c.presenceObserverTtlSec    = getenv_int("PRESENCE_OBSERVER_TTL_SEC",     300);
+        c.presenceStatusCacheMs     = getenv_int("PRESENCE_STATUS_CACHE_MS",      5000);
+
+        c.partitionMaintIntervalSec = getenv_int("PARTITION_MAINT_INTERVAL_SEC", 3600);
+        c.partitionMonthsAhead      = getenv_int("PARTITION_MONTHS_AHEAD",       3);
+        c.partitionRetentionMonths  = getenv_int("PARTITION_RETENTION_MONTHS",   0);
+        c.partitionRetentionMode    = getenv_or("PARTITION_RETENTION_MODE",      "detach");
+
+        c.wsOutboundMaxBytes = getenv_int("WS_OUTBOUND_MAX_BYTES", 1024 * 1024);
+        c.wsSlowConsumerSec  = getenv_int("WS_SLOW_CONSUMER_SEC",  15);
+        c.wsTypingThrottleMs = getenv_int("WS_TYPING_THROTTLE_MS", 3000);
+        c.wsTypingTtlMs      = getenv_int("WS_TYPING_TTL_MS",      6000);
+        c.wsTypingTickMs     = getenv_int("WS_TYPING_TICK_MS",     500);
+
         if (c.jwtSecret == "change-me" || c.jwtSecret.size() < 16) {
             throw std::runtime_error("JWT_SECRET is not set or too short (min 16 chars)");
         }
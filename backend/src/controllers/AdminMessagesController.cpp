@@ -51,9 +51,11 @@ void AdminMessagesController::listMessages(
     }
     std::string searchPattern;
     if (!filterText.empty()) {
-        searchPattern = "%" + filterText + "%";
+        // Word-prefix search on idx_messages_chat_fts (V25)
+        searchPattern = filterText;
         paramIdx++;
-        whereClause += " AND m.content ILIKE $" + std::to_string(paramIdx);
+        whereClause += " AND to_tsvector('simple', COALESCE(m.content, '')) @@ messages_search_query($" +
+                       std::to_string(paramIdx) + ")";
     }
 
     std::string limitP = "$" + std::to_string(paramIdx + 1);
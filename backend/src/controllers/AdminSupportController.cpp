@@ -1,5 +1,6 @@
 #include "AdminSupportController.h"
 #include "../ws/WsHandler.h"
+#include "../services/MembershipCache.h"
 #include <trantor/utils/Logger.h>
 
 static drogon::HttpResponsePtr jsonResp(const Json::Value& body, drogon::HttpStatusCode code) {
@@ -58,9 +59,10 @@ void AdminSupportController::listChats(
 
     db->execSqlAsync(
         "SELECT c.id, c.type::TEXT AS type, c.name, c.title, "
-        "(SELECT COUNT(*) FROM chat_members WHERE chat_id = c.id) AS member_count "
+        "COALESCE(cs.member_count, 0) AS member_count "
         "FROM chats c "
         "JOIN chat_members cm ON cm.chat_id = c.id "
+        "LEFT JOIN chat_summary cs ON cs.chat_id = c.id "
         "JOIN users u ON u.id = cm.user_id AND u.username = 'bh_support' "
         "ORDER BY c.updated_at DESC",
         [cbSh](const drogon::orm::Result& r) {
@@ -213,7 +215,9 @@ void AdminSupportController::sendMessage(
                                     db->execSqlAsync(
                                         "INSERT INTO chat_members (chat_id, user_id, role) "
                                         "VALUES ($1, $2, 'owner'), ($1, $3, 'member')",
-                                        [cbSh, db, newChatId, supportId, markedContent](const drogon::orm::Result&) {
+                                        [cbSh, db, newChatId, supportId, targetUserId, markedContent](const drogon::orm::Result&) {
+                                            MembershipCache::instance().invalidateMember(newChatId, supportId);
+                                            MembershipCache::instance().invalidateMember(newChatId, targetUserId);
                                             // Now send the message
                                             db->execSqlAsync(
                                                 "INSERT INTO messages (chat_id, sender_id, content, message_type) "
@@ -272,7 +276,9 @@ void AdminSupportController::sendMessage(
                 db->execSqlAsync(
                     "INSERT INTO chat_members (chat_id, user_id, role) "
                     "VALUES ($1, $2, 'admin') ON CONFLICT DO NOTHING",
-                    [cbSh, db, chatId, supportId, markedContent](const drogon::orm::Result&) {
+                    [cbSh, db, chatId, supportId, markedContent](const drogon::orm::Result& r) {
+                        if (r.affectedRows() > 0)
+                            MembershipCache::instance().invalidateMember(chatId, supportId);
                         db->execSqlAsync(
                             "INSERT INTO messages (chat_id, sender_id, content, message_type) "
                             "VALUES ($1, $2, $3, 'text') RETURNING id, created_at",
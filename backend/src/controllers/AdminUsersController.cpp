@@ -42,7 +42,7 @@ void AdminUsersController::listUsers(
         std::string p1 = "$" + std::to_string(paramIdx);
         paramIdx++;
         std::string p2 = "$" + std::to_string(paramIdx);
-        whereClause += " AND (u.username ILIKE " + p1 + " OR u.display_name ILIKE " + p2 + ")";
+        whereClause += " AND (u.username::text ILIKE " + p1 + " OR u.display_name ILIKE " + p2 + ")";
     }
 
     if (status == "active") whereClause += " AND u.is_active = TRUE AND u.is_blocked = FALSE";
@@ -214,8 +214,9 @@ void AdminUsersController::getUser(
     // 3. Chats
     db->execSqlAsync(
         "SELECT c.id, c.type::TEXT AS type, c.name, c.title, cm.role, cm.joined_at, "
-        "(SELECT COUNT(*) FROM chat_members WHERE chat_id = c.id) AS member_count "
+        "COALESCE(cs.member_count, 0) AS member_count "
         "FROM chat_members cm JOIN chats c ON c.id = cm.chat_id "
+        "LEFT JOIN chat_summary cs ON cs.chat_id = c.id "
         "WHERE cm.user_id = $1 ORDER BY cm.joined_at DESC",
         [result, maybeRespond](const drogon::orm::Result& r) {
             Json::Value arr(Json::arrayValue);
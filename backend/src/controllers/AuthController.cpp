@@ -1,11 +1,13 @@
 #include "AuthController.h"
 #include "../services/JwtService.h"
+#include "../services/CryptoPool.h"
 #include "../config/Config.h"
 #include "../utils/MinioPresign.h"
 #include <drogon/orm/DbClient.h>
 #include <openssl/evp.h>
 #include <openssl/hmac.h>
 #include <openssl/rand.h>
+#include <openssl/crypto.h>
 #include <trantor/utils/Logger.h>
 #include <sstream>
 #include <iomanip>
@@ -40,9 +42,14 @@ static bool verifyPassword(const std::string& password, const std::string& store
     auto p2 = stored.find('$', p1 + 1);
     if (p1 == std::string::npos || p2 == std::string::npos) return false;
     std::string salt = stored.substr(p1 + 1, p2 - p1 - 1);
-    return hashPassword(password, salt) == stored;
+    std::string computed = hashPassword(password, salt);
+    return computed.size() == stored.size() &&
+           CRYPTO_memcmp(computed.data(), stored.data(), stored.size()) == 0;
 }
 
+// hashPassword/verifyPassword cost tens of milliseconds each; they only ever
+// run on CryptoPool workers, never on an IO or DB loop.
+
 // ── Helpers ────────────────────────────────────────────────────────────────
 
 static drogon::HttpResponsePtr jsonResp(const Json::Value& body, drogon::HttpStatusCode code) {
@@ -56,6 +63,13 @@ static drogon::HttpResponsePtr err(const std::string& msg, drogon::HttpStatusCod
     return jsonResp(b, code);
 }
 
+// Crypto queue full — shed load instead of queueing logins unboundedly.
+static drogon::HttpResponsePtr busy() {
+    auto resp = err("Server busy, retry shortly", drogon::k503ServiceUnavailable);
+    resp->addHeader("Retry-After", "1");
+    return resp;
+}
+
 // ── POST /auth/register ────────────────────────────────────────────────────
 
 void AuthController::registerUser(const drogon::HttpRequestPtr& req,
@@ -74,42 +88,91 @@ void AuthController::registerUser(const drogon::HttpRequestPtr& req,
     if (password.size() < 6)
         return cb(err("Password must be at least 6 characters", drogon::k400BadRequest));
 
-    std::string salt = randomHex(16);
-    std::string hash = hashPassword(password, salt);
     std::string displayName = (*body).get("display_name", username).asString();
 
     auto cbSh = std::make_shared<std::function<void(const drogon::HttpResponsePtr&)>>(std::move(cb));
-    auto db = drogon::app().getDbClient();
-    db->execSqlAsync(
-        "INSERT INTO users (username, email, password_hash, display_name) "
-        "VALUES ($1, $2, $3, $4) RETURNING id",
-        [cbSh, username](const drogon::orm::Result& r) mutable {
-            long long uid = r[0]["id"].as<long long>();
-            // Create default settings
-            auto db2 = drogon::app().getDbClient();
-            db2->execSqlAsync(
-                "INSERT INTO user_settings (user_id) VALUES ($1) ON CONFLICT DO NOTHING",
-                [](const drogon::orm::Result&) {},
-                [](const drogon::orm::DrogonDbException& e) {
-                    LOG_WARN << "settings insert error: " << e.base().what();
-                }, uid);
+    bool queued = CryptoPool::instance().submit("pbkdf2_hash",
+        [cbSh, username, email, password, displayName] {
+            std::string hash = hashPassword(password, randomHex(16));
+            auto db = drogon::app().getDbClient();
+            db->execSqlAsync(
+                "INSERT INTO users (username, email, password_hash, display_name) "
+                "VALUES ($1, $2, $3, $4) RETURNING id",
+                [cbSh, username](const drogon::orm::Result& r) mutable {
+                    long long uid = r[0]["id"].as<long long>();
+                    // Create default settings
+                    auto db2 = drogon::app().getDbClient();
+                    db2->execSqlAsync(
+                        "INSERT INTO user_settings (user_id) VALUES ($1) ON CONFLICT DO NOTHING",
+                        [](const drogon::orm::Result&) {},
+                        [](const drogon::orm::DrogonDbException& e) {
+                            LOG_WARN << "settings insert error: " << e.base().what();
+                        }, uid);
+
+                    Json::Value resp;
+                    resp["id"]       = Json::Int64(uid);
+                    resp["username"] = username;
+                    (*cbSh)(jsonResp(resp, drogon::k201Created));
+                },
+                [cbSh](const drogon::orm::DrogonDbException& e) mutable {
+                    std::string what = e.base().what();
+                    if (what.find("unique") != std::string::npos ||
+                        what.find("duplicate") != std::string::npos)
+                        (*cbSh)(err("Username or email already taken", drogon::k409Conflict));
+                    else {
+                        LOG_ERROR << "register DB error: " << what;
+                        (*cbSh)(err("Internal error", drogon::k500InternalServerError));
+                    }
+                },
+                username, email, hash, displayName);
+        });
+    if (!queued) (*cbSh)(busy());
+}
 
-            Json::Value resp;
-            resp["id"]       = Json::Int64(uid);
-            resp["username"] = username;
-            (*cbSh)(jsonResp(resp, drogon::k201Created));
-        },
-        [cbSh](const drogon::orm::DrogonDbException& e) mutable {
-            std::string what = e.base().what();
-            if (what.find("unique") != std::string::npos ||
-                what.find("duplicate") != std::string::npos)
-                (*cbSh)(err("Username or email already taken", drogon::k409Conflict));
-            else {
-                LOG_ERROR << "register DB error: " << what;
-                (*cbSh)(err("Internal error", drogon::k500InternalServerError));
-            }
-        },
-        username, email, hash, displayName);
+// Mint the access/refresh pair for an authenticated user and respond.
+static void issueTokens(long long uid, bool isAdmin,
+                        const std::function<void(const drogon::HttpResponsePtr&)>& cb) {
+    auto& jwt = JwtService::instance();
+    std::string accessToken  = jwt.createAccessToken(uid, isAdmin);
+    std::string refreshToken = jwt.createRefreshToken(uid, isAdmin);
+
+    // Persist refresh token hash
+    std::string tokenHash;
+    {
+        unsigned char digest[32];
+        unsigned int dlen = 0;
+        HMAC(EVP_sha256(), "refresh-hash-key", 16,
+             reinterpret_cast<const unsigned char*>(refreshToken.data()),
+             refreshToken.size(), digest, &dlen);
+        std::ostringstream ss;
+        for (unsigned int i = 0; i < dlen; i++)
+            ss << std::hex << std::setw(2) << std::setfill('0') << (int)digest[i];
+        tokenHash = ss.str();
+    }
+
+    auto db2 = drogon::app().getDbClient();
+    db2->execSqlAsync(
+        "INSERT INTO refresh_tokens (user_id, token_hash, expires_at) "
+        "VALUES ($1, $2, NOW() + INTERVAL '7 days')",
+        [](const drogon::orm::Result&) {},
+        [](const drogon::orm::DrogonDbException& e) {
+            LOG_WARN << "refresh token persist error: " << e.base().what();
+        }, uid, tokenHash);
+
+    // Update last_activity for admin dashboard metrics
+    db2->execSqlAsync(
+        "UPDATE users SET last_activity = NOW() WHERE id = $1",
+        [](const drogon::orm::Result&) {},
+        [](const drogon::orm::DrogonDbException&) {},
+        uid);
+
+    Json::Value resp;
+    resp["access_token"]  = accessToken;
+    resp["refresh_token"] = refreshToken;
+    resp["token_type"]    = "Bearer";
+    resp["expires_in"]    = Config::get().jwtAccessTtl;
+    resp["user_id"]       = Json::Int64(uid);
+    cb(jsonResp(resp, drogon::k200OK));
 }
 
 // ── POST /auth/login ───────────────────────────────────────────────────────
@@ -143,50 +206,14 @@ void AuthController::loginUser(const drogon::HttpRequestPtr& req,
             if (isBlocked)
                 return cb(err("Account blocked. Contact support.", drogon::k403Forbidden));
 
-            if (!verifyPassword(password, stored))
-                return cb(err("Invalid credentials", drogon::k401Unauthorized));
-
-            auto& jwt = JwtService::instance();
-            std::string accessToken  = jwt.createAccessToken(uid, isAdmin);
-            std::string refreshToken = jwt.createRefreshToken(uid, isAdmin);
-
-            // Persist refresh token hash
-            std::string tokenHash;
-            {
-                unsigned char digest[32];
-                unsigned int dlen = 0;
-                HMAC(EVP_sha256(), "refresh-hash-key", 16,
-                     reinterpret_cast<const unsigned char*>(refreshToken.data()),
-                     refreshToken.size(), digest, &dlen);
-                std::ostringstream ss;
-                for (unsigned int i = 0; i < dlen; i++)
-                    ss << std::hex << std::setw(2) << std::setfill('0') << (int)digest[i];
-                tokenHash = ss.str();
-            }
-
-            auto db2 = drogon::app().getDbClient();
-            db2->execSqlAsync(
-                "INSERT INTO refresh_tokens (user_id, token_hash, expires_at) "
-                "VALUES ($1, $2, NOW() + INTERVAL '7 days')",
-                [](const drogon::orm::Result&) {},
-                [](const drogon::orm::DrogonDbException& e) {
-                    LOG_WARN << "refresh token persist error: " << e.base().what();
-                }, uid, tokenHash);
-
-            // Update last_activity for admin dashboard metrics
-            db2->execSqlAsync(
-                "UPDATE users SET last_activity = NOW() WHERE id = $1",
-                [](const drogon::orm::Result&) {},
-                [](const drogon::orm::DrogonDbException&) {},
-                uid);
-
-            Json::Value resp;
-            resp["access_token"]  = accessToken;
-            resp["refresh_token"] = refreshToken;
-            resp["token_type"]    = "Bearer";
-            resp["expires_in"]    = Config::get().jwtAccessTtl;
-            resp["user_id"]       = Json::Int64(uid);
-            cb(jsonResp(resp, drogon::k200OK));
+            // PBKDF2 runs on the crypto pool; the response is sent from there
+            bool queued = CryptoPool::instance().submit("pbkdf2_verify",
+                [cbSh, password, stored, uid, isAdmin] {
+                    if (!verifyPassword(password, stored))
+                        return (*cbSh)(err("Invalid credentials", drogon::k401Unauthorized));
+                    issueTokens(uid, isAdmin, *cbSh);
+                });
+            if (!queued) cb(busy());
         },
         [cbSh](const drogon::orm::DrogonDbException& e) mutable {
             LOG_ERROR << "login DB error: " << e.base().what();
@@ -239,7 +266,7 @@ void AuthController::getMe(const drogon::HttpRequestPtr& req,
     auto db = drogon::app().getDbClient();
     db->execSqlAsync(
         "SELECT u.id, u.username, u.email, u.display_name, u.bio, u.created_at, u.is_admin, "
-        "       f.bucket AS avatar_bucket, f.object_key AS avatar_key "
+        "       f.bucket AS avatar_bucket, f.object_key AS avatar_key, f.thumb_key AS avatar_thumb_key "
         "FROM users u LEFT JOIN files f ON f.id = u.avatar_file_id "
         "WHERE u.id = $1",
         [cb](const drogon::orm::Result& r) mutable {
@@ -257,15 +284,21 @@ void AuthController::getMe(const drogon::HttpRequestPtr& req,
 
             std::string avBucket = r[0]["avatar_bucket"].isNull() ? "" : r[0]["avatar_bucket"].as<std::string>();
             std::string avKey    = r[0]["avatar_key"].isNull()    ? "" : r[0]["avatar_key"].as<std::string>();
+            std::string avThumb  = r[0]["avatar_thumb_key"].isNull() ? "" : r[0]["avatar_thumb_key"].as<std::string>();
+            resp["avatar_url"]       = Json::Value();
+            resp["avatar_thumb_url"] = Json::Value();
+            const auto& cfg = Config::get();
             if (!avKey.empty()) {
-                const auto& cfg = Config::get();
-                std::string url = minio_presign::generatePresignedUrl(
+                resp["avatar_url"] = minio_presign::generatePresignedUrl(
                     cfg.minioEndpoint, cfg.minioPublicUrl,
                     avBucket, avKey,
                     cfg.minioAccessKey, cfg.minioSecretKey, cfg.presignTtl);
-                resp["avatar_url"] = url;
-            } else {
-                resp["avatar_url"] = Json::Value();
+            }
+            if (!avThumb.empty()) {
+                resp["avatar_thumb_url"] = minio_presign::generatePresignedUrl(
+                    cfg.minioEndpoint, cfg.minioPublicUrl,
+                    avBucket, avThumb,
+                    cfg.minioAccessKey, cfg.minioSecretKey, cfg.presignTtl);
             }
             cb(jsonResp(resp, drogon::k200OK));
         },
@@ -2,6 +2,8 @@
 #include "../config/Config.h"
 #include "../utils/MinioPresign.h"
 #include "../ws/WsHandler.h"
+#include "../services/MembershipCache.h"
+#include "../services/PresenceService.h"
 #include <drogon/orm/DbClient.h>
 #include <trantor/utils/Logger.h>
 
@@ -100,13 +102,16 @@ void ChatsController::createChat(const drogon::HttpRequestPtr& req,
                         db3->execSqlAsync(
                             "INSERT INTO chat_members (chat_id, user_id, role) VALUES ($1, $2, 'owner') ON CONFLICT DO NOTHING",
                             [cb, members, me, type, chatId, title](const drogon::orm::Result&) mutable {
+                                MembershipCache::instance().invalidateMember(chatId, me);
                                 // Insert other member fire-and-forget
                                 auto db4 = drogon::app().getDbClient();
                                 for (auto uid : members) {
                                     if (uid == me) continue;
                                     db4->execSqlAsync(
                                         "INSERT INTO chat_members (chat_id, user_id, role) VALUES ($1, $2, 'member') ON CONFLICT DO NOTHING",
-                                        [](const drogon::orm::Result&) {},
+                                        [chatId, uid](const drogon::orm::Result&) {
+                                            MembershipCache::instance().invalidateMember(chatId, uid);
+                                        },
                                         [](const drogon::orm::DrogonDbException& e) {
                                             LOG_WARN << "member insert: " << e.base().what();
                                         }, chatId, uid);
@@ -162,6 +167,7 @@ void ChatsController::createChat(const drogon::HttpRequestPtr& req,
             db2->execSqlAsync(
                 "INSERT INTO chat_members (chat_id, user_id, role) VALUES ($1, $2, 'owner') ON CONFLICT DO NOTHING",
                 [cb, members, me, type, title, chatId](const drogon::orm::Result&) mutable {
+                    MembershipCache::instance().invalidateMember(chatId, me);
                     // Fire-and-forget remaining members
                     if (members.size() > 1) {
                         auto db3 = drogon::app().getDbClient();
@@ -169,7 +175,9 @@ void ChatsController::createChat(const drogon::HttpRequestPtr& req,
                             if (uid == me) continue;
                             db3->execSqlAsync(
                                 "INSERT INTO chat_members (chat_id, user_id, role) VALUES ($1, $2, 'member') ON CONFLICT DO NOTHING",
-                                [](const drogon::orm::Result&) {},
+                                [chatId, uid](const drogon::orm::Result&) {
+                                    MembershipCache::instance().invalidateMember(chatId, uid);
+                                },
                                 [](const drogon::orm::DrogonDbException& e) {
                                     LOG_WARN << "member insert: " << e.base().what();
                                 }, chatId, uid);
@@ -208,34 +216,35 @@ void ChatsController::createChat(const drogon::HttpRequestPtr& req,
         }, type, name, title, description, publicName, me);
 }
 
-// GET /chats — with DM enrichment, favorites, mute status
+// GET /chats — with DM enrichment, favorites, mute status.
+// Last message, member count and unread count come from chat_summary (kept
+// current by triggers, see V22), so the query never scans messages.
 void ChatsController::listChats(const drogon::HttpRequestPtr& req,
                                  std::function<void(const drogon::HttpResponsePtr&)>&& cb) {
     long long me = req->getAttributes()->get<long long>("user_id");
     auto db = drogon::app().getDbClient();
     db->execSqlAsync(
         "SELECT c.id, c.type, c.name, c.title, c.description, c.public_name, c.updated_at, "
-        "    (SELECT m.content FROM messages m WHERE m.chat_id = c.id ORDER BY m.created_at DESC LIMIT 1) AS last_msg, "
-        "    (SELECT m.created_at FROM messages m WHERE m.chat_id = c.id ORDER BY m.created_at DESC LIMIT 1) AS last_msg_at, "
+        "    cs.last_msg_preview AS last_msg, "
+        "    cs.last_msg_at, "
         "    ou.id           AS other_user_id, "
         "    ou.username     AS other_username, "
         "    COALESCE(ou.display_name, ou.username) AS other_display_name, "
         "    ouf.bucket      AS other_avatar_bucket, "
         "    ouf.object_key  AS other_avatar_key, "
+        "    ouf.thumb_key   AS other_avatar_thumb_key, "
         "    caf.bucket      AS chat_avatar_bucket, "
         "    caf.object_key  AS chat_avatar_key, "
-        "    (SELECT COUNT(*) FROM chat_members cm3 WHERE cm3.chat_id = c.id) AS member_count, "
+        "    caf.thumb_key   AS chat_avatar_thumb_key, "
+        "    cs.member_count, "
         "    (cf.chat_id IS NOT NULL) AS is_favorite, "
         "    (cms.user_id IS NOT NULL) AS is_muted, "
         "    (pc.chat_id IS NOT NULL) AS is_pinned, "
         "    (ac.chat_id IS NOT NULL) AS is_archived, "
-        "    COALESCE(( "
-        "        SELECT COUNT(*) FROM messages m2 "
-        "        WHERE m2.chat_id = c.id AND m2.id > COALESCE(clr.last_read_msg_id, 0) "
-        "          AND m2.sender_id != $1 "
-        "    ), 0) AS unread_count "
+        "    GREATEST(cs.msg_seq - COALESCE(clr.last_read_seq, 0), 0) AS unread_count "
         "FROM chats c "
         "JOIN chat_members cm ON cm.chat_id = c.id AND cm.user_id = $1 "
+        "LEFT JOIN chat_summary cs ON cs.chat_id = c.id "
         "LEFT JOIN LATERAL ( "
         "    SELECT u2.id, u2.username, u2.display_name, u2.avatar_file_id "
         "    FROM chat_members cm2 JOIN users u2 ON u2.id = cm2.user_id "
@@ -253,6 +262,7 @@ void ChatsController::listChats(const drogon::HttpRequestPtr& req,
         "ORDER BY (pc.chat_id IS NOT NULL) DESC, (cf.chat_id IS NOT NULL) DESC, c.updated_at DESC",
         [cb](const drogon::orm::Result& r) mutable {
             Json::Value arr(Json::arrayValue);
+            std::vector<long long> peers;
             for (auto& row : r) {
                 Json::Value chat;
                 chat["id"]          = Json::Int64(row["id"].as<long long>());
@@ -276,29 +286,45 @@ void ChatsController::listChats(const drogon::HttpRequestPtr& req,
                     chat["other_user_id"]      = Json::Int64(otherUid);
                     chat["other_username"]     = row["other_username"].isNull() ? Json::Value() : Json::Value(row["other_username"].as<std::string>());
                     chat["other_display_name"] = row["other_display_name"].isNull() ? Json::Value() : Json::Value(row["other_display_name"].as<std::string>());
-                    chat["other_is_online"]    = WsHandler::isUserOnline(otherUid);
+                    chat["other_is_online"]    = false;  // filled in below
+                    peers.push_back(otherUid);
 
                     std::string avBucket = row["other_avatar_bucket"].isNull() ? "" : row["other_avatar_bucket"].as<std::string>();
                     std::string avKey    = row["other_avatar_key"].isNull()    ? "" : row["other_avatar_key"].as<std::string>();
-                    std::string url = avatarUrl(avBucket, avKey);
-                    chat["other_avatar_url"] = url.empty() ? Json::Value() : Json::Value(url);
+                    std::string avThumbKey = row["other_avatar_thumb_key"].isNull() ? "" : row["other_avatar_thumb_key"].as<std::string>();
+                    std::string url      = avatarUrl(avBucket, avKey);
+                    std::string thumbUrl = avatarUrl(avBucket, avThumbKey);
+                    chat["other_avatar_url"]       = url.empty()      ? Json::Value() : Json::Value(url);
+                    chat["other_avatar_thumb_url"] = thumbUrl.empty() ? Json::Value() : Json::Value(thumbUrl);
                 } else {
-                    chat["other_user_id"]      = Json::Value();
-                    chat["other_username"]     = Json::Value();
-                    chat["other_display_name"] = Json::Value();
-                    chat["other_avatar_url"]   = Json::Value();
+                    chat["other_user_id"]          = Json::Value();
+                    chat["other_username"]         = Json::Value();
+                    chat["other_display_name"]     = Json::Value();
+                    chat["other_avatar_url"]       = Json::Value();
+                    chat["other_avatar_thumb_url"] = Json::Value();
                 }
 
                 // Chat avatar (groups/channels)
                 std::string chatAvBucket = row["chat_avatar_bucket"].isNull() ? "" : row["chat_avatar_bucket"].as<std::string>();
                 std::string chatAvKey    = row["chat_avatar_key"].isNull()    ? "" : row["chat_avatar_key"].as<std::string>();
-                std::string chatAvUrl    = avatarUrl(chatAvBucket, chatAvKey);
-                chat["avatar_url"] = chatAvUrl.empty() ? Json::Value() : Json::Value(chatAvUrl);
+                std::string chatAvThumbKey = row["chat_avatar_thumb_key"].isNull() ? "" : row["chat_avatar_thumb_key"].as<std::string>();
+                std::string chatAvUrl      = avatarUrl(chatAvBucket, chatAvKey);
+                std::string chatAvThumbUrl = avatarUrl(chatAvBucket, chatAvThumbKey);
+                chat["avatar_url"]       = chatAvUrl.empty()      ? Json::Value() : Json::Value(chatAvUrl);
+                chat["avatar_thumb_url"] = chatAvThumbUrl.empty() ? Json::Value() : Json::Value(chatAvThumbUrl);
                 chat["member_count"] = Json::Int64(row["member_count"].isNull() ? 0 : row["member_count"].as<long long>());
 
                 arr.append(chat);
             }
-            cb(drogon::HttpResponse::newHttpJsonResponse(arr));
+            // Online status of every DM peer, cluster-wide, in one lookup
+            PresenceService::instance().lookupOnline(std::move(peers),
+                [cb, arr](const std::unordered_set<long long>& online) mutable {
+                    for (auto& chat : arr) {
+                        if (chat["other_user_id"].isNull()) continue;
+                        chat["other_is_online"] = online.count(chat["other_user_id"].asInt64()) > 0;
+                    }
+                    cb(drogon::HttpResponse::newHttpJsonResponse(arr));
+                });
         },
         [cb](const drogon::orm::DrogonDbException& e) mutable {
             LOG_ERROR << "listChats: " << e.base().what();
@@ -306,15 +332,11 @@ void ChatsController::listChats(const drogon::HttpRequestPtr& req,
         }, me);
 }
 
-// Helper: verify membership and run callback with (isMember, role)
+// Membership check served from MembershipCache (no query on a warm cache)
 static void requireMemberChat(long long chatId, long long userId,
                                std::function<void(bool)> cb) {
-    auto db = drogon::app().getDbClient();
-    db->execSqlAsync(
-        "SELECT 1 FROM chat_members WHERE chat_id = $1 AND user_id = $2",
-        [cb](const drogon::orm::Result& r) { cb(!r.empty()); },
-        [cb](const drogon::orm::DrogonDbException&) { cb(false); },
-        chatId, userId);
+    MembershipCache::instance().lookup(chatId, userId,
+        [cb = std::move(cb)](const MembershipCache::Membership& m) { cb(m.isMember); });
 }
 
 // POST /chats/{id}/favorite
@@ -453,6 +475,7 @@ void ChatsController::leaveChat(const drogon::HttpRequestPtr& req,
             db2->execSqlAsync(
                 "DELETE FROM chat_members WHERE chat_id = $1 AND user_id = $2",
                 [cb, chatId, me](const drogon::orm::Result&) mutable {
+                    MembershipCache::instance().invalidateMember(chatId, me);
                     // Notify chat members about the departure
                     Json::Value wsPayload;
                     wsPayload["type"]    = "chat_member_left";
@@ -485,7 +508,8 @@ void ChatsController::getChat(const drogon::HttpRequestPtr& req,
     auto db = drogon::app().getDbClient();
     db->execSqlAsync(
         "SELECT c.id, c.type, c.name, c.title, c.description, c.public_name, c.owner_id, c.created_at, "
-        "    caf.bucket AS chat_avatar_bucket, caf.object_key AS chat_avatar_key "
+        "    caf.bucket AS chat_avatar_bucket, caf.object_key AS chat_avatar_key, "
+        "    caf.thumb_key AS chat_avatar_thumb_key "
         "FROM chats c "
         "JOIN chat_members cm ON cm.chat_id = c.id "
         "LEFT JOIN files caf ON caf.id = c.avatar_file_id "
@@ -506,13 +530,17 @@ void ChatsController::getChat(const drogon::HttpRequestPtr& req,
             // Chat avatar
             std::string chatAvBucket = row["chat_avatar_bucket"].isNull() ? "" : row["chat_avatar_bucket"].as<std::string>();
             std::string chatAvKey    = row["chat_avatar_key"].isNull()    ? "" : row["chat_avatar_key"].as<std::string>();
-            std::string chatAvUrl    = avatarUrl(chatAvBucket, chatAvKey);
-            chat["avatar_url"] = chatAvUrl.empty() ? Json::Value() : Json::Value(chatAvUrl);
+            std::string chatAvThumbKey = row["chat_avatar_thumb_key"].isNull() ? "" : row["chat_avatar_thumb_key"].as<std::string>();
+            std::string chatAvUrl      = avatarUrl(chatAvBucket, chatAvKey);
+            std::string chatAvThumbUrl = avatarUrl(chatAvBucket, chatAvThumbKey);
+            chat["avatar_url"]       = chatAvUrl.empty()      ? Json::Value() : Json::Value(chatAvUrl);
+            chat["avatar_thumb_url"] = chatAvThumbUrl.empty() ? Json::Value() : Json::Value(chatAvThumbUrl);
 
             auto db2 = drogon::app().getDbClient();
             db2->execSqlAsync(
                 "SELECT u.id, u.username, u.display_name, cm.role, cm.joined_at, "
-                "       f.bucket AS avatar_bucket, f.object_key AS avatar_key "
+                "       f.bucket AS avatar_bucket, f.object_key AS avatar_key, "
+                "       f.thumb_key AS avatar_thumb_key "
                 "FROM chat_members cm JOIN users u ON u.id = cm.user_id "
                 "LEFT JOIN files f ON f.id = u.avatar_file_id "
                 "WHERE cm.chat_id = $1",
@@ -527,8 +555,11 @@ void ChatsController::getChat(const drogon::HttpRequestPtr& req,
                         mem["joined_at"]    = m["joined_at"].isNull() ? Json::Value() : Json::Value(m["joined_at"].as<std::string>());
                         std::string avBucket = m["avatar_bucket"].isNull() ? "" : m["avatar_bucket"].as<std::string>();
                         std::string avKey    = m["avatar_key"].isNull()    ? "" : m["avatar_key"].as<std::string>();
-                        std::string url = avatarUrl(avBucket, avKey);
-                        mem["avatar_url"]   = url.empty() ? Json::Value() : Json::Value(url);
+                        std::string avThumbKey = m["avatar_thumb_key"].isNull() ? "" : m["avatar_thumb_key"].as<std::string>();
+                        std::string url      = avatarUrl(avBucket, avKey);
+                        std::string thumbUrl = avatarUrl(avBucket, avThumbKey);
+                        mem["avatar_url"]       = url.empty()      ? Json::Value() : Json::Value(url);
+                        mem["avatar_thumb_url"] = thumbUrl.empty() ? Json::Value() : Json::Value(thumbUrl);
                         members.append(mem);
                         if (m["id"].as<long long>() == me)
                             chat["my_role"] = m["role"].as<std::string>();
@@ -555,10 +586,12 @@ void ChatsController::markRead(const drogon::HttpRequestPtr& req,
     long long me = req->getAttributes()->get<long long>("user_id");
     auto db = drogon::app().getDbClient();
     db->execSqlAsync(
-        "INSERT INTO chat_last_read (user_id, chat_id, last_read_msg_id, read_at) "
-        "SELECT $1, $2, COALESCE(MAX(m.id), 0), NOW() FROM messages m WHERE m.chat_id = $2 "
+        "INSERT INTO chat_last_read (user_id, chat_id, last_read_msg_id, last_read_seq, read_at) "
+        "SELECT $1, $2, COALESCE(cs.last_msg_id, 0), cs.msg_seq, NOW() "
+        "FROM chat_summary cs WHERE cs.chat_id = $2 "
         "ON CONFLICT (user_id, chat_id) DO UPDATE SET "
         "  last_read_msg_id = GREATEST(chat_last_read.last_read_msg_id, EXCLUDED.last_read_msg_id), "
+        "  last_read_seq    = GREATEST(chat_last_read.last_read_seq, EXCLUDED.last_read_seq), "
         "  read_at = NOW() "
         "RETURNING last_read_msg_id",
         [cb, me, chatId](const drogon::orm::Result& r) mutable {
@@ -789,6 +822,7 @@ void ChatsController::deleteChat(const drogon::HttpRequestPtr& req,
                     db3->execSqlAsync(
                         "DELETE FROM chats WHERE id = $1",
                         [cb, chatId, me, memberIds](const drogon::orm::Result&) mutable {
+                            MembershipCache::instance().invalidateChat(chatId);
                             // Notify all members via user channels (chat channel is gone after CASCADE)
                             Json::Value wsPayload;
                             wsPayload["type"]       = "chat_deleted";
@@ -951,23 +985,26 @@ void ChatsController::setChatAvatar(const drogon::HttpRequestPtr& req,
                     // Get presigned URL for the avatar
                     auto db3 = drogon::app().getDbClient();
                     db3->execSqlAsync(
-                        "SELECT f.bucket, f.object_key FROM files f WHERE f.id = $1",
+                        "SELECT f.bucket, f.object_key, COALESCE(f.thumb_key, '') AS thumb_key "
+                        "FROM files f WHERE f.id = $1",
                         [cb, chatId](const drogon::orm::Result& r3) mutable {
                             Json::Value resp;
+                            resp["avatar_url"]       = Json::Value();
+                            resp["avatar_thumb_url"] = Json::Value();
                             if (!r3.empty()) {
-                                std::string url = avatarUrl(
-                                    r3[0]["bucket"].as<std::string>(),
-                                    r3[0]["object_key"].as<std::string>());
-                                resp["avatar_url"] = url.empty() ? Json::Value() : Json::Value(url);
-                            } else {
-                                resp["avatar_url"] = Json::Value();
+                                std::string bucket   = r3[0]["bucket"].as<std::string>();
+                                std::string url      = avatarUrl(bucket, r3[0]["object_key"].as<std::string>());
+                                std::string thumbUrl = avatarUrl(bucket, r3[0]["thumb_key"].as<std::string>());
+                                if (!url.empty())      resp["avatar_url"]       = url;
+                                if (!thumbUrl.empty()) resp["avatar_thumb_url"] = thumbUrl;
                             }
 
                             // Broadcast chat_updated with new avatar_url
                             Json::Value wsPayload;
-                            wsPayload["type"]       = "chat_updated";
-                            wsPayload["chat_id"]    = Json::Int64(chatId);
-                            wsPayload["avatar_url"] = resp["avatar_url"];
+                            wsPayload["type"]             = "chat_updated";
+                            wsPayload["chat_id"]          = Json::Int64(chatId);
+                            wsPayload["avatar_url"]       = resp["avatar_url"];
+                            wsPayload["avatar_thumb_url"] = resp["avatar_thumb_url"];
                             WsDispatch::publishMessage(chatId, wsPayload);
 
                             cb(drogon::HttpResponse::newHttpJsonResponse(resp));
@@ -1006,8 +1043,9 @@ void ChatsController::promoteMember(const drogon::HttpRequestPtr& req,
             db2->execSqlAsync(
                 "UPDATE chat_members SET role = 'admin' WHERE chat_id = $1 AND user_id = $2 AND role = 'member' "
                 "RETURNING user_id",
-                [cb](const drogon::orm::Result& r2) mutable {
+                [cb, chatId, userId](const drogon::orm::Result& r2) mutable {
                     if (r2.empty()) return cb(jsonErr("User not found or already admin/owner", drogon::k404NotFound));
+                    MembershipCache::instance().invalidateMember(chatId, userId);
                     Json::Value resp;
                     resp["role"] = "admin";
                     cb(drogon::HttpResponse::newHttpJsonResponse(resp));
@@ -1041,8 +1079,9 @@ void ChatsController::demoteMember(const drogon::HttpRequestPtr& req,
             db2->execSqlAsync(
                 "UPDATE chat_members SET role = 'member' WHERE chat_id = $1 AND user_id = $2 AND role = 'admin' "
                 "RETURNING user_id",
-                [cb](const drogon::orm::Result& r2) mutable {
+                [cb, chatId, userId](const drogon::orm::Result& r2) mutable {
                     if (r2.empty()) return cb(jsonErr("User not found or not an admin", drogon::k404NotFound));
+                    MembershipCache::instance().invalidateMember(chatId, userId);
                     Json::Value resp;
                     resp["role"] = "member";
                     cb(drogon::HttpResponse::newHttpJsonResponse(resp));
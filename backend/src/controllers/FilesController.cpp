@@ -1,8 +1,11 @@
 #include "FilesController.h"
 #include "../config/Config.h"
+#include "../services/CryptoPool.h"
+#include "../services/ImagePipeline.h"
+#include "../services/MetricsService.h"
+#include "../services/ObjectStore.h"
 #include "../utils/MinioPresign.h"
 #include <drogon/orm/DbClient.h>
-#include <drogon/HttpClient.h>
 #include <drogon/MultiPart.h>
 
 // contentTypeToMime is defined in libdrogon but not exposed in a public header.
@@ -10,14 +13,11 @@ namespace drogon {
     const std::string_view& contentTypeToMime(ContentType ct);
 }
 #include <trantor/utils/Logger.h>
-#include <openssl/hmac.h>
-#include <openssl/sha.h>
-#include <openssl/evp.h>
 #include <json/json.h>
 #include <uuid/uuid.h>
+#include <algorithm>
+#include <cctype>
 #include <chrono>
-#include <sstream>
-#include <iomanip>
 #include <ctime>
 
 // ── Helpers ────────────────────────────────────────────────────────────────
@@ -29,120 +29,126 @@ static drogon::HttpResponsePtr jsonErr(const std::string& msg, drogon::HttpStatu
     return r;
 }
 
-static std::string toHex(const unsigned char* d, size_t len) {
-    std::ostringstream ss;
-    for (size_t i = 0; i < len; i++)
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)d[i];
-    return ss.str();
-}
+// Use shared MinioPresign utility — generatePresignedUrl is in minio_presign namespace
+using minio_presign::generatePresignedUrl;
+using minio_presign::generatePresignedPutUrl;
+using minio_presign::sha256Hex;
 
-static std::string sha256Hex(const std::string& s) {
-    unsigned char h[SHA256_DIGEST_LENGTH];
-    SHA256(reinterpret_cast<const unsigned char*>(s.data()), s.size(), h);
-    return toHex(h, SHA256_DIGEST_LENGTH);
-}
+// ── UUID generator ─────────────────────────────────────────────────────────
 
-static std::vector<unsigned char> hmacSha256Raw(const std::string& key, const std::string& msg) {
-    std::vector<unsigned char> h(32); unsigned int hlen = 0;
-    HMAC(EVP_sha256(), key.data(), static_cast<int>(key.size()),
-         reinterpret_cast<const unsigned char*>(msg.data()), msg.size(),
-         h.data(), &hlen);
-    h.resize(hlen);
-    return h;
+static std::string newUuid() {
+    uuid_t u;
+    uuid_generate_random(u);
+    char s[37]; uuid_unparse_lower(u, s);
+    return std::string(s);
 }
 
-static std::vector<unsigned char> hmacSha256Raw(const std::vector<unsigned char>& key,
-                                                 const std::string& msg) {
-    std::vector<unsigned char> h(32); unsigned int hlen = 0;
-    HMAC(EVP_sha256(), key.data(), static_cast<int>(key.size()),
-         reinterpret_cast<const unsigned char*>(msg.data()), msg.size(),
-         h.data(), &hlen);
-    h.resize(hlen);
-    return h;
+static Json::Value fileJson(long long id, const std::string& filename, const std::string& mime,
+                            const std::string& objectKey, long long size) {
+    Json::Value j;
+    j["id"]         = Json::Int64(id);
+    j["filename"]   = filename;
+    j["mime_type"]  = mime;
+    j["object_key"] = objectKey;
+    j["size_bytes"] = Json::Int64(size);
+    return j;
 }
 
-// ── AWS Signature V4 helpers (PUT signing) ─────────────────────────────────
+static const char* const kFileColumns =
+    "id, filename, COALESCE(mime_type, '') AS mime_type, object_key, COALESCE(size_bytes, 0) AS size_bytes";
 
-static std::vector<unsigned char> sigV4SigningKey(const std::string& secretKey,
-                                                   const std::string& date,
-                                                   const std::string& region,
-                                                   const std::string& service) {
-    auto kDate    = hmacSha256Raw("AWS4" + secretKey, date);
-    auto kRegion  = hmacSha256Raw(kDate, region);
-    auto kService = hmacSha256Raw(kRegion, service);
-    return hmacSha256Raw(kService, "aws4_request");
+// A row selected with kFileColumns.
+static Json::Value fileJson(const drogon::orm::Row& row) {
+    return fileJson(row["id"].as<long long>(), row["filename"].as<std::string>(),
+                    row["mime_type"].as<std::string>(), row["object_key"].as<std::string>(),
+                    row["size_bytes"].as<long long>());
 }
 
-// Produce a SigV4 Authorization header for a direct PUT to MinIO.
-// Signs: host, x-amz-content-sha256, x-amz-date.
-static void sigV4PutHeaders(const std::string& host,
-                             const std::string& uri,
-                             const std::string& accessKey,
-                             const std::string& secretKey,
-                             const std::string& contentType,
-                             const std::string& body,
-                             // out-params
-                             std::string& outDate,
-                             std::string& outContentSha,
-                             std::string& outAuth) {
-    const std::string region  = "us-east-1";
-    const std::string service = "s3";
-
-    std::time_t now = std::time(nullptr);
-    char dateBuf[9], timeBuf[17];
-    std::tm* utc = std::gmtime(&now);
-    std::strftime(dateBuf, sizeof(dateBuf),  "%Y%m%d",        utc);
-    std::strftime(timeBuf, sizeof(timeBuf),  "%Y%m%dT%H%M%SZ", utc);
-    std::string date(dateBuf), datetime(timeBuf);
-
-    outDate        = datetime;
-    outContentSha  = sha256Hex(body);
-
-    // Canonical headers (must be sorted alphabetically)
-    std::string canonicalHeaders =
-        "content-type:" + contentType + "\n"
-        "host:" + host + "\n"
-        "x-amz-content-sha256:" + outContentSha + "\n"
-        "x-amz-date:" + datetime + "\n";
-    std::string signedHeaders = "content-type;host;x-amz-content-sha256;x-amz-date";
-
-    std::string canonicalRequest =
-        "PUT\n" + uri + "\n\n" +
-        canonicalHeaders + "\n" +
-        signedHeaders + "\n" +
-        outContentSha;
-
-    std::string credScope = date + "/" + region + "/" + service + "/aws4_request";
-    std::string stringToSign =
-        "AWS4-HMAC-SHA256\n" + datetime + "\n" + credScope + "\n" +
-        sha256Hex(canonicalRequest);
-
-    auto kSigning = sigV4SigningKey(secretKey, date, region, service);
-    unsigned char h[32]; unsigned int hlen = 0;
-    HMAC(EVP_sha256(), kSigning.data(), static_cast<int>(kSigning.size()),
-         reinterpret_cast<const unsigned char*>(stringToSign.data()),
-         stringToSign.size(), h, &hlen);
-    std::string signature = toHex(h, hlen);
-
-    outAuth = "AWS4-HMAC-SHA256 Credential=" + accessKey + "/" + credScope +
-              ", SignedHeaders=" + signedHeaders +
-              ", Signature=" + signature;
+static std::string tooLargeMessage() {
+    return "File too large (max " + std::to_string(Config::get().maxFileSizeMb) + " MB)";
 }
 
-// Use shared MinioPresign utility — generatePresignedUrl is in minio_presign namespace
-using minio_presign::generatePresignedUrl;
+// Crypto queue full — same answer as login/register.
+static drogon::HttpResponsePtr busy() {
+    auto resp = jsonErr("Server busy, retry shortly", drogon::k503ServiceUnavailable);
+    resp->addHeader("Retry-After", "1");
+    return resp;
+}
 
-// ── UUID generator ─────────────────────────────────────────────────────────
+using RespondPtr = std::shared_ptr<std::function<void(const drogon::HttpResponsePtr&)>>;
+
+// Content already stored: give this upload its own files row (own uploader,
+// filename and type) on the existing blob's object, with any image variants
+// rendered so far. No row when the content is not stored.
+// $1 sha256, $2 size, $3 uploader, $4 filename, $5 mime type.
+static std::string linkBlobSql(const char* extraCond) {
+    return std::string(
+        "WITH b AS (SELECT bucket, object_key, size_bytes FROM blobs "
+        "           WHERE sha256 = $1 AND size_bytes = $2") + extraCond + ") "
+        "INSERT INTO files (uploader_id, bucket, object_key, filename, mime_type, size_bytes, "
+        "                   sha256, thumb_key, preview_key) "
+        "SELECT $3::BIGINT, b.bucket, b.object_key, $4::TEXT, $5::TEXT, b.size_bytes, $1, "
+        "       v.thumb_key, v.preview_key "
+        "FROM b LEFT JOIN LATERAL ("
+        "  SELECT thumb_key, preview_key FROM files "
+        "  WHERE object_key = b.object_key AND thumb_key IS NOT NULL LIMIT 1) v ON TRUE "
+        "RETURNING " + kFileColumns;
+}
+// For a hash the server computed from the bytes itself.
+static const std::string kLinkBlobSql = linkBlobSql("");
+// For a hash the client merely declares: it proves nothing about access to
+// the content, so only content the caller has uploaded before is linked.
+static const std::string kLinkOwnBlobSql = linkBlobSql(
+    " AND EXISTS (SELECT 1 FROM files WHERE sha256 = $1 AND uploader_id = $3::BIGINT)");
+
+// New content: store it as uploads/<sha256>, record the blob and insert the
+// row. A concurrent upload of the same content wrote the same object, so the
+// blob insert merges and each upload still gets its own row. Images whose
+// blob was actually inserted get their WebP variants rendered in the
+// background; on a merge the other upload already queued them.
+static void storeUpload(RespondPtr cbSh, std::shared_ptr<drogon::MultiPartParser> hold,
+                        long long me, const std::string& filename, const std::string& mime,
+                        const char* data, size_t len, const std::string& sha) {
+    std::string bucket    = Config::get().minioUploadsBucket;
+    std::string objectKey = "uploads/" + sha;
+    long long   sizeBytes = static_cast<long long>(len);
+    ObjectStore::instance().put(bucket, objectKey, mime, data, len, sha,
+                                [=, hold = std::move(hold)](bool ok) {
+        if (!ok) return (*cbSh)(jsonErr("Object storage upload failed", drogon::k502BadGateway));
 
-static std::string newUuid() {
-    uuid_t u;
-    uuid_generate_random(u);
-    char s[37]; uuid_unparse_lower(u, s);
-    return std::string(s);
+        auto db = drogon::app().getDbClient();
+        db->execSqlAsync(
+            std::string("WITH b AS ("
+                        "  INSERT INTO blobs (sha256, bucket, object_key, size_bytes) "
+                        "  VALUES ($7, $2, $3, $6) "
+                        "  ON CONFLICT (sha256) DO UPDATE SET sha256 = EXCLUDED.sha256 "
+                        "  RETURNING (xmax = 0) AS inserted) "
+                        "INSERT INTO files (uploader_id, bucket, object_key, filename, mime_type, "
+                        "size_bytes, sha256) "
+                        "SELECT $1::BIGINT, $2, $3, $4::TEXT, $5::TEXT, $6, $7 FROM b "
+                        "RETURNING ") + kFileColumns + ", (SELECT inserted FROM b) AS inserted",
+            [cbSh, bucket, objectKey, mime, sizeBytes](const drogon::orm::Result& r) {
+                MetricsService::instance().fileUpload(false);
+                if (r[0]["inserted"].as<bool>())
+                    ImagePipeline::instance().enqueue(r[0]["id"].as<long long>(), bucket, objectKey,
+                                                      mime, sizeBytes);
+                auto httpResp = drogon::HttpResponse::newHttpJsonResponse(fileJson(r[0]));
+                httpResp->setStatusCode(drogon::k201Created);
+                (*cbSh)(httpResp);
+            },
+            [cbSh](const drogon::orm::DrogonDbException& e) {
+                LOG_ERROR << "file metadata insert: " << e.base().what();
+                (*cbSh)(jsonErr("Internal error", drogon::k500InternalServerError));
+            },
+            me, bucket, objectKey, filename, mime, sizeBytes, sha);
+    });
 }
 
 // ── POST /files ────────────────────────────────────────────────────────────
 // Multipart upload. Stores object in MinIO, metadata in PostgreSQL.
+// Content-addressed: the file is hashed on the crypto pool, and content that
+// is already stored gets a new files row on the existing object
+// ("deduplicated": true) without sending anything to MinIO.
 
 void FilesController::uploadFile(const drogon::HttpRequestPtr& req,
                                   std::function<void(const drogon::HttpResponsePtr&)>&& cb) {
@@ -152,76 +158,265 @@ void FilesController::uploadFile(const drogon::HttpRequestPtr& req,
     // Validate size
     long long maxBytes = cfg.maxFileSizeMb * 1024 * 1024;
     if (static_cast<long long>(req->body().size()) > maxBytes)
-        return cb(jsonErr("File too large (max " + std::to_string(cfg.maxFileSizeMb) + " MB)",
-                          drogon::k413RequestEntityTooLarge));
+        return cb(jsonErr(tooLargeMessage(), drogon::k413RequestEntityTooLarge));
 
-    drogon::MultiPartParser mp;
-    if (mp.parse(req) != 0 || mp.getFiles().empty())
+    auto mp = std::make_shared<drogon::MultiPartParser>();
+    if (mp->parse(req) != 0 || mp->getFiles().empty())
         return cb(jsonErr("No file uploaded (use multipart/form-data field 'file')",
                           drogon::k400BadRequest));
 
-    const auto& files = mp.getFiles();
-    const auto& f     = files[0];
+    const auto& f     = mp->getFiles()[0];
     std::string orig  = f.getFileName();
     std::string mime  = std::string(drogon::contentTypeToMime(f.getContentType()));
-    std::string objectKey= "uploads/" + newUuid() + "_" + orig;
-    std::string bucket   = cfg.minioUploadsBucket;
-
-    // Upload to MinIO via HTTP PUT using AWS Signature V4.
-    std::string minioHost = cfg.minioEndpoint;
-    auto client = drogon::HttpClient::newHttpClient("http://" + minioHost);
-
-    std::string uri      = "/" + bucket + "/" + objectKey;
-    std::string bodyStr  = std::string(f.fileData(), f.fileLength());
-
-    std::string amzDate, contentSha, authHeader;
-    sigV4PutHeaders(minioHost, uri,
-                    cfg.minioAccessKey, cfg.minioSecretKey,
-                    mime, bodyStr,
-                    amzDate, contentSha, authHeader);
-
-    auto putReq = drogon::HttpRequest::newHttpRequest();
-    putReq->setMethod(drogon::Put);
-    putReq->setPath(uri);
-    putReq->setContentTypeString(mime);
-    putReq->setBody(bodyStr);
-    putReq->addHeader("x-amz-date",             amzDate);
-    putReq->addHeader("x-amz-content-sha256",   contentSha);
-    putReq->addHeader("Authorization",           authHeader);
-
-    client->sendRequest(putReq, [=, cb = std::move(cb)](
-            drogon::ReqResult result,
-            const drogon::HttpResponsePtr& minioResp) mutable {
-
-        if (result != drogon::ReqResult::Ok || !minioResp ||
-            minioResp->statusCode() >= 300) {
-            LOG_ERROR << "MinIO PUT failed: "
-                      << (minioResp ? std::to_string(minioResp->statusCode()) : "no response");
-            return cb(jsonErr("Object storage upload failed", drogon::k502BadGateway));
-        }
-
-        // Persist metadata
+    // f's data points into the request body, which Drogon spools to a mapped
+    // temp file past 64 KB; `mp` keeps it alive until the upload is done.
+    const char* data  = f.fileData();
+    size_t      len   = f.fileLength();
+
+    auto cbSh = std::make_shared<std::function<void(const drogon::HttpResponsePtr&)>>(std::move(cb));
+    bool queued = CryptoPool::instance().submit("sha256", [cbSh, mp, me, orig, mime, data, len] {
+        std::string sha = sha256Hex(data, len);
         auto db = drogon::app().getDbClient();
         db->execSqlAsync(
-            "INSERT INTO files (uploader_id, bucket, object_key, filename, mime_type, size_bytes) "
-            "VALUES ($1, $2, $3, $4, $5, $6) RETURNING id",
-            [cb, objectKey, bucket, orig, mime](const drogon::orm::Result& r) mutable {
-                long long fileId = r[0]["id"].as<long long>();
-                Json::Value resp;
-                resp["id"]         = Json::Int64(fileId);
-                resp["filename"]   = orig;
-                resp["mime_type"]  = mime;
-                resp["object_key"] = objectKey;
+            kLinkBlobSql,
+            [cbSh, mp, me, orig, mime, data, len, sha](const drogon::orm::Result& r) {
+                if (r.empty()) return storeUpload(cbSh, mp, me, orig, mime, data, len, sha);
+                MetricsService::instance().fileUpload(true);
+                Json::Value resp = fileJson(r[0]);
+                resp["deduplicated"] = true;
                 auto httpResp = drogon::HttpResponse::newHttpJsonResponse(resp);
                 httpResp->setStatusCode(drogon::k201Created);
-                cb(httpResp);
+                (*cbSh)(httpResp);
             },
-            [cb](const drogon::orm::DrogonDbException& e) mutable {
-                LOG_ERROR << "file metadata insert: " << e.base().what();
-                cb(jsonErr("Internal error", drogon::k500InternalServerError));
+            [cbSh](const drogon::orm::DrogonDbException& e) {
+                LOG_ERROR << "file dedup lookup: " << e.base().what();
+                (*cbSh)(jsonErr("Internal error", drogon::k500InternalServerError));
             },
-            me, bucket, objectKey, orig, mime, static_cast<long long>(0));
+            sha, static_cast<long long>(len), me, orig, mime);
     });
+    if (!queued) (*cbSh)(busy());
+}
+
+// ── Direct-to-storage uploads ──────────────────────────────────────────────
+// POST /files/upload-url issues presigned PUT URLs and records the file as
+// pending; the client uploads straight to MinIO and then calls
+// POST /files/{id}/complete, which checks the object with a HEAD, records its
+// real size and marks the file ready (queueing image variants). Only ready
+// files can be downloaded.
+
+// Insert the pending row and answer with the URL(s) to upload to. `uploadId`
+// is empty for a single PUT.
+static void issueUploadUrls(std::function<void(const drogon::HttpResponsePtr&)> cb,
+                            long long me, const std::string& bucket, const std::string& objectKey,
+                            const std::string& filename, const std::string& mime,
+                            long long size, const std::string& uploadId) {
+    auto db = drogon::app().getDbClient();
+    db->execSqlAsync(
+        "INSERT INTO files (uploader_id, bucket, object_key, filename, mime_type, status, upload_id) "
+        "VALUES ($1, $2, $3, $4, $5, 'pending', NULLIF($6, '')) RETURNING id",
+        [cb, bucket, objectKey, size, uploadId](const drogon::orm::Result& r) mutable {
+            const auto& cfg = Config::get();
+            Json::Value resp;
+            resp["id"]         = Json::Int64(r[0]["id"].as<long long>());
+            resp["object_key"] = objectKey;
+            resp["expires_in"] = cfg.uploadUrlTtl;
+            if (uploadId.empty()) {
+                resp["upload_url"] = generatePresignedPutUrl(
+                    cfg.minioEndpoint, cfg.minioPublicUrl, bucket, objectKey,
+                    cfg.minioAccessKey, cfg.minioSecretKey, cfg.uploadUrlTtl);
+            } else {
+                long long partSize = static_cast<long long>(
+                    ObjectStore::instance().partSizeFor(static_cast<size_t>(size)));
+                resp["part_size"] = Json::Int64(partSize);
+                resp["part_urls"] = Json::arrayValue;
+                for (int n = 1; static_cast<long long>(n - 1) * partSize < size; ++n) {
+                    resp["part_urls"].append(generatePresignedPutUrl(
+                        cfg.minioEndpoint, cfg.minioPublicUrl, bucket, objectKey,
+                        cfg.minioAccessKey, cfg.minioSecretKey, cfg.uploadUrlTtl,
+                        n, uploadId));
+                }
+            }
+            auto httpResp = drogon::HttpResponse::newHttpJsonResponse(resp);
+            httpResp->setStatusCode(drogon::k201Created);
+            cb(httpResp);
+        },
+        [cb](const drogon::orm::DrogonDbException& e) mutable {
+            LOG_ERROR << "upload-url insert: " << e.base().what();
+            cb(jsonErr("Internal error", drogon::k500InternalServerError));
+        },
+        me, bucket, objectKey, filename, mime, uploadId, ttl);
+}
+
+static void startDirectUpload(std::function<void(const drogon::HttpResponsePtr&)> cb,
+                              long long me, const std::string& filename,
+                              const std::string& mime, long long size) {
+    std::string objectKey = "uploads/" + newUuid() + "_" + filename;
+    std::string bucket    = Config::get().minioUploadsBucket;
+
+    auto& store = ObjectStore::instance();
+    if (static_cast<size_t>(size) <= store.partSizeFor(static_cast<size_t>(size)))
+        return issueUploadUrls(std::move(cb), me, bucket, objectKey, filename, mime, size, "");
+
+    store.createMultipartUpload(bucket, objectKey, mime,
+        [cb = std::move(cb), me, bucket, objectKey, filename, mime, size](std::string uploadId) mutable {
+            if (uploadId.empty())
+                return cb(jsonErr("Object storage unavailable", drogon::k502BadGateway));
+            issueUploadUrls(std::move(cb), me, bucket, objectKey, filename, mime, size, uploadId);
+        });
+}
+
+// POST /files/upload-url  { filename, mime_type?, size, sha256? }
+// → 200 { id, filename, mime_type, object_key, size_bytes, deduplicated: true }
+//   when sha256 (hex) matches content the caller already uploaded: nothing to upload
+// → 201 { id, object_key, expires_in, upload_url }             PUT the whole file
+// → 201 { id, object_key, expires_in, part_size, part_urls }   larger files: PUT
+//   part n (part_size bytes, the last one shorter) to part_urls[n-1] and keep
+//   each response's ETag header for /complete
+void FilesController::createUploadUrl(const drogon::HttpRequestPtr& req,
+                                      std::function<void(const drogon::HttpResponsePtr&)>&& cb) {
+    long long me = req->getAttributes()->get<long long>("user_id");
+    const auto& cfg = Config::get();
+
+    auto body = req->getJsonObject();
+    if (!body) return cb(jsonErr("Invalid JSON", drogon::k400BadRequest));
+    std::string filename = (*body).get("filename", "").asString();
+    std::string mime     = (*body).get("mime_type", "application/octet-stream").asString();
+    if (filename.empty())
+        return cb(jsonErr("filename is required", drogon::k400BadRequest));
+    if (!(*body)["size"].isIntegral() || (*body)["size"].asInt64() <= 0)
+        return cb(jsonErr("size is required", drogon::k400BadRequest));
+    long long size = (*body)["size"].asInt64();
+    if (size > cfg.maxFileSizeMb * 1024 * 1024)
+        return cb(jsonErr(tooLargeMessage(), drogon::k413RequestEntityTooLarge));
+
+    std::string sha = (*body).get("sha256", "").asString();
+    std::transform(sha.begin(), sha.end(), sha.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (sha.empty())
+        return startDirectUpload(std::move(cb), me, filename, mime, size);
+    if (sha.size() != 64 || sha.find_first_not_of("0123456789abcdef") != std::string::npos)
+        return cb(jsonErr("Invalid sha256", drogon::k400BadRequest));
+
+    // Content the caller has already stored needs no upload at all. Anything
+    // else is uploaded directly and not deduplicated.
+    auto db = drogon::app().getDbClient();
+    db->execSqlAsync(
+        kLinkOwnBlobSql,
+        [cb, me, filename, mime, size](const drogon::orm::Result& r) mutable {
+            if (r.empty()) return startDirectUpload(std::move(cb), me, filename, mime, size);
+            MetricsService::instance().fileUpload(true);
+            Json::Value resp = fileJson(r[0]);
+            resp["deduplicated"] = true;
+            cb(drogon::HttpResponse::newHttpJsonResponse(resp));
+        },
+        [cb](const drogon::orm::DrogonDbException& e) mutable {
+            LOG_ERROR << "upload-url dedup lookup: " << e.base().what();
+            cb(jsonErr("Internal error", drogon::k500InternalServerError));
+        },
+        sha, size, me, filename, mime);
+}
+
+// HEAD the uploaded object and mark the file ready with its real size.
+static void finishUpload(std::function<void(const drogon::HttpResponsePtr&)> cb,
+                         long long fileId, const std::string& bucket, const std::string& objectKey,
+                         const std::string& filename, const std::string& mime) {
+    ObjectStore::instance().head(bucket, objectKey,
+        [cb, fileId, bucket, objectKey, filename, mime](bool ok, const ObjectStore::ObjectInfo& info) mutable {
+            if (!ok) return cb(jsonErr("Object storage unavailable", drogon::k502BadGateway));
+            if (!info.found)
+                return cb(jsonErr("Upload not found in storage", drogon::k409Conflict));
+
+            auto db = drogon::app().getDbClient();
+            if (info.size > Config::get().maxFileSizeMb * 1024 * 1024) {
+                // A presigned PUT cannot cap the size; drop what went over
+                ObjectStore::instance().remove(bucket, objectKey, [](bool) {});
+                db->execSqlAsync("DELETE FROM files WHERE id = $1 AND status = 'pending'",
+                                 [](const drogon::orm::Result&) {},
+                                 [](const drogon::orm::DrogonDbException& e) {
+                                     LOG_ERROR << "oversized upload delete: " << e.base().what();
+                                 },
+                                 fileId);
+                return cb(jsonErr(tooLargeMessage(), drogon::k413RequestEntityTooLarge));
+            }
+
+            long long size = info.size;
+            db->execSqlAsync(
+                "UPDATE files SET status = 'ready', size_bytes = $2, upload_id = NULL "
+                "WHERE id = $1 AND status = 'pending'",
+                [cb, fileId, bucket, filename, mime, objectKey, size](const drogon::orm::Result& r) mutable {
+                    // Gone: the sweep reaped it as expired (see UploadSweeper)
+                    if (r.affectedRows() == 0)
+                        return cb(jsonErr("Upload expired", drogon::k409Conflict));
+                    ImagePipeline::instance().enqueue(fileId, bucket, objectKey, mime, size);
+                    cb(drogon::HttpResponse::newHttpJsonResponse(
+                        fileJson(fileId, filename, mime, objectKey, size)));
+                },
+                [cb](const drogon::orm::DrogonDbException& e) mutable {
+                    LOG_ERROR << "upload complete update: " << e.base().what();
+                    cb(jsonErr("Internal error", drogon::k500InternalServerError));
+                },
+                fileId, size);
+        });
+}
+
+// POST /files/{id}/complete  { parts?: [{ part_number, etag }] }  (parts for multipart only)
+// → 200 { id, filename, mime_type, object_key, size_bytes }
+void FilesController::completeUpload(const drogon::HttpRequestPtr& req,
+                                     std::function<void(const drogon::HttpResponsePtr&)>&& cb,
+                                     long long fileId) {
+    long long me = req->getAttributes()->get<long long>("user_id");
+
+    std::vector<std::string> etags;
+    auto body = req->getJsonObject();
+    if (body && (*body)["parts"].isArray()) {
+        const auto& parts = (*body)["parts"];
+        etags.resize(parts.size());
+        for (const auto& part : parts) {
+            long long n      = part.get("part_number", 0).asInt64();
+            std::string etag = part.get("etag", "").asString();
+            if (n < 1 || n > static_cast<long long>(parts.size()) || etag.empty() ||
+                !etags[n - 1].empty())
+                return cb(jsonErr("Invalid parts", drogon::k400BadRequest));
+            etags[n - 1] = etag;
+        }
+    }
+
+    auto db = drogon::app().getDbClient();
+    db->execSqlAsync(
+        "SELECT bucket, object_key, filename, COALESCE(mime_type, '') AS mime_type, status, "
+        "COALESCE(size_bytes, 0) AS size_bytes, COALESCE(upload_id, '') AS upload_id "
+        "FROM files WHERE id = $1 AND uploader_id = $2",
+        [cb, fileId, etags](const drogon::orm::Result& r) mutable {
+            if (r.empty()) return cb(jsonErr("File not found", drogon::k404NotFound));
+
+            std::string bucket    = r[0]["bucket"].as<std::string>();
+            std::string objectKey = r[0]["object_key"].as<std::string>();
+            std::string filename  = r[0]["filename"].as<std::string>();
+            std::string mime      = r[0]["mime_type"].as<std::string>();
+            std::string uploadId  = r[0]["upload_id"].as<std::string>();
+
+            // Completing twice is harmless
+            if (r[0]["status"].as<std::string>() == "ready") {
+                return cb(drogon::HttpResponse::newHttpJsonResponse(
+                    fileJson(fileId, filename, mime, objectKey, r[0]["size_bytes"].as<long long>())));
+            }
+
+            if (uploadId.empty())
+                return finishUpload(std::move(cb), fileId, bucket, objectKey, filename, mime);
+
+            if (etags.empty()) return cb(jsonErr("parts are required", drogon::k400BadRequest));
+            ObjectStore::instance().completeMultipartUpload(bucket, objectKey, uploadId, etags,
+                [cb, fileId, bucket, objectKey, filename, mime](bool ok) mutable {
+                    if (!ok)
+                        return cb(jsonErr("Upload could not be completed", drogon::k409Conflict));
+                    finishUpload(std::move(cb), fileId, bucket, objectKey, filename, mime);
+                });
+        },
+        [cb](const drogon::orm::DrogonDbException& e) mutable {
+            LOG_ERROR << "completeUpload: " << e.base().what();
+            cb(jsonErr("Internal error", drogon::k500InternalServerError));
+        },
+        fileId, me);
 }
 
 // ── GET /files/{id}/download ───────────────────────────────────────────────
@@ -233,7 +428,8 @@ void FilesController::downloadFile(const drogon::HttpRequestPtr& req,
     const auto& cfg = Config::get();
     auto db = drogon::app().getDbClient();
     db->execSqlAsync(
-        "SELECT bucket, object_key, filename, mime_type FROM files WHERE id = $1",
+        "SELECT bucket, object_key, filename, mime_type FROM files "
+        "WHERE id = $1 AND status = 'ready'",
         [cb, &cfg](const drogon::orm::Result& r) mutable {
             if (r.empty()) return cb(jsonErr("File not found", drogon::k404NotFound));
 
@@ -5,12 +5,21 @@ class FilesController : public drogon::HttpController<FilesController> {
 public:
     METHOD_LIST_BEGIN
     ADD_METHOD_TO(FilesController::uploadFile,   "/files",            drogon::Post, "AuthFilter");
+    ADD_METHOD_TO(FilesController::createUploadUrl, "/files/upload-url", drogon::Post, "AuthFilter");
+    ADD_METHOD_TO(FilesController::completeUpload, "/files/{1}/complete", drogon::Post, "AuthFilter");
     ADD_METHOD_TO(FilesController::downloadFile, "/files/{1}/download", drogon::Get, "AuthFilter");
     METHOD_LIST_END
 
     void uploadFile(const drogon::HttpRequestPtr& req,
                     std::function<void(const drogon::HttpResponsePtr&)>&& cb);
 
+    void createUploadUrl(const drogon::HttpRequestPtr& req,
+                         std::function<void(const drogon::HttpResponsePtr&)>&& cb);
+
+    void completeUpload(const drogon::HttpRequestPtr& req,
+                        std::function<void(const drogon::HttpResponsePtr&)>&& cb,
+                        long long fileId);
+
     void downloadFile(const drogon::HttpRequestPtr& req,
                       std::function<void(const drogon::HttpResponsePtr&)>&& cb,
                       long long fileId);
@@ -1,5 +1,6 @@
 #include "InvitesController.h"
 #include "../ws/WsHandler.h"
+#include "../services/MembershipCache.h"
 #include <drogon/orm/DbClient.h>
 #include <trantor/utils/Logger.h>
 
@@ -304,6 +305,7 @@ void InvitesController::joinInvite(const drogon::HttpRequestPtr& req,
                         "INSERT INTO chat_members (chat_id, user_id, role) VALUES ($1, $2, 'member') "
                         "ON CONFLICT DO NOTHING",
                         [cb, chatId, me](const drogon::orm::Result&) mutable {
+                            MembershipCache::instance().invalidateMember(chatId, me);
                             // Look up joining user's info and notify chat
                             auto db4 = drogon::app().getDbClient();
                             db4->execSqlAsync(
@@ -1,10 +1,13 @@
 #include "MessagesController.h"
 #include "../config/Config.h"
+#include "../utils/MessageCursor.h"
 #include "../utils/MinioPresign.h"
 #include "../ws/WsHandler.h"
+#include "../services/MembershipCache.h"
 #include <drogon/orm/DbClient.h>
 #include <trantor/utils/Logger.h>
 #include <json/json.h>
+#include <optional>
 
 static drogon::HttpResponsePtr jsonErr(const std::string& msg, drogon::HttpStatusCode code) {
     Json::Value b; b["error"] = msg;
@@ -23,14 +26,11 @@ static std::string presign(const std::string& bucket, const std::string& key) {
         cfg.minioAccessKey, cfg.minioSecretKey, cfg.presignTtl);
 }
 
+// Membership check served from MembershipCache (no query on a warm cache)
 static void requireMember(long long chatId, long long userId,
                            std::function<void(bool)> cb) {
-    auto db = drogon::app().getDbClient();
-    db->execSqlAsync(
-        "SELECT 1 FROM chat_members WHERE chat_id = $1 AND user_id = $2",
-        [cb](const drogon::orm::Result& r) { cb(!r.empty()); },
-        [cb](const drogon::orm::DrogonDbException&) { cb(false); },
-        chatId, userId);
+    MembershipCache::instance().lookup(chatId, userId,
+        [cb = std::move(cb)](const MembershipCache::Membership& m) { cb(m.isMember); });
 }
 
 // Build a JSON message object from an enriched query row
@@ -42,6 +42,7 @@ static Json::Value buildMsgJson(const drogon::orm::Row& row) {
     msg["content"]      = row["content"].isNull() ? Json::Value() : Json::Value(row["content"].as<std::string>());
     msg["message_type"] = row["message_type"].as<std::string>();
     msg["created_at"]   = row["created_at"].as<std::string>();
+    msg["cursor"]       = msg_cursor::encode(row["created_us"].as<long long>(), row["id"].as<long long>());
     msg["is_edited"]    = row["is_edited"].as<bool>();
     if (!row["updated_at"].isNull())
         msg["updated_at"] = row["updated_at"].as<std::string>();
@@ -55,6 +56,9 @@ static Json::Value buildMsgJson(const drogon::orm::Row& row) {
     std::string avKey    = row["sender_avatar_key"].isNull()    ? "" : row["sender_avatar_key"].as<std::string>();
     std::string avUrl    = presign(avBucket, avKey);
     msg["sender_avatar_url"] = avUrl.empty() ? Json::Value() : Json::Value(avUrl);
+    std::string avThumbKey = row["sender_avatar_thumb_key"].isNull() ? "" : row["sender_avatar_thumb_key"].as<std::string>();
+    std::string avThumbUrl = presign(avBucket, avThumbKey);
+    msg["sender_avatar_thumb_url"] = avThumbUrl.empty() ? Json::Value() : Json::Value(avThumbUrl);
 
     // Sticker fields
     std::string stickerBucket = row["sticker_bucket"].isNull() ? "" : row["sticker_bucket"].as<std::string>();
@@ -73,6 +77,13 @@ static Json::Value buildMsgJson(const drogon::orm::Row& row) {
     std::string attKey    = row["att_key"].isNull()    ? "" : row["att_key"].as<std::string>();
     std::string attUrl    = presign(attBucket, attKey);
     msg["attachment_url"] = attUrl.empty() ? Json::Value() : Json::Value(attUrl);
+    // WebP variants of image attachments (ImagePipeline); null until rendered
+    std::string attThumbKey   = row["att_thumb_key"].isNull()   ? "" : row["att_thumb_key"].as<std::string>();
+    std::string attPreviewKey = row["att_preview_key"].isNull() ? "" : row["att_preview_key"].as<std::string>();
+    std::string attThumbUrl   = presign(attBucket, attThumbKey);
+    std::string attPreviewUrl = presign(attBucket, attPreviewKey);
+    msg["attachment_thumb_url"]   = attThumbUrl.empty()   ? Json::Value() : Json::Value(attThumbUrl);
+    msg["attachment_preview_url"] = attPreviewUrl.empty() ? Json::Value() : Json::Value(attPreviewUrl);
     msg["attachment_filename"]  = row["attachment_filename"].isNull() ? Json::Value() : Json::Value(row["attachment_filename"].as<std::string>());
     msg["attachment_mime_type"] = row["attachment_mime_type"].isNull() ? Json::Value() : Json::Value(row["attachment_mime_type"].as<std::string>());
 
@@ -119,9 +130,11 @@ static Json::Value buildMsgJson(const drogon::orm::Row& row) {
     return msg;
 }
 
-// The enriched SELECT used by both list and single-message fetch
+// The enriched SELECT used by both list and single-message fetch. The reply
+// join matches on the parent's created_at too so it prunes to one partition.
 static const char* kEnrichedMsgSelect =
     "SELECT m.id, m.chat_id, m.sender_id, m.content, m.message_type, m.created_at, "
+    "       (EXTRACT(EPOCH FROM m.created_at) * 1000000)::BIGINT AS created_us, "
     "       m.is_edited, m.updated_at, "
     "       m.duration_seconds, "
     "       m.forwarded_from_chat_id, m.forwarded_from_message_id, "
@@ -131,9 +144,11 @@ static const char* kEnrichedMsgSelect =
     "       COALESCE(u.display_name, u.username) AS sender_display_name, "
     "       u.is_admin AS sender_is_admin, "
     "       av.bucket AS sender_avatar_bucket, av.object_key AS sender_avatar_key, "
+    "       av.thumb_key AS sender_avatar_thumb_key, "
     "       s.label  AS sticker_label, "
     "       sf.bucket AS sticker_bucket, sf.object_key AS sticker_key, "
     "       af.bucket AS att_bucket,    af.object_key  AS att_key, "
+    "       af.thumb_key AS att_thumb_key, af.preview_key AS att_preview_key, "
     "       af.filename AS attachment_filename, af.mime_type AS attachment_mime_type, "
     "       rm.content AS reply_to_content, "
     "       rm.message_type AS reply_to_type, "
@@ -145,9 +160,71 @@ static const char* kEnrichedMsgSelect =
     "LEFT JOIN stickers s  ON s.id = m.sticker_id "
     "LEFT JOIN files sf ON sf.id = s.file_id "
     "LEFT JOIN files af ON af.id = m.file_id "
-    "LEFT JOIN messages rm ON rm.id = m.reply_to_message_id "
+    "LEFT JOIN messages rm ON rm.id = m.reply_to_message_id AND rm.created_at = m.reply_to_created_at "
     "LEFT JOIN users ru ON ru.id = rm.sender_id ";
 
+// The whole send in one round trip: permission check (membership, and
+// owner/admin for channels), sticker validation, the insert and the chat
+// touch. A reply records its parent's created_at (V23) so later joins to
+// the parent prune. The messages insert trigger (V22) updates chat_summary
+// and the sender's read position in the same statement. Always returns one row;
+// a NULL id means a check failed and role/can_post/sticker_ok say which.
+// $1 chat, $2 sender, $3 content, $4 type, $5 sticker, $6 file,
+// $7 duration, $8 reply_to — zero meaning "none" for the last four.
+static const char* kSendMessageSql =
+    "WITH perm AS ("
+    "  SELECT cm.role, (c.type <> 'channel' OR cm.role IN ('owner', 'admin')) AS can_post "
+    "  FROM chat_members cm JOIN chats c ON c.id = cm.chat_id "
+    "  WHERE cm.chat_id = $1 AND cm.user_id = $2"
+    "), chk AS ("
+    "  SELECT p.role, p.can_post, "
+    "         ($5::BIGINT = 0 OR EXISTS (SELECT 1 FROM stickers WHERE id = $5::BIGINT)) AS sticker_ok "
+    "  FROM (SELECT 1) one LEFT JOIN perm p ON TRUE"
+    "), reply AS ("
+    "  SELECT created_at FROM messages "
+    "  WHERE $8::BIGINT > 0 AND chat_id = $1 AND id = $8::BIGINT LIMIT 1"
+    "), ins AS ("
+    "  INSERT INTO messages (chat_id, sender_id, content, message_type, sticker_id, "
+    "                        file_id, duration_seconds, reply_to_message_id, reply_to_created_at) "
+    "  SELECT $1, $2, $3::TEXT, $4::TEXT, NULLIF($5::BIGINT, 0), "
+    "         NULLIF($6::BIGINT, 0), NULLIF($7::INTEGER, 0), NULLIF($8::BIGINT, 0), "
+    "         (SELECT created_at FROM reply) "
+    "  FROM chk WHERE chk.can_post AND chk.sticker_ok "
+    "  RETURNING id, created_at, (EXTRACT(EPOCH FROM created_at) * 1000000)::BIGINT AS created_us"
+    "), touch AS ("
+    "  UPDATE chats SET updated_at = NOW() "
+    "  WHERE id = $1 AND EXISTS (SELECT 1 FROM ins)"
+    ") "
+    "SELECT chk.role, COALESCE(chk.can_post, FALSE) AS can_post, chk.sticker_ok, "
+    "       ins.id, ins.created_at, ins.created_us "
+    "FROM chk LEFT JOIN ins ON TRUE";
+
+// Soft-delete and per-user "delete for me" filter ($1 = viewer, $2 = chat).
+// The viewer's hidden ids for the chat are one int8multirange (V26), read
+// once per query as an InitPlan; each row is then a binary search in memory
+// instead of an index probe into deleted_messages.
+static const char* kVisibleFilter =
+    "AND m.is_deleted = FALSE "
+    "AND NOT COALESCE(m.id <@ (SELECT hr.ranges FROM hidden_message_ranges hr "
+    "                          WHERE hr.user_id = $1 AND hr.chat_id = $2), FALSE) ";
+
+// Keyset page bounds on (created_at, id) for a msg_cursor. The created_at
+// bound is what lets the planner prune partitions and range-scan
+// idx_messages_chat_created; id only breaks ties within one timestamp.
+static std::string cursorTs(int usParam) {
+    return "(TIMESTAMPTZ 'epoch' + $" + std::to_string(usParam) + "::BIGINT * INTERVAL '1 microsecond')";
+}
+static std::string keysetBefore(int usParam, int idParam) {
+    std::string ts = cursorTs(usParam);
+    return "AND m.created_at <= " + ts + " AND (m.created_at < " + ts +
+           " OR m.id < $" + std::to_string(idParam) + ") ";
+}
+static std::string keysetAfter(int usParam, int idParam) {
+    std::string ts = cursorTs(usParam);
+    return "AND m.created_at >= " + ts + " AND (m.created_at > " + ts +
+           " OR m.id > $" + std::to_string(idParam) + ") ";
+}
+
 // POST /chats/{id}/messages
 void MessagesController::sendMessage(const drogon::HttpRequestPtr& req,
                                       std::function<void(const drogon::HttpResponsePtr&)>&& cb,
@@ -166,150 +243,89 @@ void MessagesController::sendMessage(const drogon::HttpRequestPtr& req,
     if (content.empty() && fileId == 0 && stickerId == 0)
         return cb(jsonErr("content, file_id or sticker_id required", drogon::k400BadRequest));
 
-    // Use shared_ptr so cb can be safely shared across all async callbacks
-    // without triggering bad_function_call from double-move.
+    // A sticker message carries no file; a duration only makes sense with one
+    if (stickerId > 0) fileId = 0;
+    if (fileId <= 0) durationSecs = 0;
+
+    // Both callbacks need cb; share it rather than move it into one of them
     using CbT = std::function<void(const drogon::HttpResponsePtr&)>;
     auto cbPtr = std::make_shared<CbT>(std::move(cb));
 
-    requireMember(chatId, me, [=, cbPtr](bool isMember) mutable {
-        if (!isMember) return (*cbPtr)(jsonErr("Not a member of this chat", drogon::k403Forbidden));
-
-        auto db0 = drogon::app().getDbClient();
-        db0->execSqlAsync(
-            "SELECT c.type, cm.role FROM chats c "
-            "JOIN chat_members cm ON cm.chat_id = c.id AND cm.user_id = $2 "
-            "WHERE c.id = $1",
-            [=, cbPtr](const drogon::orm::Result& pr) mutable {
-                if (!pr.empty()) {
-                    std::string chatType = pr[0]["type"].as<std::string>();
-                    std::string role     = pr[0]["role"].as<std::string>();
-                    if (chatType == "channel" && role != "owner" && role != "admin")
-                        return (*cbPtr)(jsonErr("Only admins can post in channels", drogon::k403Forbidden));
-                }
-
-                auto doInsert = [=, cbPtr](long long resolvedStickerId,
-                                           long long resolvedFileId) mutable {
-                    auto db = drogon::app().getDbClient();
-                    std::string sql;
-                    if (resolvedStickerId > 0) {
-                        sql = "INSERT INTO messages (chat_id, sender_id, content, message_type, sticker_id, reply_to_message_id) "
-                              "VALUES ($1, $2, $3, $4, $5, NULLIF($6::BIGINT, 0)) RETURNING id, created_at";
-                    } else if (resolvedFileId > 0 && durationSecs > 0) {
-                        sql = "INSERT INTO messages (chat_id, sender_id, content, message_type, file_id, duration_seconds, reply_to_message_id) "
-                              "VALUES ($1, $2, $3, $4, $5, $6, NULLIF($7::BIGINT, 0)) RETURNING id, created_at";
-                    } else if (resolvedFileId > 0) {
-                        sql = "INSERT INTO messages (chat_id, sender_id, content, message_type, file_id, reply_to_message_id) "
-                              "VALUES ($1, $2, $3, $4, $5, NULLIF($6::BIGINT, 0)) RETURNING id, created_at";
-                    } else {
-                        sql = "INSERT INTO messages (chat_id, sender_id, content, message_type, reply_to_message_id) "
-                              "VALUES ($1, $2, $3, $4, NULLIF($5::BIGINT, 0)) RETURNING id, created_at";
-                    }
-
-                    auto onInserted = [=, cbPtr](const drogon::orm::Result& r) mutable {
-                        long long msgId       = r[0]["id"].as<long long>();
-                        std::string createdAt = r[0]["created_at"].as<std::string>();
-
-                        auto db2 = drogon::app().getDbClient();
-                        db2->execSqlAsync(
-                            "UPDATE chats SET updated_at = NOW() WHERE id = $1",
-                            [](const drogon::orm::Result&) {},
-                            [](const drogon::orm::DrogonDbException& e) {
-                                LOG_WARN << "chat updated_at: " << e.base().what();
-                            }, chatId);
-
-                        // Auto-mark sender's own message as read
-                        auto db3 = drogon::app().getDbClient();
-                        db3->execSqlAsync(
-                            "INSERT INTO chat_last_read (user_id, chat_id, last_read_msg_id, read_at) "
-                            "VALUES ($1, $2, $3, NOW()) "
-                            "ON CONFLICT (user_id, chat_id) DO UPDATE SET "
-                            "  last_read_msg_id = GREATEST(chat_last_read.last_read_msg_id, EXCLUDED.last_read_msg_id), "
-                            "  read_at = NOW()",
-                            [](const drogon::orm::Result&) {},
-                            [](const drogon::orm::DrogonDbException& e) {
-                                LOG_WARN << "auto-mark-read on send: " << e.base().what();
-                            }, me, chatId, msgId);
-
-                        Json::Value wsMsg;
-                        wsMsg["type"]         = "message";
-                        wsMsg["id"]           = Json::Int64(msgId);
-                        wsMsg["chat_id"]      = Json::Int64(chatId);
-                        wsMsg["sender_id"]    = Json::Int64(me);
-                        wsMsg["content"]      = content;
-                        wsMsg["message_type"] = msgType;
-                        wsMsg["created_at"]   = createdAt;
-                        if (replyToMsgId > 0)
-                            wsMsg["reply_to_message_id"] = Json::Int64(replyToMsgId);
-                        WsDispatch::publishMessage(chatId, wsMsg);
+    auto db = drogon::app().getDbClient();
+    db->execSqlAsync(
+        kSendMessageSql,
+        [=](const drogon::orm::Result& r) {
+            const auto& row = r[0];
+            if (row["id"].isNull()) {
+                // Nothing inserted: report which check failed
+                if (row["role"].isNull())
+                    return (*cbPtr)(jsonErr("Not a member of this chat", drogon::k403Forbidden));
+                if (!row["can_post"].as<bool>())
+                    return (*cbPtr)(jsonErr("Only admins can post in channels", drogon::k403Forbidden));
+                return (*cbPtr)(jsonErr("Sticker not found", drogon::k404NotFound));
+            }
 
-                        Json::Value resp;
-                        resp["id"]           = Json::Int64(msgId);
-                        resp["chat_id"]      = Json::Int64(chatId);
-                        resp["sender_id"]    = Json::Int64(me);
-                        resp["content"]      = content;
-                        resp["message_type"] = msgType;
-                        resp["type"]         = msgType;
-                        resp["created_at"]   = createdAt;
-                        if (resolvedStickerId > 0)
-                            resp["sticker_id"] = Json::Int64(resolvedStickerId);
-                        if (durationSecs > 0)
-                            resp["duration_seconds"] = durationSecs;
-                        if (replyToMsgId > 0)
-                            resp["reply_to_message_id"] = Json::Int64(replyToMsgId);
-                        auto httpResp = drogon::HttpResponse::newHttpJsonResponse(resp);
-                        httpResp->setStatusCode(drogon::k201Created);
-                        (*cbPtr)(httpResp);
-                    };
-
-                    auto onErr = [cbPtr](const drogon::orm::DrogonDbException& e) mutable {
-                        LOG_ERROR << "sendMessage insert: " << e.base().what();
-                        (*cbPtr)(jsonErr("Internal error", drogon::k500InternalServerError));
-                    };
-
-                    if (resolvedStickerId > 0)
-                        db->execSqlAsync(sql, std::move(onInserted), std::move(onErr),
-                                         chatId, me, content, msgType, resolvedStickerId, replyToMsgId);
-                    else if (resolvedFileId > 0 && durationSecs > 0)
-                        db->execSqlAsync(sql, std::move(onInserted), std::move(onErr),
-                                         chatId, me, content, msgType, resolvedFileId, durationSecs, replyToMsgId);
-                    else if (resolvedFileId > 0)
-                        db->execSqlAsync(sql, std::move(onInserted), std::move(onErr),
-                                         chatId, me, content, msgType, resolvedFileId, replyToMsgId);
-                    else
-                        db->execSqlAsync(sql, std::move(onInserted), std::move(onErr),
-                                         chatId, me, content, msgType, replyToMsgId);
-                };
-
-                if (stickerId > 0) {
-                    auto dbS = drogon::app().getDbClient();
-                    dbS->execSqlAsync(
-                        "SELECT id FROM stickers WHERE id = $1",
-                        [=, cbPtr, doInsert = std::move(doInsert)](const drogon::orm::Result& sr) mutable {
-                            if (sr.empty()) return (*cbPtr)(jsonErr("Sticker not found", drogon::k404NotFound));
-                            doInsert(stickerId, 0);
-                        },
-                        [cbPtr](const drogon::orm::DrogonDbException& e) mutable {
-                            LOG_ERROR << "sticker lookup: " << e.base().what();
-                            (*cbPtr)(jsonErr("Internal error", drogon::k500InternalServerError));
-                        }, stickerId);
-                } else {
-                    doInsert(0, fileId);
-                }
-            },
-            [cbPtr](const drogon::orm::DrogonDbException& e) mutable {
-                LOG_ERROR << "channel permission check: " << e.base().what();
-                (*cbPtr)(jsonErr("Internal error", drogon::k500InternalServerError));
-            },
-            chatId, me);
-    });
+            long long msgId       = row["id"].as<long long>();
+            std::string createdAt = row["created_at"].as<std::string>();
+            std::string cursor    = msg_cursor::encode(row["created_us"].as<long long>(), msgId);
+
+            Json::Value wsMsg;
+            wsMsg["type"]         = "message";
+            wsMsg["id"]           = Json::Int64(msgId);
+            wsMsg["chat_id"]      = Json::Int64(chatId);
+            wsMsg["sender_id"]    = Json::Int64(me);
+            wsMsg["content"]      = content;
+            wsMsg["message_type"] = msgType;
+            wsMsg["created_at"]   = createdAt;
+            wsMsg["cursor"]       = cursor;
+            if (replyToMsgId > 0)
+                wsMsg["reply_to_message_id"] = Json::Int64(replyToMsgId);
+            WsDispatch::publishMessage(chatId, wsMsg);
+
+            Json::Value resp;
+            resp["id"]           = Json::Int64(msgId);
+            resp["chat_id"]      = Json::Int64(chatId);
+            resp["sender_id"]    = Json::Int64(me);
+            resp["content"]      = content;
+            resp["message_type"] = msgType;
+            resp["type"]         = msgType;
+            resp["created_at"]   = createdAt;
+            resp["cursor"]       = cursor;
+            if (stickerId > 0)
+                resp["sticker_id"] = Json::Int64(stickerId);
+            if (durationSecs > 0)
+                resp["duration_seconds"] = durationSecs;
+            if (replyToMsgId > 0)
+                resp["reply_to_message_id"] = Json::Int64(replyToMsgId);
+            auto httpResp = drogon::HttpResponse::newHttpJsonResponse(resp);
+            httpResp->setStatusCode(drogon::k201Created);
+            (*cbPtr)(httpResp);
+        },
+        [cbPtr](const drogon::orm::DrogonDbException& e) {
+            LOG_ERROR << "sendMessage: " << e.base().what();
+            (*cbPtr)(jsonErr("Internal error", drogon::k500InternalServerError));
+        },
+        chatId, me, content, msgType, stickerId, fileId, durationSecs, replyToMsgId);
 }
 
-// GET /chats/{id}/messages?limit=50&before=<id>&after_id=<id>
+// GET /chats/{id}/messages?limit=50&before_cursor=<c>&after_cursor=<c>
+// Cursors are the `cursor` field of a returned message. The id-based
+// before=<id> / after_id=<id> are still accepted but cannot prune partitions.
 void MessagesController::listMessages(const drogon::HttpRequestPtr& req,
                                        std::function<void(const drogon::HttpResponsePtr&)>&& cb,
                                        long long chatId) {
     long long me = req->getAttributes()->get<long long>("user_id");
 
+    std::optional<msg_cursor::Cursor> afterCur, beforeCur;
+    {
+        std::string ac = req->getParameter("after_cursor");
+        std::string bc = req->getParameter("before_cursor");
+        if (!ac.empty() && !(afterCur = msg_cursor::decode(ac)))
+            return cb(jsonErr("Invalid after_cursor", drogon::k400BadRequest));
+        if (!bc.empty() && !(beforeCur = msg_cursor::decode(bc)))
+            return cb(jsonErr("Invalid before_cursor", drogon::k400BadRequest));
+    }
+
     requireMember(chatId, me, [=, cb = std::move(cb)](bool isMember) mutable {
         if (!isMember) return cb(jsonErr("Not a member of this chat", drogon::k403Forbidden));
 
@@ -339,25 +355,36 @@ void MessagesController::listMessages(const drogon::HttpRequestPtr& req,
             cb(jsonErr("Internal error", drogon::k500InternalServerError));
         };
 
-        // Soft-delete and per-user delete filter fragment
-        const std::string deletedFilter =
-            "AND m.is_deleted = FALSE "
-            "AND NOT EXISTS (SELECT 1 FROM deleted_messages dm WHERE dm.message_id = m.id AND dm.user_id = $1) ";
-
-        if (!afterStr.empty()) {
-            // Polling: return messages AFTER this id, oldest-first
+        if (afterCur) {
+            // Polling: messages after the cursor, oldest-first
+            std::string sql = std::string(kEnrichedMsgSelect) +
+                "WHERE m.chat_id = $2 " + keysetAfter(3, 4) + kVisibleFilter +
+                "ORDER BY m.created_at ASC, m.id ASC LIMIT $5";
+            db->execSqlAsync(sql, std::move(handleRows), std::move(onErr),
+                             me, chatId, afterCur->createdUs, afterCur->id, limit);
+        } else if (beforeCur) {
+            // Scroll-back: N messages before the cursor, oldest-first
+            std::string sql = std::string(
+                "SELECT * FROM (") + kEnrichedMsgSelect +
+                "WHERE m.chat_id = $2 " + keysetBefore(3, 4) + kVisibleFilter +
+                "ORDER BY m.created_at DESC, m.id DESC LIMIT $5) sub "
+                "ORDER BY created_at ASC, id ASC";
+            db->execSqlAsync(sql, std::move(handleRows), std::move(onErr),
+                             me, chatId, beforeCur->createdUs, beforeCur->id, limit);
+        } else if (!afterStr.empty()) {
+            // Legacy polling by id: return messages AFTER this id, oldest-first
             long long afterId = std::stoll(afterStr);
             std::string sql = std::string(kEnrichedMsgSelect) +
-                "WHERE m.chat_id = $2 AND m.id > $3 " + deletedFilter +
+                "WHERE m.chat_id = $2 AND m.id > $3 " + kVisibleFilter +
                 "ORDER BY m.created_at ASC LIMIT $4";
             db->execSqlAsync(sql, std::move(handleRows), std::move(onErr),
                              me, chatId, afterId, limit);
         } else if (!beforeStr.empty()) {
-            // Older messages pagination: return N messages BEFORE this id, oldest-first
+            // Legacy pagination by id: return N messages BEFORE this id, oldest-first
             long long before = std::stoll(beforeStr);
             std::string sql = std::string(
                 "SELECT * FROM (") + kEnrichedMsgSelect +
-                "WHERE m.chat_id = $2 AND m.id < $3 " + deletedFilter +
+                "WHERE m.chat_id = $2 AND m.id < $3 " + kVisibleFilter +
                 "ORDER BY m.created_at DESC LIMIT $4) sub "
                 "ORDER BY created_at ASC";
             db->execSqlAsync(sql, std::move(handleRows), std::move(onErr),
@@ -366,9 +393,9 @@ void MessagesController::listMessages(const drogon::HttpRequestPtr& req,
             // Initial load: latest N messages in chronological order
             std::string sql = std::string(
                 "SELECT * FROM (") + kEnrichedMsgSelect +
-                "WHERE m.chat_id = $2 " + deletedFilter +
-                "ORDER BY m.created_at DESC LIMIT $3) sub "
-                "ORDER BY created_at ASC";
+                "WHERE m.chat_id = $2 " + kVisibleFilter +
+                "ORDER BY m.created_at DESC, m.id DESC LIMIT $3) sub "
+                "ORDER BY created_at ASC, id ASC";
             db->execSqlAsync(sql, std::move(handleRows), std::move(onErr),
                              me, chatId, limit);
         }
@@ -413,8 +440,8 @@ void MessagesController::deleteMessage(const drogon::HttpRequestPtr& req,
                     // Delete for me only: insert into deleted_messages
                     auto db2 = drogon::app().getDbClient();
                     db2->execSqlAsync(
-                        "INSERT INTO deleted_messages (user_id, message_id) "
-                        "VALUES ($1, $2) ON CONFLICT DO NOTHING",
+                        "INSERT INTO deleted_messages (user_id, chat_id, message_id) "
+                        "VALUES ($1, $2, $3) ON CONFLICT DO NOTHING",
                         [cbPtr](const drogon::orm::Result&) {
                             auto resp = drogon::HttpResponse::newHttpResponse();
                             resp->setStatusCode(drogon::k204NoContent);
@@ -424,7 +451,7 @@ void MessagesController::deleteMessage(const drogon::HttpRequestPtr& req,
                             LOG_ERROR << "deleteMessage (for me): " << e.base().what();
                             (*cbPtr)(jsonErr("Internal error", drogon::k500InternalServerError));
                         },
-                        me, messageId);
+                        me, chatId, messageId);
                     return;
                 }
 
@@ -547,98 +574,82 @@ void MessagesController::pinMessage(const drogon::HttpRequestPtr& req,
     using CbT = std::function<void(const drogon::HttpResponsePtr&)>;
     auto cbPtr = std::make_shared<CbT>(std::move(cb));
 
-    requireMember(chatId, me, [=](bool isMember) {
-        if (!isMember) return (*cbPtr)(jsonErr("Not a member of this chat", drogon::k403Forbidden));
+    MembershipCache::instance().lookup(chatId, me, [=](const MembershipCache::Membership& mem) {
+        if (!mem.isMember) return (*cbPtr)(jsonErr("Not a member of this chat", drogon::k403Forbidden));
 
         // Check channel permission: only owner/admin can pin in channels
-        auto db0 = drogon::app().getDbClient();
-        db0->execSqlAsync(
-            "SELECT c.type, cm.role FROM chats c "
-            "JOIN chat_members cm ON cm.chat_id = c.id AND cm.user_id = $2 "
-            "WHERE c.id = $1",
-            [=](const drogon::orm::Result& pr) {
-                if (!pr.empty()) {
-                    std::string chatType = pr[0]["type"].as<std::string>();
-                    std::string role     = pr[0]["role"].as<std::string>();
-                    if (chatType == "channel" && role != "owner" && role != "admin")
-                        return (*cbPtr)(jsonErr("Only admins can pin in channels", drogon::k403Forbidden));
-                }
-
-                // Verify message exists and belongs to this chat
-                auto db1 = drogon::app().getDbClient();
-                db1->execSqlAsync(
-                    "SELECT id FROM messages WHERE id = $1 AND chat_id = $2 AND is_deleted = FALSE",
-                    [=](const drogon::orm::Result& mr) {
-                        if (mr.empty())
-                            return (*cbPtr)(jsonErr("Message not found", drogon::k404NotFound));
+        if (mem.chatType == "channel" && mem.role != "owner" && mem.role != "admin")
+            return (*cbPtr)(jsonErr("Only admins can pin in channels", drogon::k403Forbidden));
+
+        // Verify message exists and belongs to this chat
+        auto db1 = drogon::app().getDbClient();
+        db1->execSqlAsync(
+            "SELECT id FROM messages WHERE id = $1 AND chat_id = $2 AND is_deleted = FALSE",
+            [=](const drogon::orm::Result& mr) {
+                if (mr.empty())
+                    return (*cbPtr)(jsonErr("Message not found", drogon::k404NotFound));
 
-                        // Unpin current pinned message (if any)
-                        auto db2 = drogon::app().getDbClient();
-                        db2->execSqlAsync(
-                            "UPDATE pinned_messages SET unpinned_at = NOW() WHERE chat_id = $1 AND unpinned_at IS NULL",
-                            [=](const drogon::orm::Result&) {
-                                // Insert new pin
-                                auto db3 = drogon::app().getDbClient();
-                                db3->execSqlAsync(
-                                    "INSERT INTO pinned_messages (chat_id, message_id, pinned_by) "
-                                    "VALUES ($1, $2, $3) RETURNING id, pinned_at",
-                                    [=](const drogon::orm::Result& ir) {
-                                        std::string pinnedAt = ir[0]["pinned_at"].as<std::string>();
-
-                                        // Fetch enriched message
-                                        auto db4 = drogon::app().getDbClient();
-                                        std::string sql = std::string(kEnrichedMsgSelect) + "WHERE m.id = $1";
-                                        db4->execSqlAsync(sql,
-                                            [=](const drogon::orm::Result& er) {
-                                                Json::Value msgJson;
-                                                if (!er.empty()) msgJson = buildMsgJson(er[0]);
-
-                                                // WS broadcast
-                                                Json::Value wsPayload;
-                                                wsPayload["type"]       = "message_pinned";
-                                                wsPayload["chat_id"]    = Json::Int64(chatId);
-                                                wsPayload["message_id"] = Json::Int64(messageId);
-                                                wsPayload["pinned_by"]  = Json::Int64(me);
-                                                wsPayload["message"]    = msgJson;
-                                                WsDispatch::publishMessage(chatId, wsPayload);
-
-                                                // HTTP response
-                                                Json::Value resp;
-                                                resp["pinned_message_id"] = Json::Int64(messageId);
-                                                resp["message"]    = msgJson;
-                                                resp["pinned_at"]  = pinnedAt;
-                                                resp["pinned_by"]  = Json::Int64(me);
-                                                (*cbPtr)(drogon::HttpResponse::newHttpJsonResponse(resp));
-                                            },
-                                            [cbPtr](const drogon::orm::DrogonDbException& e) {
-                                                LOG_ERROR << "pinMessage enriched fetch: " << e.base().what();
-                                                (*cbPtr)(jsonErr("Internal error", drogon::k500InternalServerError));
-                                            },
-                                            messageId);
+                // Unpin current pinned message (if any)
+                auto db2 = drogon::app().getDbClient();
+                db2->execSqlAsync(
+                    "UPDATE pinned_messages SET unpinned_at = NOW() WHERE chat_id = $1 AND unpinned_at IS NULL",
+                    [=](const drogon::orm::Result&) {
+                        // Insert new pin
+                        auto db3 = drogon::app().getDbClient();
+                        db3->execSqlAsync(
+                            "INSERT INTO pinned_messages (chat_id, message_id, pinned_by) "
+                            "VALUES ($1, $2, $3) RETURNING id, pinned_at",
+                            [=](const drogon::orm::Result& ir) {
+                                std::string pinnedAt = ir[0]["pinned_at"].as<std::string>();
+
+                                // Fetch enriched message
+                                auto db4 = drogon::app().getDbClient();
+                                std::string sql = std::string(kEnrichedMsgSelect) + "WHERE m.id = $1";
+                                db4->execSqlAsync(sql,
+                                    [=](const drogon::orm::Result& er) {
+                                        Json::Value msgJson;
+                                        if (!er.empty()) msgJson = buildMsgJson(er[0]);
+
+                                        // WS broadcast
+                                        Json::Value wsPayload;
+                                        wsPayload["type"]       = "message_pinned";
+                                        wsPayload["chat_id"]    = Json::Int64(chatId);
+                                        wsPayload["message_id"] = Json::Int64(messageId);
+                                        wsPayload["pinned_by"]  = Json::Int64(me);
+                                        wsPayload["message"]    = msgJson;
+                                        WsDispatch::publishMessage(chatId, wsPayload);
+
+                                        // HTTP response
+                                        Json::Value resp;
+                                        resp["pinned_message_id"] = Json::Int64(messageId);
+                                        resp["message"]    = msgJson;
+                                        resp["pinned_at"]  = pinnedAt;
+                                        resp["pinned_by"]  = Json::Int64(me);
+                                        (*cbPtr)(drogon::HttpResponse::newHttpJsonResponse(resp));
                                     },
                                     [cbPtr](const drogon::orm::DrogonDbException& e) {
-                                        LOG_ERROR << "pinMessage insert: " << e.base().what();
+                                        LOG_ERROR << "pinMessage enriched fetch: " << e.base().what();
                                         (*cbPtr)(jsonErr("Internal error", drogon::k500InternalServerError));
                                     },
-                                    chatId, messageId, me);
+                                    messageId);
                             },
                             [cbPtr](const drogon::orm::DrogonDbException& e) {
-                                LOG_ERROR << "pinMessage unpin current: " << e.base().what();
+                                LOG_ERROR << "pinMessage insert: " << e.base().what();
                                 (*cbPtr)(jsonErr("Internal error", drogon::k500InternalServerError));
                             },
-                            chatId);
+                            chatId, messageId, me);
                     },
                     [cbPtr](const drogon::orm::DrogonDbException& e) {
-                        LOG_ERROR << "pinMessage msg lookup: " << e.base().what();
+                        LOG_ERROR << "pinMessage unpin current: " << e.base().what();
                         (*cbPtr)(jsonErr("Internal error", drogon::k500InternalServerError));
                     },
-                    messageId, chatId);
+                    chatId);
             },
             [cbPtr](const drogon::orm::DrogonDbException& e) {
-                LOG_ERROR << "pinMessage permission check: " << e.base().what();
+                LOG_ERROR << "pinMessage msg lookup: " << e.base().what();
                 (*cbPtr)(jsonErr("Internal error", drogon::k500InternalServerError));
             },
-            chatId, me);
+            messageId, chatId);
     });
 }
 
@@ -651,54 +662,38 @@ void MessagesController::unpinMessage(const drogon::HttpRequestPtr& req,
     using CbT = std::function<void(const drogon::HttpResponsePtr&)>;
     auto cbPtr = std::make_shared<CbT>(std::move(cb));
 
-    requireMember(chatId, me, [=](bool isMember) {
-        if (!isMember) return (*cbPtr)(jsonErr("Not a member of this chat", drogon::k403Forbidden));
+    MembershipCache::instance().lookup(chatId, me, [=](const MembershipCache::Membership& mem) {
+        if (!mem.isMember) return (*cbPtr)(jsonErr("Not a member of this chat", drogon::k403Forbidden));
 
         // Check channel permission
-        auto db0 = drogon::app().getDbClient();
-        db0->execSqlAsync(
-            "SELECT c.type, cm.role FROM chats c "
-            "JOIN chat_members cm ON cm.chat_id = c.id AND cm.user_id = $2 "
-            "WHERE c.id = $1",
-            [=](const drogon::orm::Result& pr) {
-                if (!pr.empty()) {
-                    std::string chatType = pr[0]["type"].as<std::string>();
-                    std::string role     = pr[0]["role"].as<std::string>();
-                    if (chatType == "channel" && role != "owner" && role != "admin")
-                        return (*cbPtr)(jsonErr("Only admins can unpin in channels", drogon::k403Forbidden));
-                }
+        if (mem.chatType == "channel" && mem.role != "owner" && mem.role != "admin")
+            return (*cbPtr)(jsonErr("Only admins can unpin in channels", drogon::k403Forbidden));
+
+        auto db1 = drogon::app().getDbClient();
+        db1->execSqlAsync(
+            "UPDATE pinned_messages SET unpinned_at = NOW() "
+            "WHERE chat_id = $1 AND message_id = $2 AND unpinned_at IS NULL "
+            "RETURNING id",
+            [=](const drogon::orm::Result& r) {
+                if (r.empty())
+                    return (*cbPtr)(jsonErr("No pinned message found", drogon::k404NotFound));
 
-                auto db1 = drogon::app().getDbClient();
-                db1->execSqlAsync(
-                    "UPDATE pinned_messages SET unpinned_at = NOW() "
-                    "WHERE chat_id = $1 AND message_id = $2 AND unpinned_at IS NULL "
-                    "RETURNING id",
-                    [=](const drogon::orm::Result& r) {
-                        if (r.empty())
-                            return (*cbPtr)(jsonErr("No pinned message found", drogon::k404NotFound));
-
-                        // WS broadcast
-                        Json::Value wsPayload;
-                        wsPayload["type"]       = "message_unpinned";
-                        wsPayload["chat_id"]    = Json::Int64(chatId);
-                        wsPayload["message_id"] = Json::Int64(messageId);
-                        WsDispatch::publishMessage(chatId, wsPayload);
-
-                        auto resp = drogon::HttpResponse::newHttpResponse();
-                        resp->setStatusCode(drogon::k204NoContent);
-                        (*cbPtr)(resp);
-                    },
-                    [cbPtr](const drogon::orm::DrogonDbException& e) {
-                        LOG_ERROR << "unpinMessage: " << e.base().what();
-                        (*cbPtr)(jsonErr("Internal error", drogon::k500InternalServerError));
-                    },
-                    chatId, messageId);
+                // WS broadcast
+                Json::Value wsPayload;
+                wsPayload["type"]       = "message_unpinned";
+                wsPayload["chat_id"]    = Json::Int64(chatId);
+                wsPayload["message_id"] = Json::Int64(messageId);
+                WsDispatch::publishMessage(chatId, wsPayload);
+
+                auto resp = drogon::HttpResponse::newHttpResponse();
+                resp->setStatusCode(drogon::k204NoContent);
+                (*cbPtr)(resp);
             },
             [cbPtr](const drogon::orm::DrogonDbException& e) {
-                LOG_ERROR << "unpinMessage permission check: " << e.base().what();
+                LOG_ERROR << "unpinMessage: " << e.base().what();
                 (*cbPtr)(jsonErr("Internal error", drogon::k500InternalServerError));
             },
-            chatId, me);
+            chatId, messageId);
     });
 }
 
@@ -760,7 +755,12 @@ void MessagesController::getPinnedMessage(const drogon::HttpRequestPtr& req,
     });
 }
 
-// GET /chats/{id}/messages/search?q=text&limit=20&before_id=N
+// Word-prefix match served by idx_messages_chat_fts (V25); $3 is the raw query
+static const char* kMsgSearchMatch =
+    "AND to_tsvector('simple', COALESCE(m.content, '')) @@ messages_search_query($3) ";
+
+// GET /chats/{id}/messages/search?q=text&limit=20&before_cursor=<c>
+// (before_id=N is the legacy, non-pruning form)
 void MessagesController::searchMessages(const drogon::HttpRequestPtr& req,
                                          std::function<void(const drogon::HttpResponsePtr&)>&& cb,
                                          long long chatId) {
@@ -782,6 +782,12 @@ void MessagesController::searchMessages(const drogon::HttpRequestPtr& req,
     }
 
     std::string beforeIdStr = req->getParameter("before_id");
+    std::optional<msg_cursor::Cursor> beforeCur;
+    {
+        std::string bc = req->getParameter("before_cursor");
+        if (!bc.empty() && !(beforeCur = msg_cursor::decode(bc)))
+            return cb(jsonErr("Invalid before_cursor", drogon::k400BadRequest));
+    }
 
     using CbT = std::function<void(const drogon::HttpResponsePtr&)>;
     auto cbPtr = std::make_shared<CbT>(std::move(cb));
@@ -789,12 +795,6 @@ void MessagesController::searchMessages(const drogon::HttpRequestPtr& req,
     requireMember(chatId, me, [=](bool isMember) {
         if (!isMember) return (*cbPtr)(jsonErr("Not a member of this chat", drogon::k403Forbidden));
 
-        std::string searchPattern = "%" + q + "%";
-
-        const std::string deletedFilter =
-            "AND m.is_deleted = FALSE "
-            "AND NOT EXISTS (SELECT 1 FROM deleted_messages dm WHERE dm.message_id = m.id AND dm.user_id = $1) ";
-
         auto handleRows = [cbPtr](const drogon::orm::Result& r) {
             Json::Value arr(Json::arrayValue);
             for (auto& row : r)
@@ -809,20 +809,27 @@ void MessagesController::searchMessages(const drogon::HttpRequestPtr& req,
 
         auto db = drogon::app().getDbClient();
 
-        if (!beforeIdStr.empty()) {
+        if (beforeCur) {
+            std::string sql = std::string(kEnrichedMsgSelect) +
+                "WHERE m.chat_id = $2 AND m.message_type = 'text' " + kMsgSearchMatch +
+                keysetBefore(4, 5) + kVisibleFilter +
+                "ORDER BY m.created_at DESC, m.id DESC LIMIT $6";
+            db->execSqlAsync(sql, std::move(handleRows), std::move(onErr),
+                             me, chatId, q, beforeCur->createdUs, beforeCur->id, limit);
+        } else if (!beforeIdStr.empty()) {
             long long beforeId = std::stoll(beforeIdStr);
             std::string sql = std::string(kEnrichedMsgSelect) +
-                "WHERE m.chat_id = $2 AND m.message_type = 'text' AND m.content ILIKE $3 "
-                "AND m.id < $4 " + deletedFilter +
+                "WHERE m.chat_id = $2 AND m.message_type = 'text' " + kMsgSearchMatch +
+                "AND m.id < $4 " + kVisibleFilter +
                 "ORDER BY m.created_at DESC LIMIT $5";
             db->execSqlAsync(sql, std::move(handleRows), std::move(onErr),
-                             me, chatId, searchPattern, beforeId, limit);
+                             me, chatId, q, beforeId, limit);
         } else {
             std::string sql = std::string(kEnrichedMsgSelect) +
-                "WHERE m.chat_id = $2 AND m.message_type = 'text' AND m.content ILIKE $3 " + deletedFilter +
-                "ORDER BY m.created_at DESC LIMIT $4";
+                "WHERE m.chat_id = $2 AND m.message_type = 'text' " + kMsgSearchMatch + kVisibleFilter +
+                "ORDER BY m.created_at DESC, m.id DESC LIMIT $4";
             db->execSqlAsync(sql, std::move(handleRows), std::move(onErr),
-                             me, chatId, searchPattern, limit);
+                             me, chatId, q, limit);
         }
     });
 }
@@ -1,5 +1,6 @@
 #include "ReactionsController.h"
 #include "../ws/WsHandler.h"
+#include "../services/MembershipCache.h"
 #include <drogon/orm/DbClient.h>
 #include <trantor/utils/Logger.h>
 #include <json/json.h>
@@ -13,14 +14,11 @@ static drogon::HttpResponsePtr jsonErr(const std::string& msg, drogon::HttpStatu
     return r;
 }
 
+// Membership check served from MembershipCache (no query on a warm cache)
 static void requireMember(long long chatId, long long userId,
                            std::function<void(bool)> cb) {
-    auto db = drogon::app().getDbClient();
-    db->execSqlAsync(
-        "SELECT 1 FROM chat_members WHERE chat_id = $1 AND user_id = $2",
-        [cb](const drogon::orm::Result& r) { cb(!r.empty()); },
-        [cb](const drogon::orm::DrogonDbException&) { cb(false); },
-        chatId, userId);
+    MembershipCache::instance().lookup(chatId, userId,
+        [cb = std::move(cb)](const MembershipCache::Membership& m) { cb(m.isMember); });
 }
 
 // POST /chats/{chatId}/messages/{messageId}/reactions
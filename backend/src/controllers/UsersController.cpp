@@ -2,6 +2,7 @@
 #include "../config/Config.h"
 #include "../utils/MinioPresign.h"
 #include "../ws/WsHandler.h"
+#include "../services/PresenceService.h"
 #include <drogon/orm/DbClient.h>
 #include <trantor/utils/Logger.h>
 #include <regex>
@@ -40,8 +41,11 @@ static Json::Value buildUserJson(const drogon::orm::Row& r) {
 
     std::string avBucket = r["avatar_bucket"].isNull() ? "" : r["avatar_bucket"].as<std::string>();
     std::string avKey    = r["avatar_key"].isNull()    ? "" : r["avatar_key"].as<std::string>();
-    std::string url = avatarUrl(avBucket, avKey);
-    u["avatar_url"] = url.empty() ? Json::Value() : Json::Value(url);
+    std::string avThumbKey = r["avatar_thumb_key"].isNull() ? "" : r["avatar_thumb_key"].as<std::string>();
+    std::string url      = avatarUrl(avBucket, avKey);
+    std::string thumbUrl = avatarUrl(avBucket, avThumbKey);
+    u["avatar_url"]       = url.empty()      ? Json::Value() : Json::Value(url);
+    u["avatar_thumb_url"] = thumbUrl.empty() ? Json::Value() : Json::Value(thumbUrl);
     return u;
 }
 
@@ -61,7 +65,7 @@ void UsersController::getUser(const drogon::HttpRequestPtr& req,
     db->execSqlAsync(
         "SELECT u.id, u.username, u.display_name, u.bio, u.is_admin, "
         "       u.last_activity, "
-        "       f.bucket AS avatar_bucket, f.object_key AS avatar_key, "
+        "       f.bucket AS avatar_bucket, f.object_key AS avatar_key, f.thumb_key AS avatar_thumb_key, "
         "       COALESCE(us.last_seen_visibility, 'everyone') AS last_seen_visibility, "
         "       CASE "
         "         WHEN u.last_activity IS NULL THEN NULL "
@@ -80,13 +84,10 @@ void UsersController::getUser(const drogon::HttpRequestPtr& req,
             Json::Value u = buildUserJson(r[0]);
 
             bool viewerIsAdmin = false;
-            // Check if viewer is admin
-            auto db2 = drogon::app().getDbClient();
             // We already have the target user's data; check viewer admin inline
             long long targetId = r[0]["id"].as<long long>();
             bool targetIsAdmin = r[0]["is_admin"].isNull() ? false : r[0]["is_admin"].as<bool>();
             std::string visibility = r[0]["last_seen_visibility"].as<std::string>();
-            bool isOnline = WsHandler::isUserOnline(targetId);
 
             std::string lastActivity;
             if (!r[0]["last_activity"].isNull())
@@ -96,37 +97,41 @@ void UsersController::getUser(const drogon::HttpRequestPtr& req,
             if (!r[0]["last_seen_bucket"].isNull())
                 lastSeenBucket = r[0]["last_seen_bucket"].as<std::string>();
 
-            // Check if viewer is admin to decide presence rules
-            db2->execSqlAsync(
-                "SELECT is_admin FROM users WHERE id = $1",
-                [cb, u, visibility, isOnline, lastActivity, lastSeenBucket, viewerId, targetId]
-                (const drogon::orm::Result& vr) mutable {
-                    bool viewerIsAdmin = (!vr.empty() && !vr[0]["is_admin"].isNull() && vr[0]["is_admin"].as<bool>());
-
-                    if (viewerIsAdmin || viewerId == targetId) {
-                        // Admin or self: always return exact presence
-                        u["is_online"] = isOnline;
-                        u["last_activity"] = lastActivity.empty() ? Json::Value() : Json::Value(lastActivity);
-                    } else if (visibility == "everyone") {
-                        u["is_online"] = isOnline;
-                        u["last_activity"] = lastActivity.empty() ? Json::Value() : Json::Value(lastActivity);
-                    } else if (visibility == "approx_only") {
-                        u["is_online"] = Json::Value();
-                        u["last_activity"] = Json::Value();
-                        u["last_seen_approx"] = lastSeenBucket.empty() ? Json::Value() : Json::Value(lastSeenBucket);
-                    } else {
-                        // "nobody"
-                        u["is_online"] = Json::Value();
-                        u["last_activity"] = Json::Value();
-                    }
+            PresenceService::instance().isOnline(targetId,
+                [cb, u, visibility, lastActivity, lastSeenBucket, viewerId, targetId](bool isOnline) mutable {
+                    // Check if viewer is admin to decide presence rules
+                    auto db2 = drogon::app().getDbClient();
+                    db2->execSqlAsync(
+                        "SELECT is_admin FROM users WHERE id = $1",
+                        [cb, u, visibility, isOnline, lastActivity, lastSeenBucket, viewerId, targetId]
+                        (const drogon::orm::Result& vr) mutable {
+                            bool viewerIsAdmin = (!vr.empty() && !vr[0]["is_admin"].isNull() && vr[0]["is_admin"].as<bool>());
+
+                            if (viewerIsAdmin || viewerId == targetId) {
+                                // Admin or self: always return exact presence
+                                u["is_online"] = isOnline;
+                                u["last_activity"] = lastActivity.empty() ? Json::Value() : Json::Value(lastActivity);
+                            } else if (visibility == "everyone") {
+                                u["is_online"] = isOnline;
+                                u["last_activity"] = lastActivity.empty() ? Json::Value() : Json::Value(lastActivity);
+                            } else if (visibility == "approx_only") {
+                                u["is_online"] = Json::Value();
+                                u["last_activity"] = Json::Value();
+                                u["last_seen_approx"] = lastSeenBucket.empty() ? Json::Value() : Json::Value(lastSeenBucket);
+                            } else {
+                                // "nobody"
+                                u["is_online"] = Json::Value();
+                                u["last_activity"] = Json::Value();
+                            }
 
-                    cb(drogon::HttpResponse::newHttpJsonResponse(u));
-                },
-                [cb, u](const drogon::orm::DrogonDbException& e) mutable {
-                    LOG_ERROR << "getUser viewer check: " << e.base().what();
-                    // Fallback: return user without presence
-                    cb(drogon::HttpResponse::newHttpJsonResponse(u));
-                }, viewerId);
+                            cb(drogon::HttpResponse::newHttpJsonResponse(u));
+                        },
+                        [cb, u](const drogon::orm::DrogonDbException& e) mutable {
+                            LOG_ERROR << "getUser viewer check: " << e.base().what();
+                            // Fallback: return user without presence
+                            cb(drogon::HttpResponse::newHttpJsonResponse(u));
+                        }, viewerId);
+                });
         },
         [cb](const drogon::orm::DrogonDbException& e) mutable {
             LOG_ERROR << "getUser: " << e.base().what();
@@ -143,7 +148,7 @@ void UsersController::getUserByUsername(const drogon::HttpRequestPtr& req,
     db->execSqlAsync(
         "SELECT u.id, u.username, u.display_name, u.bio, u.is_admin, "
         "       u.last_activity, "
-        "       f.bucket AS avatar_bucket, f.object_key AS avatar_key, "
+        "       f.bucket AS avatar_bucket, f.object_key AS avatar_key, f.thumb_key AS avatar_thumb_key, "
         "       COALESCE(us.last_seen_visibility, 'everyone') AS last_seen_visibility, "
         "       CASE "
         "         WHEN u.last_activity IS NULL THEN NULL "
@@ -163,7 +168,6 @@ void UsersController::getUserByUsername(const drogon::HttpRequestPtr& req,
 
             long long targetId = r[0]["id"].as<long long>();
             std::string visibility = r[0]["last_seen_visibility"].as<std::string>();
-            bool isOnline = WsHandler::isUserOnline(targetId);
 
             std::string lastActivity;
             if (!r[0]["last_activity"].isNull())
@@ -173,34 +177,37 @@ void UsersController::getUserByUsername(const drogon::HttpRequestPtr& req,
             if (!r[0]["last_seen_bucket"].isNull())
                 lastSeenBucket = r[0]["last_seen_bucket"].as<std::string>();
 
-            auto db2 = drogon::app().getDbClient();
-            db2->execSqlAsync(
-                "SELECT is_admin FROM users WHERE id = $1",
-                [cb, u, visibility, isOnline, lastActivity, lastSeenBucket, viewerId, targetId]
-                (const drogon::orm::Result& vr) mutable {
-                    bool viewerIsAdmin = (!vr.empty() && !vr[0]["is_admin"].isNull() && vr[0]["is_admin"].as<bool>());
-
-                    if (viewerIsAdmin || viewerId == targetId) {
-                        u["is_online"] = isOnline;
-                        u["last_activity"] = lastActivity.empty() ? Json::Value() : Json::Value(lastActivity);
-                    } else if (visibility == "everyone") {
-                        u["is_online"] = isOnline;
-                        u["last_activity"] = lastActivity.empty() ? Json::Value() : Json::Value(lastActivity);
-                    } else if (visibility == "approx_only") {
-                        u["is_online"] = Json::Value();
-                        u["last_activity"] = Json::Value();
-                        u["last_seen_approx"] = lastSeenBucket.empty() ? Json::Value() : Json::Value(lastSeenBucket);
-                    } else {
-                        u["is_online"] = Json::Value();
-                        u["last_activity"] = Json::Value();
-                    }
+            PresenceService::instance().isOnline(targetId,
+                [cb, u, visibility, lastActivity, lastSeenBucket, viewerId, targetId](bool isOnline) mutable {
+                    auto db2 = drogon::app().getDbClient();
+                    db2->execSqlAsync(
+                        "SELECT is_admin FROM users WHERE id = $1",
+                        [cb, u, visibility, isOnline, lastActivity, lastSeenBucket, viewerId, targetId]
+                        (const drogon::orm::Result& vr) mutable {
+                            bool viewerIsAdmin = (!vr.empty() && !vr[0]["is_admin"].isNull() && vr[0]["is_admin"].as<bool>());
+
+                            if (viewerIsAdmin || viewerId == targetId) {
+                                u["is_online"] = isOnline;
+                                u["last_activity"] = lastActivity.empty() ? Json::Value() : Json::Value(lastActivity);
+                            } else if (visibility == "everyone") {
+                                u["is_online"] = isOnline;
+                                u["last_activity"] = lastActivity.empty() ? Json::Value() : Json::Value(lastActivity);
+                            } else if (visibility == "approx_only") {
+                                u["is_online"] = Json::Value();
+                                u["last_activity"] = Json::Value();
+                                u["last_seen_approx"] = lastSeenBucket.empty() ? Json::Value() : Json::Value(lastSeenBucket);
+                            } else {
+                                u["is_online"] = Json::Value();
+                                u["last_activity"] = Json::Value();
+                            }
 
-                    cb(drogon::HttpResponse::newHttpJsonResponse(u));
-                },
-                [cb, u](const drogon::orm::DrogonDbException& e) mutable {
-                    LOG_ERROR << "getUserByUsername viewer check: " << e.base().what();
-                    cb(drogon::HttpResponse::newHttpJsonResponse(u));
-                }, viewerId);
+                            cb(drogon::HttpResponse::newHttpJsonResponse(u));
+                        },
+                        [cb, u](const drogon::orm::DrogonDbException& e) mutable {
+                            LOG_ERROR << "getUserByUsername viewer check: " << e.base().what();
+                            cb(drogon::HttpResponse::newHttpJsonResponse(u));
+                        }, viewerId);
+                });
         },
         [cb](const drogon::orm::DrogonDbException& e) mutable {
             LOG_ERROR << "getUserByUsername: " << e.base().what();
@@ -209,37 +216,62 @@ void UsersController::getUserByUsername(const drogon::HttpRequestPtr& req,
 }
 
 // GET /users/search?q=alice
+// Ranked: exact username, then username prefix, then trigram similarity of
+// username or display name. Matching is index-backed (V25 trigram indexes).
 void UsersController::searchUsers(const drogon::HttpRequestPtr& req,
                                    std::function<void(const drogon::HttpResponsePtr&)>&& cb) {
     std::string q = req->getParameter("q");
+    auto onRows = [cb](const drogon::orm::Result& r) mutable {
+        Json::Value arr(Json::arrayValue);
+        for (auto& row : r)
+            arr.append(buildUserJson(row));
+        cb(drogon::HttpResponse::newHttpJsonResponse(arr));
+    };
+    auto onErr = [cb](const drogon::orm::DrogonDbException& e) mutable {
+        LOG_ERROR << "searchUsers: " << e.base().what();
+        cb(jsonErr("Internal error", drogon::k500InternalServerError));
+    };
+    auto db = drogon::app().getDbClient();
+
     // Allow empty q — returns all users (useful for DM user picker)
+    if (q.empty()) {
+        db->execSqlAsync(
+            "SELECT u.id, u.username, u.display_name, u.bio, u.is_admin, "
+            "       f.bucket AS avatar_bucket, f.object_key AS avatar_key, f.thumb_key AS avatar_thumb_key "
+            "FROM users u LEFT JOIN files f ON f.id = u.avatar_file_id "
+            "WHERE u.is_active = TRUE "
+            "ORDER BY u.username LIMIT 50",
+            std::move(onRows), std::move(onErr));
+        return;
+    }
+
     std::string pattern = "%" + q + "%";
-    auto db = drogon::app().getDbClient();
     db->execSqlAsync(
         "SELECT u.id, u.username, u.display_name, u.bio, u.is_admin, "
-        "       f.bucket AS avatar_bucket, f.object_key AS avatar_key "
+        "       f.bucket AS avatar_bucket, f.object_key AS avatar_key, f.thumb_key AS avatar_thumb_key "
         "FROM users u LEFT JOIN files f ON f.id = u.avatar_file_id "
-        "WHERE (u.username ILIKE $1 OR u.display_name ILIKE $1) AND u.is_active = TRUE "
-        "ORDER BY u.username LIMIT 50",
-        [cb](const drogon::orm::Result& r) mutable {
-            Json::Value arr(Json::arrayValue);
-            for (auto& row : r)
-                arr.append(buildUserJson(row));
-            cb(drogon::HttpResponse::newHttpJsonResponse(arr));
-        },
-        [cb](const drogon::orm::DrogonDbException& e) mutable {
-            LOG_ERROR << "searchUsers: " << e.base().what();
-            cb(jsonErr("Internal error", drogon::k500InternalServerError));
-        }, pattern);
+        "WHERE (u.username::text ILIKE $1 OR u.display_name ILIKE $1) AND u.is_active = TRUE "
+        "ORDER BY lower(u.username::text) = lower($2) DESC, "
+        "         starts_with(lower(u.username::text), lower($2)) DESC, "
+        "         GREATEST(similarity(u.username::text, $2), "
+        "                  similarity(COALESCE(u.display_name, ''), $2)) DESC, "
+        "         u.username "
+        "LIMIT 50",
+        std::move(onRows), std::move(onErr), pattern, q);
 }
 
-// GET /users/{id}/avatar  → 302 to presigned MinIO URL
+// GET /users/{id}/avatar[?size=thumb|preview]  → 302 to presigned MinIO URL
+// The WebP variant when asked for and already rendered, else the original.
 void UsersController::getUserAvatar(const drogon::HttpRequestPtr& req,
                                     std::function<void(const drogon::HttpResponsePtr&)>&& cb,
                                     long long userId) {
+    std::string size = req->getParameter("size");
+    std::string variantColumn = size == "thumb"   ? "f.thumb_key"
+                              : size == "preview" ? "f.preview_key"
+                              : "NULL";
     auto db = drogon::app().getDbClient();
     db->execSqlAsync(
-        "SELECT f.bucket, f.object_key "
+        "SELECT f.bucket, COALESCE(" + variantColumn + ", f.object_key) AS object_key "
         "FROM users u JOIN files f ON f.id = u.avatar_file_id "
         "WHERE u.id = $1",
         [cb](const drogon::orm::Result& r) mutable {
@@ -365,26 +397,29 @@ void UsersController::updateMyAvatar(const drogon::HttpRequestPtr& req,
             // Fetch updated avatar_url for response
             auto db2 = drogon::app().getDbClient();
             db2->execSqlAsync(
-                "SELECT f.bucket, f.object_key FROM files f WHERE f.id = $1",
+                "SELECT f.bucket, f.object_key, COALESCE(f.thumb_key, '') AS thumb_key "
+                "FROM files f WHERE f.id = $1",
                 [cb, me](const drogon::orm::Result& fr) mutable {
                     Json::Value resp;
-                    std::string url;
+                    std::string url, thumbUrl;
                     if (!fr.empty()) {
-                        url = avatarUrl(
-                            fr[0]["bucket"].as<std::string>(),
-                            fr[0]["object_key"].as<std::string>());
-                        resp["avatar_url"] = url;
+                        std::string bucket = fr[0]["bucket"].as<std::string>();
+                        url      = avatarUrl(bucket, fr[0]["object_key"].as<std::string>());
+                        thumbUrl = avatarUrl(bucket, fr[0]["thumb_key"].as<std::string>());
+                        resp["avatar_url"]       = url;
+                        resp["avatar_thumb_url"] = thumbUrl.empty() ? Json::Value() : Json::Value(thumbUrl);
                     }
 
                     // Broadcast avatar update to all chats the user belongs to
                     auto dbP = drogon::app().getDbClient();
                     dbP->execSqlAsync(
                         "SELECT chat_id FROM chat_members WHERE user_id = $1",
-                        [me, url](const drogon::orm::Result& cr) {
+                        [me, url, thumbUrl](const drogon::orm::Result& cr) {
                             Json::Value wsPayload;
-                            wsPayload["type"]       = "user_profile_updated";
-                            wsPayload["user_id"]    = Json::Int64(me);
-                            wsPayload["avatar_url"] = url.empty() ? Json::Value() : Json::Value(url);
+                            wsPayload["type"]             = "user_profile_updated";
+                            wsPayload["user_id"]          = Json::Int64(me);
+                            wsPayload["avatar_url"]       = url.empty()      ? Json::Value() : Json::Value(url);
+                            wsPayload["avatar_thumb_url"] = thumbUrl.empty() ? Json::Value() : Json::Value(thumbUrl);
                             for (const auto& row : cr) {
                                 long long chatId = row["chat_id"].as<long long>();
                                 WsDispatch::publishMessage(chatId, wsPayload);
@@ -5,7 +5,7 @@
 void AuthFilter::doFilter(const drogon::HttpRequestPtr& req,
                            drogon::FilterCallback&&      fcb,
                            drogon::FilterChainCallback&& fccb) {
-    std::string auth = req->getHeader("Authorization");
+    const std::string& auth = req->getHeader("Authorization");
 
     auto reject = [&](const std::string& msg) {
         Json::Value body;
@@ -18,12 +18,12 @@ void AuthFilter::doFilter(const drogon::HttpRequestPtr& req,
     if (auth.empty()) {
         return reject("Missing Authorization header");
     }
-    if (auth.substr(0, 7) != "Bearer ") {
+    if (auth.compare(0, 7, "Bearer ") != 0) {
         return reject("Authorization header must start with 'Bearer '");
     }
 
-    std::string token = auth.substr(7);
-    auto claims = JwtService::instance().verify(token);
+    // View into the header; verified tokens are served from JwtService's cache
+    auto claims = JwtService::instance().verify(std::string_view(auth).substr(7));
     if (!claims) {
         return reject("Invalid or expired token");
     }
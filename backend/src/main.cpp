@@ -15,7 +15,12 @@
 
 #include <drogon/drogon.h>
 #include "config/Config.h"
+#include "services/ImagePipeline.h"
 #include "services/MetricsService.h"
+#include "services/ObjectStore.h"
+#include "services/PartitionManager.h"
+#include "services/PresenceService.h"
+#include "services/UploadSweeper.h"
 #include "controllers/AuthController.h"
 #include "controllers/UsersController.h"
 #include "controllers/ChatsController.h"
@@ -218,6 +223,27 @@ int main(int argc, char* argv[]) {
         },
         {drogon::Options});
 
+    // ── Background maintenance ───────────────────────────────────────────────
+    drogon::app().registerBeginningAdvice([] {
+        PartitionManager::instance().start();
+        PresenceService::instance().start();
+        ObjectStore::instance().start();
+        UploadSweeper::instance().start();
+        ImagePipeline::instance().start();
+    });
+
+    // Image workers talk to MinIO and the database through the IO loops, so
+    // they are stopped before the app quits rather than at static destruction.
+    // Called from the signal handler: hop to the main loop, as quit() does.
+    auto shutdown = [] {
+        drogon::app().getLoop()->queueInLoop([] {
+            ImagePipeline::instance().stop();
+            drogon::app().quit();
+        });
+    };
+    drogon::app().setTermSignalHandler(shutdown);
+    drogon::app().setIntSignalHandler(shutdown);
+
     // ── Server configuration ──────────────────────────────────────────────────
     drogon::app()
         .addListener("0.0.0.0", cfg.apiPort)
@@ -0,0 +1,72 @@
+#include "CryptoPool.h"
+#include "MetricsService.h"
+#include "../config/Config.h"
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+
+CryptoPool& CryptoPool::instance() {
+    static CryptoPool inst;
+    return inst;
+}
+
+CryptoPool::CryptoPool() {
+    const auto& cfg = Config::get();
+    maxQueue_ = static_cast<size_t>(std::max(1, cfg.cryptoQueueMax));
+    int n = std::max(1, cfg.cryptoThreads);
+    workers_.reserve(n);
+    for (int i = 0; i < n; ++i) workers_.emplace_back([this] { workerLoop(); });
+    LOG_INFO << "Crypto pool: " << n << " worker(s), queue limit " << maxQueue_;
+}
+
+CryptoPool::~CryptoPool() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+bool CryptoPool::submit(const std::string& op, std::function<void()> job) {
+    size_t depth;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (queue_.size() >= maxQueue_) {
+            MetricsService::instance().cryptoRejected(op);
+            return false;
+        }
+        queue_.push_back({op, std::move(job), std::chrono::steady_clock::now()});
+        depth = queue_.size();
+    }
+    MetricsService::instance().setCryptoQueueDepth(static_cast<long long>(depth));
+    cv_.notify_one();
+    return true;
+}
+
+void CryptoPool::workerLoop() {
+    for (;;) {
+        Job job;
+        size_t depth;
+        {
+            std::unique_lock<std::mutex> lk(mu_);
+            cv_.wait(lk, [this] { return stop_ || !queue_.empty(); });
+            if (stop_ && queue_.empty()) return;
+            job = std::move(queue_.front());
+            queue_.pop_front();
+            depth = queue_.size();
+        }
+        MetricsService::instance().setCryptoQueueDepth(static_cast<long long>(depth));
+
+        auto start = std::chrono::steady_clock::now();
+        try {
+            job.fn();
+        } catch (const std::exception& e) {
+            LOG_ERROR << "Crypto job '" << job.op << "' error: " << e.what();
+        }
+        auto end = std::chrono::steady_clock::now();
+        MetricsService::instance().observeCrypto(
+            job.op,
+            std::chrono::duration<double>(start - job.enqueued).count(),
+            std::chrono::duration<double>(end - start).count());
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Dedicated worker pool for CPU-heavy crypto (PBKDF2 password hashing,
+/// SHA-256 of uploaded files for content addressing, and of multipart upload
+/// parts for SigV4).
+///
+/// Keeps 100k-iteration PBKDF2 off Drogon's IO and DB loops so a login storm
+/// cannot stall WebSocket delivery. Sized by CRYPTO_THREADS; at most
+/// CRYPTO_QUEUE_MAX jobs may wait, beyond which submit() refuses the job and
+/// the caller answers 503. Queue wait and run time are recorded per `op`
+/// in MetricsService.
+class CryptoPool {
+public:
+    static CryptoPool& instance();
+
+    /// Run `job` on a crypto worker. Returns false without running it when the
+    /// queue is full. `job` runs on a worker thread — anything it calls back
+    /// into (HTTP callbacks, DB clients) must be thread-safe, as Drogon's are.
+    bool submit(const std::string& op, std::function<void()> job);
+
+    ~CryptoPool();
+    CryptoPool(const CryptoPool&) = delete;
+    CryptoPool& operator=(const CryptoPool&) = delete;
+
+private:
+    CryptoPool();
+    void workerLoop();
+
+    struct Job {
+        std::string                           op;
+        std::function<void()>                 fn;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    std::mutex               mu_;
+    std::condition_variable  cv_;
+    std::deque<Job>          queue_;
+    std::vector<std::thread> workers_;
+    size_t                   maxQueue_;
+    bool                     stop_ = false;
+};
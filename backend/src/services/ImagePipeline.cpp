@@ -0,0 +1,218 @@
+#include "ImagePipeline.h"
+#include "MetricsService.h"
+#include "ObjectStore.h"
+#include "../config/Config.h"
+#include <drogon/HttpAppFramework.h>
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string_view>
+
+#ifdef HAVE_VIPS
+#include <vips/vips.h>
+#endif
+
+namespace {
+
+bool isImage(const std::string& mime) {
+    return mime == "image/jpeg" || mime == "image/png" ||
+           mime == "image/webp" || mime == "image/gif";
+}
+
+#ifdef HAVE_VIPS
+
+// Longest a worker waits on MinIO. ObjectStore's own timeout normally answers
+// first; this only bounds a stuck worker when that is off.
+constexpr auto kStoreWait = std::chrono::minutes(5);
+// How often a waiting worker checks for shutdown.
+constexpr auto kStopPoll  = std::chrono::milliseconds(100);
+
+// Wait for `f` until it is ready, kStoreWait passes or `stop` is set.
+template <typename T>
+bool await(std::future<T>& f, const std::atomic<bool>& stop) {
+    const auto deadline = std::chrono::steady_clock::now() + kStoreWait;
+    while (f.wait_for(kStopPoll) != std::future_status::ready) {
+        if (stop || std::chrono::steady_clock::now() >= deadline) return false;
+    }
+    return true;
+}
+
+// Shrink `src` to fit within maxPx × maxPx (never enlarging), turned upright
+// per its EXIF orientation and with metadata stripped, as WebP. "" on failure.
+std::string renderWebp(std::string_view src, int maxPx, int quality) {
+    VipsImage* img = nullptr;
+    if (vips_thumbnail_buffer(const_cast<char*>(src.data()), src.size(), &img, maxPx,
+                              "height", maxPx, "size", VIPS_SIZE_DOWN, nullptr) != 0) {
+        LOG_WARN << "Image variant decode failed: " << vips_error_buffer();
+        vips_error_clear();
+        return {};
+    }
+    void*  out    = nullptr;
+    size_t outLen = 0;
+    int rc = vips_webpsave_buffer(img, &out, &outLen, "Q", quality, "strip", TRUE, nullptr);
+    g_object_unref(img);
+    if (rc != 0) {
+        LOG_WARN << "Image variant encode failed: " << vips_error_buffer();
+        vips_error_clear();
+        return {};
+    }
+    std::string webp(static_cast<const char*>(out), outLen);
+    g_free(out);
+    return webp;
+}
+
+// ObjectStore answers on an IO loop; the worker blocks until it does. The
+// promise is shared so a late answer after an abandoned wait is harmless.
+drogon::HttpResponsePtr fetch(const std::string& bucket, const std::string& key,
+                              const std::atomic<bool>& stop) {
+    auto p = std::make_shared<std::promise<drogon::HttpResponsePtr>>();
+    auto f = p->get_future();
+    ObjectStore::instance().get(bucket, key,
+                                [p](const drogon::HttpResponsePtr& obj) { p->set_value(obj); });
+    return await(f, stop) ? f.get() : nullptr;
+}
+
+bool store(const std::string& bucket, const std::string& key,
+           std::shared_ptr<const std::string> webp, const std::atomic<bool>& stop) {
+    auto p = std::make_shared<std::promise<bool>>();
+    auto f = p->get_future();
+    ObjectStore::instance().put(bucket, key, "image/webp", webp->data(), webp->size(), "",
+                                [p, webp](bool ok) { p->set_value(ok); });
+    return await(f, stop) && f.get();
+}
+
+#endif  // HAVE_VIPS
+
+}  // namespace
+
+ImagePipeline& ImagePipeline::instance() {
+    static ImagePipeline inst;
+    return inst;
+}
+
+ImagePipeline::ImagePipeline() {
+    const auto& cfg = Config::get();
+    maxQueue_       = static_cast<size_t>(std::max(1, cfg.imageQueueMax));
+    maxSourceBytes_ = static_cast<long long>(std::max(0, cfg.imageMaxSourceMb)) * 1024 * 1024;
+}
+
+void ImagePipeline::start() {
+#ifdef HAVE_VIPS
+    const auto& cfg = Config::get();
+    int n = std::max(0, cfg.imageThreads);
+    if (n == 0) {
+        LOG_INFO << "Image variants disabled (IMAGE_THREADS=0)";
+        return;
+    }
+    if (VIPS_INIT("messenger_api") != 0) {
+        LOG_ERROR << "Image variants disabled: libvips init failed: " << vips_error_buffer();
+        vips_error_clear();
+        return;
+    }
+    vips_concurrency_set(1);        // parallelism comes from the workers
+    vips_cache_set_max(0);          // every source is seen once
+#if VIPS_MAJOR_VERSION > 8 || (VIPS_MAJOR_VERSION == 8 && VIPS_MINOR_VERSION >= 13)
+    vips_block_untrusted_set(TRUE); // uploads are untrusted; keep to fuzzed loaders
+#endif
+
+    workers_.reserve(n);
+    for (int i = 0; i < n; ++i) workers_.emplace_back([this] { workerLoop(); });
+    running_ = workers_.size();
+    LOG_INFO << "Image pipeline: " << n << " worker(s), queue limit " << maxQueue_;
+#else
+    LOG_INFO << "Image variants disabled (built without libvips)";
+#endif
+}
+
+void ImagePipeline::stop() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+        queue_.clear();
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) t.join();
+    workers_.clear();
+    running_ = 0;
+}
+
+// Normally a no-op: stop() already ran from the shutdown hook.
+ImagePipeline::~ImagePipeline() {
+    stop();
+}
+
+void ImagePipeline::enqueue(long long fileId, const std::string& bucket,
+                            const std::string& objectKey, const std::string& mime,
+                            long long size) {
+    if (running_ == 0 || !isImage(mime) || size <= 0 || size > maxSourceBytes_) return;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (stop_) return;
+        if (queue_.size() >= maxQueue_) {
+            MetricsService::instance().imageVariantsSkipped();
+            LOG_WARN << "Image queue full, no variants for file " << fileId;
+            return;
+        }
+        queue_.push_back({fileId, bucket, objectKey});
+    }
+    cv_.notify_one();
+}
+
+void ImagePipeline::workerLoop() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lk(mu_);
+            cv_.wait(lk, [this] { return stop_ || !queue_.empty(); });
+            // Variants are an optimisation; pending ones are dropped on shutdown
+            if (stop_) return;
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        try {
+            process(job);
+        } catch (const std::exception& e) {
+            LOG_ERROR << "Image variants for file " << job.fileId << " error: " << e.what();
+            MetricsService::instance().imageVariants(false);
+        }
+    }
+}
+
+void ImagePipeline::process(const Job& job) {
+#ifdef HAVE_VIPS
+    const auto& cfg = Config::get();
+    const int quality = std::clamp(cfg.imageWebpQuality, 1, 100);
+
+    auto obj = fetch(job.bucket, job.objectKey, stop_);
+    if (!obj) return MetricsService::instance().imageVariants(false);
+    auto thumb   = std::make_shared<const std::string>(
+        renderWebp(obj->body(), cfg.imageThumbPx, quality));
+    auto preview = std::make_shared<const std::string>(
+        renderWebp(obj->body(), cfg.imagePreviewPx, quality));
+    obj.reset();  // done with the original
+    if (thumb->empty() || preview->empty())
+        return MetricsService::instance().imageVariants(false);
+
+    std::string thumbKey   = job.objectKey + ".thumb.webp";
+    std::string previewKey = job.objectKey + ".preview.webp";
+    if (!store(job.bucket, thumbKey, thumb, stop_) ||
+        !store(job.bucket, previewKey, preview, stop_))
+        return MetricsService::instance().imageVariants(false);
+    if (stop_) return;  // shutting down: the database client may be gone
+
+    // Every upload of the same content shares the object, and so its variants
+    long long fileId = job.fileId;
+    drogon::app().getDbClient()->execSqlAsync(
+        "UPDATE files SET thumb_key = $2, preview_key = $3 WHERE object_key = $1",
+        [](const drogon::orm::Result&) { MetricsService::instance().imageVariants(true); },
+        [fileId](const drogon::orm::DrogonDbException& e) {
+            LOG_ERROR << "Image variants for file " << fileId << " not recorded: " << e.base().what();
+            MetricsService::instance().imageVariants(false);
+        },
+        job.objectKey, thumbKey, previewKey);
+#else
+    (void)job;
+#endif
+}
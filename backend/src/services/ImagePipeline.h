@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Renders WebP variants of uploaded images in the background, so clients can
+/// show a 40×40 avatar or an image in history without fetching the original.
+///
+/// When an image upload becomes ready, FilesController calls enqueue(). A
+/// worker fetches the original from MinIO, renders a "thumb" (longest side
+/// IMAGE_THUMB_PX, for avatars and chat-list entries) and a "preview"
+/// (IMAGE_PREVIEW_PX, for images in message history), stores them next to
+/// the original as <key>.thumb.webp / <key>.preview.webp and records the keys
+/// in files.thumb_key / preview_key of every row on that object. Controllers
+/// presign those as *_thumb_url / *_preview_url, which stay null until the
+/// variants exist.
+///
+/// IMAGE_THREADS workers render one image each at a time, so at most that
+/// many originals (each at most IMAGE_MAX_SOURCE_MB) are held in memory. With
+/// IMAGE_QUEUE_MAX images waiting, further ones are skipped and simply get no
+/// variants. Rendering needs libvips; built without it (HAVE_VIPS unset) the
+/// pipeline is disabled and enqueue() does nothing.
+///
+/// Workers reach MinIO and the database through the app's IO loops, so stop()
+/// must run while those are still up: main.cpp calls it on SIGTERM/SIGINT,
+/// before asking the app to quit.
+class ImagePipeline {
+public:
+    static ImagePipeline& instance();
+
+    /// Start the workers. Call once the app is running; until then enqueue()
+    /// does nothing.
+    void start();
+    /// Drop queued jobs, abandon in-flight ones and join the workers. Call on
+    /// the main loop before the app quits; idempotent.
+    void stop();
+
+    /// Queue variant rendering for a ready file. Returns at once; files that
+    /// are not images, or too large, are ignored.
+    void enqueue(long long fileId, const std::string& bucket,
+                 const std::string& objectKey, const std::string& mime, long long size);
+
+    ~ImagePipeline();
+    ImagePipeline(const ImagePipeline&) = delete;
+    ImagePipeline& operator=(const ImagePipeline&) = delete;
+
+private:
+    ImagePipeline();
+    void workerLoop();
+
+    struct Job {
+        long long   fileId = 0;
+        std::string bucket;
+        std::string objectKey;
+    };
+    void process(const Job& job);
+
+    std::mutex               mu_;
+    std::condition_variable  cv_;
+    std::deque<Job>          queue_;
+    std::vector<std::thread> workers_;    // only touched by start()/stop() on the main loop
+    std::atomic<size_t>      running_{0}; // workers started; enqueue() reads it from any thread
+    size_t                   maxQueue_;
+    long long                maxSourceBytes_;
+    std::atomic<bool>        stop_{false};  // set under mu_; polled by workers waiting on MinIO
+};
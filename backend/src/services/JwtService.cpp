@@ -1,12 +1,16 @@
 #include "JwtService.h"
 #include "../config/Config.h"
-#include <openssl/hmac.h>
+#include <openssl/core_names.h>
 #include <openssl/evp.h>
-#include <openssl/bio.h>
-#include <openssl/buffer.h>
+#include <openssl/params.h>
+#include <openssl/crypto.h>
 #include <json/json.h>
+#include <array>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <stdexcept>
-#include <sstream>
 #include <cstring>
 
 JwtService& JwtService::instance() {
@@ -16,28 +20,35 @@ JwtService& JwtService::instance() {
 
 // ── Base64URL ──────────────────────────────────────────────────────────────
 
-static std::string b64url_encode(const unsigned char* data, size_t len) {
-    // Standard base64 via OpenSSL BIO
-    BIO* b64  = BIO_new(BIO_f_base64());
-    BIO* bmem = BIO_new(BIO_s_mem());
-    b64 = BIO_push(b64, bmem);
-    BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
-    BIO_write(b64, data, static_cast<int>(len));
-    BIO_flush(b64);
-
-    BUF_MEM* bptr;
-    BIO_get_mem_ptr(b64, &bptr);
-    std::string result(bptr->data, bptr->length);
-    BIO_free_all(b64);
-
-    // Base64 → Base64URL
-    for (auto& c : result) {
-        if (c == '+') c = '-';
-        else if (c == '/') c = '_';
+static constexpr char kB64Url[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Unpadded base64url into `out` (needs 4 * ceil(len / 3) bytes); returns length.
+static size_t b64url_encode_to(const unsigned char* d, size_t len, char* out) {
+    size_t o = 0, i = 0;
+    for (; i + 2 < len; i += 3) {
+        uint32_t n = (uint32_t(d[i]) << 16) | (uint32_t(d[i + 1]) << 8) | d[i + 2];
+        out[o++] = kB64Url[(n >> 18) & 63];
+        out[o++] = kB64Url[(n >> 12) & 63];
+        out[o++] = kB64Url[(n >> 6) & 63];
+        out[o++] = kB64Url[n & 63];
     }
-    // Remove padding
-    while (!result.empty() && result.back() == '=')
-        result.pop_back();
+    if (len - i == 1) {
+        uint32_t n = uint32_t(d[i]) << 16;
+        out[o++] = kB64Url[(n >> 18) & 63];
+        out[o++] = kB64Url[(n >> 12) & 63];
+    } else if (len - i == 2) {
+        uint32_t n = (uint32_t(d[i]) << 16) | (uint32_t(d[i + 1]) << 8);
+        out[o++] = kB64Url[(n >> 18) & 63];
+        out[o++] = kB64Url[(n >> 12) & 63];
+        out[o++] = kB64Url[(n >> 6) & 63];
+    }
+    return o;
+}
+
+static std::string b64url_encode(const unsigned char* data, size_t len) {
+    std::string result((len + 2) / 3 * 4, '\0');
+    result.resize(b64url_encode_to(data, len, result.data()));
     return result;
 }
 
@@ -46,40 +57,76 @@ static std::string b64url_encode_str(const std::string& s) {
         reinterpret_cast<const unsigned char*>(s.data()), s.size());
 }
 
-static std::string b64url_decode_str(const std::string& in) {
-    std::string padded = in;
-    for (auto& c : padded) {
-        if (c == '-') c = '+';
-        else if (c == '_') c = '/';
+// Decode unpadded base64url into `out` (capacity `cap`). False on invalid
+// input or overflow.
+static bool b64url_decode_to(std::string_view in, char* out, size_t cap, size_t& outLen) {
+    static const std::array<signed char, 256> kRev = [] {
+        std::array<signed char, 256> t{};
+        t.fill(-1);
+        for (int i = 0; i < 64; i++) t[static_cast<unsigned char>(kB64Url[i])] = static_cast<signed char>(i);
+        return t;
+    }();
+    if (in.size() % 4 == 1) return false;
+    if (in.size() / 4 * 3 + 2 > cap) return false;
+
+    size_t o = 0;
+    uint32_t acc = 0;
+    int bits = 0;
+    for (unsigned char c : in) {
+        int v = kRev[c];
+        if (v < 0) return false;
+        acc = (acc << 6) | static_cast<uint32_t>(v);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out[o++] = static_cast<char>((acc >> bits) & 0xff);
+        }
     }
-    while (padded.size() % 4) padded += '=';
-
-    BIO* b64  = BIO_new(BIO_f_base64());
-    BIO* bmem = BIO_new_mem_buf(padded.data(), static_cast<int>(padded.size()));
-    b64 = BIO_push(b64, bmem);
-    BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
-
-    std::string result(padded.size(), '\0');
-    int decoded = BIO_read(b64, result.data(), static_cast<int>(padded.size()));
-    BIO_free_all(b64);
-    if (decoded < 0) return {};
-    result.resize(static_cast<size_t>(decoded));
-    return result;
+    outLen = o;
+    return true;
 }
 
 // ── HMAC-SHA256 ───────────────────────────────────────────────────────────
 
-static std::string sign(const std::string& headerDotPayload) {
-    const auto& secret = Config::get().jwtSecret;
-    unsigned char digest[EVP_MAX_MD_SIZE];
-    unsigned int  dlen = 0;
+// HMAC context keyed once with the JWT secret, copied per thread (EVP_MAC
+// contexts are not shareable). Re-initialising with a null key reuses the
+// precomputed pads instead of rehashing the key.
+static EVP_MAC_CTX* keyedHmacTemplate() {
+    static EVP_MAC_CTX* tmpl = [] {
+        EVP_MAC* mac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
+        if (!mac) throw std::runtime_error("HMAC unavailable in OpenSSL");
+        EVP_MAC_CTX* ctx = EVP_MAC_CTX_new(mac);
+        EVP_MAC_free(mac);  // ctx holds its own reference
+        char digest[] = "SHA256";
+        OSSL_PARAM params[] = {
+            OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+            OSSL_PARAM_construct_end()};
+        const auto& secret = Config::get().jwtSecret;
+        if (!ctx || !EVP_MAC_init(ctx, reinterpret_cast<const unsigned char*>(secret.data()),
+                                  secret.size(), params))
+            throw std::runtime_error("HMAC-SHA256 init failed");
+        return ctx;
+    }();
+    return tmpl;
+}
+
+static unsigned int hmacSecret(std::string_view msg, unsigned char* digest) {
+    struct Ctx {
+        EVP_MAC_CTX* ctx = EVP_MAC_CTX_dup(keyedHmacTemplate());
+        ~Ctx() { EVP_MAC_CTX_free(ctx); }
+    };
+    thread_local Ctx t;
 
-    HMAC(EVP_sha256(),
-         secret.data(), static_cast<int>(secret.size()),
-         reinterpret_cast<const unsigned char*>(headerDotPayload.data()),
-         headerDotPayload.size(),
-         digest, &dlen);
+    size_t dlen = 0;
+    EVP_MAC_init(t.ctx, nullptr, 0, nullptr);
+    EVP_MAC_update(t.ctx, reinterpret_cast<const unsigned char*>(msg.data()), msg.size());
+    EVP_MAC_final(t.ctx, digest, &dlen, EVP_MAX_MD_SIZE);
+    return static_cast<unsigned int>(dlen);
+}
 
+static std::string sign(const std::string& headerDotPayload) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int  dlen = hmacSecret(headerDotPayload, digest);
     return b64url_encode(digest, dlen);
 }
 
@@ -101,6 +148,196 @@ static std::string makePayload(long long userId,
     return Json::writeString(wbuilder, p);
 }
 
+// ── Payload parser ─────────────────────────────────────────────────────────
+
+// Parses the flat object makePayload writes without building a Json::Value.
+// Returns false on anything it does not understand (escapes, nesting, ...);
+// the caller then falls back to jsoncpp.
+static bool parseClaimsFast(std::string_view js, JwtService::Claims& c) {
+    size_t i = 0;
+    auto ws = [&] { while (i < js.size() && (js[i] == ' ' || js[i] == '\n' ||
+                                             js[i] == '\t' || js[i] == '\r')) i++; };
+    auto str = [&](std::string_view& out) {
+        if (i >= js.size() || js[i] != '"') return false;
+        size_t start = ++i;
+        while (i < js.size() && js[i] != '"') {
+            if (js[i] == '\\') return false;
+            i++;
+        }
+        if (i >= js.size()) return false;
+        out = js.substr(start, i - start);
+        i++;
+        return true;
+    };
+    auto num = [&](long long& out) {
+        bool neg = i < js.size() && js[i] == '-';
+        if (neg) i++;
+        size_t start = i;
+        long long v = 0;
+        while (i < js.size() && js[i] >= '0' && js[i] <= '9') {
+            if (i - start >= 18) return false;
+            v = v * 10 + (js[i++] - '0');
+        }
+        if (i == start) return false;
+        out = neg ? -v : v;
+        return true;
+    };
+    auto lit = [&](std::string_view word) {
+        if (js.substr(i, word.size()) != word) return false;
+        i += word.size();
+        return true;
+    };
+
+    bool haveSub = false, haveType = false, haveExp = false;
+    c.iat = 0;
+    c.isAdmin = false;
+
+    ws();
+    if (i >= js.size() || js[i++] != '{') return false;
+    ws();
+    if (i < js.size() && js[i] == '}') return false;
+    for (;;) {
+        std::string_view key;
+        ws();
+        if (!str(key)) return false;
+        ws();
+        if (i >= js.size() || js[i++] != ':') return false;
+        ws();
+
+        if (key == "sub") {
+            std::string_view sv;
+            if (!str(sv) || sv.empty() || sv.size() > 18) return false;
+            long long v = 0;
+            for (char ch : sv) {
+                if (ch < '0' || ch > '9') return false;
+                v = v * 10 + (ch - '0');
+            }
+            c.userId = v;
+            haveSub = true;
+        } else if (key == "type") {
+            std::string_view sv;
+            if (!str(sv)) return false;
+            c.tokenType.assign(sv.data(), sv.size());
+            haveType = true;
+        } else if (key == "exp") {
+            if (!num(c.exp)) return false;
+            haveExp = true;
+        } else if (key == "iat") {
+            if (!num(c.iat)) return false;
+        } else if (key == "is_admin") {
+            if (lit("true")) c.isAdmin = true;
+            else if (lit("false")) c.isAdmin = false;
+            else return false;
+        } else {
+            // Unknown member: only skip simple scalars
+            std::string_view sv;
+            long long n;
+            if (!(str(sv) || num(n) || lit("true") || lit("false") || lit("null")))
+                return false;
+        }
+
+        ws();
+        if (i >= js.size()) return false;
+        if (js[i] == ',') { i++; continue; }
+        if (js[i] == '}') { i++; break; }
+        return false;
+    }
+    ws();
+    return i == js.size() && haveSub && haveType && haveExp;
+}
+
+static bool parseClaimsJson(std::string_view js, JwtService::Claims& c) {
+    Json::Value root;
+    Json::CharReaderBuilder rbuilder;
+    std::unique_ptr<Json::CharReader> reader(rbuilder.newCharReader());
+    std::string err;
+    if (!reader->parse(js.data(), js.data() + js.size(), &root, &err)) return false;
+    try {
+        c.userId    = std::stoll(root["sub"].asString());
+        c.tokenType = root["type"].asString();
+        c.exp       = root["exp"].asInt64();
+        c.iat       = root["iat"].asInt64();
+        c.isAdmin   = root.isMember("is_admin") && root["is_admin"].asBool();
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// ── Verified-token cache ───────────────────────────────────────────────────
+
+namespace {
+
+// Sharded LRU of verified tokens, keyed by the signature segment. Entries hold
+// the full token and a hit must match it byte-for-byte, so the cache can only
+// ever answer for a token that passed HMAC verification before.
+class VerifiedTokenCache {
+public:
+    explicit VerifiedTokenCache(int capacity)
+        : perShard_(capacity > 0 ? std::max<size_t>(1, size_t(capacity) / kShards) : 0) {}
+
+    bool enabled() const { return perShard_ > 0; }
+
+    std::optional<JwtService::Claims> find(std::string_view token, std::string_view sig,
+                                           long long now) {
+        auto& s = shardFor(sig);
+        std::lock_guard<std::mutex> lk(s.mu);
+        auto it = s.index.find(sig);
+        if (it == s.index.end()) return std::nullopt;
+        auto node = it->second;
+        if (node->token != token) return std::nullopt;
+        if (now >= node->claims.exp) {
+            s.index.erase(it);
+            s.lru.erase(node);
+            return std::nullopt;
+        }
+        s.lru.splice(s.lru.begin(), s.lru, node);
+        return node->claims;
+    }
+
+    void insert(std::string_view token, size_t sigOffset, const JwtService::Claims& claims) {
+        auto& s = shardFor(token.substr(sigOffset));
+        std::lock_guard<std::mutex> lk(s.mu);
+        if (s.index.count(token.substr(sigOffset))) return;
+        s.lru.push_front(Entry{std::string(token), sigOffset, claims});
+        s.index.emplace(s.lru.front().sig(), s.lru.begin());
+        if (s.lru.size() > perShard_) {
+            s.index.erase(s.lru.back().sig());
+            s.lru.pop_back();
+        }
+    }
+
+private:
+    static constexpr size_t kShards = 16;
+
+    struct Entry {
+        std::string        token;
+        size_t             sigOffset;
+        JwtService::Claims claims;
+        std::string_view sig() const { return std::string_view(token).substr(sigOffset); }
+    };
+    struct Shard {
+        std::mutex mu;
+        std::list<Entry> lru;  // front = most recently used
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;  // views into lru
+    };
+
+    Shard& shardFor(std::string_view sig) {
+        uint64_t h = std::hash<std::string_view>{}(sig);
+        return shards_[(h * 0x9E3779B97F4A7C15ull) >> 60];
+    }
+
+    std::array<Shard, kShards> shards_;
+    const size_t perShard_;
+};
+
+VerifiedTokenCache& verifiedCache() {
+    static VerifiedTokenCache c(Config::get().jwtCacheSize);
+    return c;
+}
+
+} // namespace
+
 // ── Public API ─────────────────────────────────────────────────────────────
 
 static const std::string kHeader =
@@ -120,43 +357,50 @@ std::string JwtService::createRefreshToken(long long userId, bool isAdmin) const
     return hdrPayload + "." + sign(hdrPayload);
 }
 
-std::optional<JwtService::Claims> JwtService::verify(const std::string& token) const {
-    auto dot1 = token.find('.');
-    if (dot1 == std::string::npos) return std::nullopt;
-    auto dot2 = token.find('.', dot1 + 1);
-    if (dot2 == std::string::npos) return std::nullopt;
+// Full verification: HMAC, payload decode and expiry check, all on the stack.
+static std::optional<JwtService::Claims> verifyUncached(std::string_view token,
+                                                        size_t dot1, size_t dot2,
+                                                        long long now) {
+    std::string_view hdrPayload = token.substr(0, dot2);
+    std::string_view sigGiven   = token.substr(dot2 + 1);
 
-    std::string hdrPayload = token.substr(0, dot2);
-    std::string sigGiven   = token.substr(dot2 + 1);
-    std::string sigExpect  = sign(hdrPayload);
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int  dlen = hmacSecret(hdrPayload, digest);
+    char sigExpect[(EVP_MAX_MD_SIZE + 2) / 3 * 4];
+    size_t elen = b64url_encode_to(digest, dlen, sigExpect);
 
     // Constant-time comparison
-    if (sigGiven.size() != sigExpect.size()) return std::nullopt;
-    unsigned char diff = 0;
-    for (size_t i = 0; i < sigGiven.size(); i++)
-        diff |= static_cast<unsigned char>(sigGiven[i]) ^
-                static_cast<unsigned char>(sigExpect[i]);
-    if (diff != 0) return std::nullopt;
+    if (sigGiven.size() != elen) return std::nullopt;
+    if (CRYPTO_memcmp(sigGiven.data(), sigExpect, elen) != 0) return std::nullopt;
 
-    // Decode payload
-    std::string payloadJson = b64url_decode_str(token.substr(dot1 + 1, dot2 - dot1 - 1));
-    if (payloadJson.empty()) return std::nullopt;
+    // Decode payload (our tokens are ~120 bytes; anything huge is not ours)
+    char payloadJson[1024];
+    size_t plen = 0;
+    if (!b64url_decode_to(token.substr(dot1 + 1, dot2 - dot1 - 1),
+                          payloadJson, sizeof(payloadJson), plen) || plen == 0)
+        return std::nullopt;
 
-    Json::Value root;
-    Json::CharReaderBuilder rbuilder;
-    std::istringstream ss(payloadJson);
-    std::string err;
-    if (!Json::parseFromStream(rbuilder, ss, &root, &err)) return std::nullopt;
+    JwtService::Claims c;
+    std::string_view js(payloadJson, plen);
+    if (!parseClaimsFast(js, c) && !parseClaimsJson(js, c)) return std::nullopt;
 
-    long long exp = root["exp"].asInt64();
-    long long now = static_cast<long long>(std::time(nullptr));
-    if (now >= exp) return std::nullopt;  // expired
-
-    Claims c;
-    c.userId    = std::stoll(root["sub"].asString());
-    c.tokenType = root["type"].asString();
-    c.exp       = exp;
-    c.iat       = root["iat"].asInt64();
-    c.isAdmin   = root.isMember("is_admin") && root["is_admin"].asBool();
+    if (now >= c.exp) return std::nullopt;  // expired
     return c;
 }
+
+std::optional<JwtService::Claims> JwtService::verify(std::string_view token) const {
+    auto dot1 = token.find('.');
+    if (dot1 == std::string_view::npos) return std::nullopt;
+    auto dot2 = token.find('.', dot1 + 1);
+    if (dot2 == std::string_view::npos) return std::nullopt;
+
+    long long now = static_cast<long long>(std::time(nullptr));
+    auto& cache = verifiedCache();
+    if (cache.enabled()) {
+        if (auto hit = cache.find(token, token.substr(dot2 + 1), now)) return hit;
+    }
+
+    auto claims = verifyUncached(token, dot1, dot2, now);
+    if (claims && cache.enabled()) cache.insert(token, dot2 + 1, *claims);
+    return claims;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <optional>
 #include <ctime>
 
@@ -23,7 +24,9 @@ public:
     std::string createRefreshToken(long long userId, bool isAdmin = false) const;
 
     /// Verify and decode a token. Returns nullopt if invalid or expired.
-    std::optional<Claims> verify(const std::string& token) const;
+    /// Verified tokens are cached (JWT_CACHE_SIZE) until they expire, so a
+    /// client re-sending the same token skips the HMAC and payload decode.
+    std::optional<Claims> verify(std::string_view token) const;
 
 private:
     JwtService() = default;
@@ -0,0 +1,154 @@
+#include "MembershipCache.h"
+#include "PresenceService.h"
+#include "../config/Config.h"
+#include "../ws/RedisChannelMux.h"
+#include <drogon/drogon.h>
+#include <drogon/nosql/RedisClient.h>
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <cstdlib>
+
+static const char* const kChannel = "membership";
+
+MembershipCache& MembershipCache::instance() {
+    static MembershipCache inst;
+    return inst;
+}
+
+MembershipCache::MembershipCache()
+    : maxPerShard_(std::max<size_t>(1, static_cast<size_t>(
+          std::max(0, Config::get().membershipCacheSize)) / kShards)),
+      ttl_(std::max(1, Config::get().membershipCacheTtlSec)) {}
+
+MembershipCache::Shard& MembershipCache::shardFor(long long chatId) {
+    return shards_[static_cast<unsigned long long>(chatId) % kShards];
+}
+
+void MembershipCache::ensureSubscribed() {
+    std::call_once(subscribeOnce_, [this] {
+        // Held for the life of the process; never released
+        RedisChannelMux::instance().acquire(kChannel,
+            [this](const std::string&, const std::string& msg) {
+                applyInvalidation(msg);
+            });
+    });
+}
+
+void MembershipCache::lookup(long long chatId, long long userId, Callback cb) {
+    ensureSubscribed();
+    const bool enabled = Config::get().membershipCacheSize > 0;
+
+    std::uint64_t epoch = 0;
+    if (enabled) {
+        auto& s = shardFor(chatId);
+        std::unique_lock<std::mutex> lk(s.mu);
+        auto cit = s.chats.find(chatId);
+        if (cit != s.chats.end()) {
+            auto uit = cit->second.find(userId);
+            if (uit != cit->second.end()) {
+                if (uit->second.expires > std::chrono::steady_clock::now()) {
+                    Membership m{true, uit->second.role, uit->second.chatType};
+                    lk.unlock();
+                    return cb(m);
+                }
+                cit->second.erase(uit);
+                s.size--;
+                if (cit->second.empty()) s.chats.erase(cit);
+            }
+        }
+        epoch = s.epoch;
+    }
+
+    auto db = drogon::app().getDbClient();
+    db->execSqlAsync(
+        "SELECT c.type::TEXT AS type, cm.role FROM chat_members cm "
+        "JOIN chats c ON c.id = cm.chat_id "
+        "WHERE cm.chat_id = $1 AND cm.user_id = $2",
+        [this, cb, chatId, userId, epoch, enabled](const drogon::orm::Result& r) {
+            if (r.empty()) return cb(Membership{});
+            Membership m{true, r[0]["role"].as<std::string>(), r[0]["type"].as<std::string>()};
+
+            if (enabled) {
+                auto& s = shardFor(chatId);
+                std::lock_guard<std::mutex> lk(s.mu);
+                // An invalidation raced with this load; don't cache what may be stale
+                if (s.epoch == epoch) {
+                    if (s.size >= maxPerShard_) {
+                        // Full: start the shard over rather than track recency
+                        s.chats.clear();
+                        s.size = 0;
+                    }
+                    auto& users = s.chats[chatId];
+                    bool inserted = users.insert_or_assign(
+                        userId, Entry{m.role, m.chatType, std::chrono::steady_clock::now() + ttl_}).second;
+                    if (inserted) s.size++;
+                }
+            }
+            cb(m);
+        },
+        [cb](const drogon::orm::DrogonDbException& e) {
+            LOG_ERROR << "membership lookup: " << e.base().what();
+            Membership m;
+            m.failed = true;
+            cb(m);
+        },
+        chatId, userId);
+}
+
+void MembershipCache::dropMember(long long chatId, long long userId) {
+    PresenceService::instance().invalidateMember(chatId, userId);
+    auto& s = shardFor(chatId);
+    std::lock_guard<std::mutex> lk(s.mu);
+    s.epoch++;
+    auto cit = s.chats.find(chatId);
+    if (cit == s.chats.end()) return;
+    s.size -= cit->second.erase(userId);
+    if (cit->second.empty()) s.chats.erase(cit);
+}
+
+void MembershipCache::dropChat(long long chatId) {
+    PresenceService::instance().invalidateChat(chatId);
+    auto& s = shardFor(chatId);
+    std::lock_guard<std::mutex> lk(s.mu);
+    s.epoch++;
+    auto cit = s.chats.find(chatId);
+    if (cit == s.chats.end()) return;
+    s.size -= cit->second.size();
+    s.chats.erase(cit);
+}
+
+void MembershipCache::publish(const std::string& msg) {
+    auto redis = drogon::app().getRedisClient();
+    if (!redis) return;
+    redis->execCommandAsync(
+        [](const drogon::nosql::RedisResult&) {},
+        [](const std::exception& e) {
+            LOG_ERROR << "Redis PUBLISH (membership) error: " << e.what();
+        },
+        "PUBLISH %s %s", kChannel, msg.c_str());
+}
+
+void MembershipCache::invalidateMember(long long chatId, long long userId) {
+    dropMember(chatId, userId);
+    publish("m " + std::to_string(chatId) + " " + std::to_string(userId));
+}
+
+void MembershipCache::invalidateChat(long long chatId) {
+    dropChat(chatId);
+    publish("c " + std::to_string(chatId));
+}
+
+void MembershipCache::applyInvalidation(std::string_view msg) {
+    if (msg.size() < 3 || msg[1] != ' ') return;
+    std::string rest(msg.substr(2));
+    char* end = nullptr;
+    long long chatId = std::strtoll(rest.c_str(), &end, 10);
+    if (chatId <= 0) return;
+
+    if (msg[0] == 'c') {
+        dropChat(chatId);
+    } else if (msg[0] == 'm') {
+        long long userId = std::strtoll(end, nullptr, 10);
+        if (userId > 0) dropMember(chatId, userId);
+    }
+}
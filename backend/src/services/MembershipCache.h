@@ -0,0 +1,80 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/// In-process cache of chat membership: (chat_id, user_id) → role + chat type.
+///
+/// Replaces the per-request `SELECT 1 FROM chat_members` (and the follow-up
+/// `SELECT c.type, cm.role`) in front of history reads, reactions, pins and
+/// WS subscribes (sends check membership inside their insert statement).
+/// Only positive answers are cached, so for this cache only removals and
+/// role changes (leave, promote, demote, chat delete) need to call
+/// invalidateMember()/invalidateChat(), which drop the local entry and
+/// broadcast the invalidation to every node over the Redis "membership"
+/// channel. Joins call invalidateMember() as well: the same invalidation
+/// drops the presence observer sets (PresenceService) the new member now
+/// belongs in. Entries also expire after MEMBERSHIP_CACHE_TTL_SEC as a
+/// backstop for lost pub/sub messages.
+class MembershipCache {
+public:
+    struct Membership {
+        bool        isMember = false;
+        std::string role;       // "owner" | "admin" | "member"
+        std::string chatType;   // "direct" | "group" | "channel"
+        bool        failed = false;  // lookup query failed (isMember is false)
+    };
+    using Callback = std::function<void(const Membership&)>;
+
+    static MembershipCache& instance();
+
+    /// Resolve membership, from cache or with one query. `cb` may run inline
+    /// (cache hit) or on a DB callback thread. DB errors report non-member
+    /// with `failed` set.
+    void lookup(long long chatId, long long userId, Callback cb);
+
+    /// A user joined or left a chat, or their role in it changed.
+    void invalidateMember(long long chatId, long long userId);
+    /// The chat was deleted or its type changed.
+    void invalidateChat(long long chatId);
+
+    /// Apply an invalidation received on the "membership" channel.
+    /// Format: "m <chat_id> <user_id>" or "c <chat_id>".
+    void applyInvalidation(std::string_view msg);
+
+    MembershipCache(const MembershipCache&) = delete;
+    MembershipCache& operator=(const MembershipCache&) = delete;
+
+private:
+    MembershipCache();
+
+    struct Entry {
+        std::string role;
+        std::string chatType;
+        std::chrono::steady_clock::time_point expires;
+    };
+    // Sharded by chat so a chat-wide invalidation touches one shard
+    struct Shard {
+        std::mutex mu;
+        std::unordered_map<long long, std::unordered_map<long long, Entry>> chats;
+        size_t        size  = 0;
+        std::uint64_t epoch = 0;   // bumped on invalidation; stale loads are not cached
+    };
+    static constexpr size_t kShards = 32;
+
+    Shard& shardFor(long long chatId);
+    void dropMember(long long chatId, long long userId);
+    void dropChat(long long chatId);
+    void publish(const std::string& msg);
+    void ensureSubscribed();
+
+    std::array<Shard, kShards> shards_;
+    size_t                     maxPerShard_;
+    std::chrono::seconds       ttl_;
+    std::once_flag             subscribeOnce_;
+};
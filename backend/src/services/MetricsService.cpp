@@ -28,6 +28,96 @@ void MetricsService::observeLatency(const std::string& method,
 
 void MetricsService::wsConnect()    { ++wsActive_; ++wsTotal_; }
 void MetricsService::wsDisconnect() { if (wsActive_ > 0) --wsActive_; }
+void MetricsService::setRedisChannels(long long n) { redisChannels_ = n; }
+
+void MetricsService::wsOutboundCongested(long long delta) { wsCongested_ += delta; }
+void MetricsService::wsOutboundHeld(long long delta)      { wsHeld_ += delta; }
+void MetricsService::wsOutboundCoalesced()                { ++wsCoalesced_; }
+void MetricsService::wsOutboundDropped(size_t bytes) {
+    ++wsDroppedFrames_;
+    wsDroppedBytes_ += static_cast<long long>(bytes);
+}
+void MetricsService::wsSlowConsumerEvicted()              { ++wsEvicted_; }
+
+void MetricsService::wsTypingReport(bool published) {
+    if (published) ++wsTypingPublished_; else ++wsTypingThrottled_;
+}
+void MetricsService::wsTypingSetsSent(size_t chats) {
+    wsTypingSets_ += static_cast<long long>(chats);
+}
+
+void MetricsService::presenceAnnounced(const std::string& status) {
+    if (status == "online") ++presenceOnline_; else ++presenceOffline_;
+}
+void MetricsService::presenceObserverLookup(bool hit) {
+    if (hit) ++presenceObsHit_; else ++presenceObsMiss_;
+}
+void MetricsService::presenceFramesSent(size_t n) {
+    presenceFrames_ += static_cast<long long>(n);
+}
+void MetricsService::presenceStatusLookup(size_t local, size_t redis) {
+    presenceStatusLocal_ += static_cast<long long>(local);
+    presenceStatusRedis_ += static_cast<long long>(redis);
+}
+
+void MetricsService::objectStoreRequest(bool ok) {
+    if (ok) ++objectStoreOk_; else ++objectStoreFailed_;
+}
+void MetricsService::objectStoreQueued() { ++objectStoreQueued_; }
+void MetricsService::fileUpload(bool deduplicated) {
+    if (deduplicated) ++fileUploadsDeduplicated_; else ++fileUploadsStored_;
+}
+void MetricsService::pendingUploadsExpired(size_t n) {
+    pendingUploadsExpired_ += static_cast<long long>(n);
+}
+void MetricsService::imageVariants(bool ok) {
+    if (ok) ++imageVariantsOk_; else ++imageVariantsFailed_;
+}
+void MetricsService::imageVariantsSkipped() { ++imageVariantsSkipped_; }
+
+void MetricsService::observe(HistBucket& h, double seconds) {
+    h.sum += seconds;
+    h.count++;
+    for (double b : kBuckets) {
+        if (seconds <= b) h.buckets[b]++;
+    }
+}
+
+void MetricsService::observeCrypto(const std::string& op, double waitSeconds,
+                                   double runSeconds) {
+    std::lock_guard<std::mutex> lk(mu_);
+    observe(cryptoWait_[op], waitSeconds);
+    observe(cryptoRun_[op],  runSeconds);
+}
+
+void MetricsService::cryptoRejected(const std::string& op) {
+    std::lock_guard<std::mutex> lk(mu_);
+    cryptoRejected_[op]++;
+}
+
+void MetricsService::setCryptoQueueDepth(long long n) { cryptoQueueDepth_ = n; }
+
+void MetricsService::setMessagePartitions(std::vector<PartitionStat> parts) {
+    std::lock_guard<std::mutex> lk(mu_);
+    partitions_ = std::move(parts);
+}
+
+void MetricsService::partitionMaintenanceRun(bool ok) {
+    if (ok) ++partMaintOk_; else ++partMaintFailed_;
+}
+
+void MetricsService::writeHistogram(std::ostringstream& out, const std::string& name,
+                                    const std::string& labels, const HistBucket& h) {
+    for (double b : kBuckets) {
+        long long cnt = 0;
+        auto it = h.buckets.find(b);
+        if (it != h.buckets.end()) cnt = it->second;
+        out << name << "_bucket{" << labels << ",le=\"" << b << "\"} " << cnt << "\n";
+    }
+    out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << h.count << "\n";
+    out << name << "_sum{"   << labels << "} " << h.sum   << "\n";
+    out << name << "_count{" << labels << "} " << h.count << "\n";
+}
 
 std::string MetricsService::expose() const {
     std::lock_guard<std::mutex> lk(mu_);
@@ -80,7 +170,115 @@ std::string MetricsService::expose() const {
         << "messenger_ws_connections_active " << wsActive_.load() << "\n\n"
         << "# HELP messenger_ws_connections_total Total WebSocket connections opened\n"
         << "# TYPE messenger_ws_connections_total counter\n"
-        << "messenger_ws_connections_total " << wsTotal_.load() << "\n";
+        << "messenger_ws_connections_total " << wsTotal_.load() << "\n\n"
+        << "# HELP messenger_ws_redis_channels_active Redis pub/sub channels subscribed by this process\n"
+        << "# TYPE messenger_ws_redis_channels_active gauge\n"
+        << "messenger_ws_redis_channels_active " << redisChannels_.load() << "\n\n";
+
+    // ── WebSocket backpressure ───────────────────────────────────────────────
+    out << "# HELP messenger_ws_outbound_congested_connections Connections whose output buffer is over the watermark\n"
+        << "# TYPE messenger_ws_outbound_congested_connections gauge\n"
+        << "messenger_ws_outbound_congested_connections " << wsCongested_.load() << "\n\n"
+        << "# HELP messenger_ws_outbound_held_frames Coalesced typing/presence frames queued until drain\n"
+        << "# TYPE messenger_ws_outbound_held_frames gauge\n"
+        << "messenger_ws_outbound_held_frames " << wsHeld_.load() << "\n\n"
+        << "# HELP messenger_ws_outbound_coalesced_total Frames superseded by a newer frame while congested\n"
+        << "# TYPE messenger_ws_outbound_coalesced_total counter\n"
+        << "messenger_ws_outbound_coalesced_total " << wsCoalesced_.load() << "\n\n"
+        << "# HELP messenger_ws_outbound_dropped_frames_total Frames dropped while congested\n"
+        << "# TYPE messenger_ws_outbound_dropped_frames_total counter\n"
+        << "messenger_ws_outbound_dropped_frames_total " << wsDroppedFrames_.load() << "\n\n"
+        << "# HELP messenger_ws_outbound_dropped_bytes_total Bytes dropped while congested\n"
+        << "# TYPE messenger_ws_outbound_dropped_bytes_total counter\n"
+        << "messenger_ws_outbound_dropped_bytes_total " << wsDroppedBytes_.load() << "\n\n"
+        << "# HELP messenger_ws_slow_consumer_evictions_total Connections closed for staying congested\n"
+        << "# TYPE messenger_ws_slow_consumer_evictions_total counter\n"
+        << "messenger_ws_slow_consumer_evictions_total " << wsEvicted_.load() << "\n\n";
+
+    // ── Typing indicators ────────────────────────────────────────────────────
+    out << "# HELP messenger_ws_typing_reports_total Client typing reports, published or absorbed by the throttle\n"
+        << "# TYPE messenger_ws_typing_reports_total counter\n"
+        << "messenger_ws_typing_reports_total{result=\"published\"} " << wsTypingPublished_.load() << "\n"
+        << "messenger_ws_typing_reports_total{result=\"throttled\"} " << wsTypingThrottled_.load() << "\n\n"
+        << "# HELP messenger_ws_typing_sets_total Batched per-chat typing frames fanned out to local subscribers\n"
+        << "# TYPE messenger_ws_typing_sets_total counter\n"
+        << "messenger_ws_typing_sets_total " << wsTypingSets_.load() << "\n\n";
+
+    // ── Presence ─────────────────────────────────────────────────────────────
+    out << "# HELP messenger_presence_announcements_total Cluster-wide presence transitions published\n"
+        << "# TYPE messenger_presence_announcements_total counter\n"
+        << "messenger_presence_announcements_total{status=\"online\"} " << presenceOnline_.load() << "\n"
+        << "messenger_presence_announcements_total{status=\"offline\"} " << presenceOffline_.load() << "\n\n"
+        << "# HELP messenger_presence_observer_lookups_total Observer-set lookups by cache result\n"
+        << "# TYPE messenger_presence_observer_lookups_total counter\n"
+        << "messenger_presence_observer_lookups_total{result=\"hit\"} " << presenceObsHit_.load() << "\n"
+        << "messenger_presence_observer_lookups_total{result=\"miss\"} " << presenceObsMiss_.load() << "\n\n"
+        << "# HELP messenger_presence_frames_total Batched presence frames sent to local users\n"
+        << "# TYPE messenger_presence_frames_total counter\n"
+        << "messenger_presence_frames_total " << presenceFrames_.load() << "\n\n"
+        << "# HELP messenger_presence_status_lookups_total Online-status answers by source (local/cache vs Redis)\n"
+        << "# TYPE messenger_presence_status_lookups_total counter\n"
+        << "messenger_presence_status_lookups_total{source=\"local\"} " << presenceStatusLocal_.load() << "\n"
+        << "messenger_presence_status_lookups_total{source=\"redis\"} " << presenceStatusRedis_.load() << "\n\n";
+
+    // ── Object storage ───────────────────────────────────────────────────────
+    out << "# HELP messenger_object_store_requests_total MinIO requests by outcome\n"
+        << "# TYPE messenger_object_store_requests_total counter\n"
+        << "messenger_object_store_requests_total{result=\"ok\"} " << objectStoreOk_.load() << "\n"
+        << "messenger_object_store_requests_total{result=\"failed\"} " << objectStoreFailed_.load() << "\n\n"
+        << "# HELP messenger_object_store_queued_total MinIO requests that waited for an in-flight slot\n"
+        << "# TYPE messenger_object_store_queued_total counter\n"
+        << "messenger_object_store_queued_total " << objectStoreQueued_.load() << "\n\n"
+        << "# HELP messenger_file_uploads_total Uploads by outcome: new content stored or matched existing content\n"
+        << "# TYPE messenger_file_uploads_total counter\n"
+        << "messenger_file_uploads_total{result=\"stored\"} " << fileUploadsStored_.load() << "\n"
+        << "messenger_file_uploads_total{result=\"deduplicated\"} " << fileUploadsDeduplicated_.load() << "\n\n"
+        << "# HELP messenger_pending_uploads_expired_total Direct uploads never completed, removed by the sweep\n"
+        << "# TYPE messenger_pending_uploads_expired_total counter\n"
+        << "messenger_pending_uploads_expired_total " << pendingUploadsExpired_.load() << "\n\n"
+        << "# HELP messenger_image_variant_jobs_total Images by variant outcome: stored, failed, or skipped (queue full)\n"
+        << "# TYPE messenger_image_variant_jobs_total counter\n"
+        << "messenger_image_variant_jobs_total{result=\"ok\"} " << imageVariantsOk_.load() << "\n"
+        << "messenger_image_variant_jobs_total{result=\"failed\"} " << imageVariantsFailed_.load() << "\n"
+        << "messenger_image_variant_jobs_total{result=\"skipped\"} " << imageVariantsSkipped_.load() << "\n\n";
+
+    // ── Crypto worker pool ───────────────────────────────────────────────────
+    out << "# HELP messenger_crypto_queue_wait_seconds Time crypto jobs wait for a worker\n"
+        << "# TYPE messenger_crypto_queue_wait_seconds histogram\n";
+    for (auto& [op, h] : cryptoWait_)
+        writeHistogram(out, "messenger_crypto_queue_wait_seconds", "op=\"" + op + "\"", h);
+    out << "\n# HELP messenger_crypto_duration_seconds Crypto job run time\n"
+        << "# TYPE messenger_crypto_duration_seconds histogram\n";
+    for (auto& [op, h] : cryptoRun_)
+        writeHistogram(out, "messenger_crypto_duration_seconds", "op=\"" + op + "\"", h);
+    out << "\n# HELP messenger_crypto_rejected_total Crypto jobs refused because the queue was full\n"
+        << "# TYPE messenger_crypto_rejected_total counter\n";
+    for (auto& [op, n] : cryptoRejected_)
+        out << "messenger_crypto_rejected_total{op=\"" << op << "\"} " << n << "\n";
+    out << "\n# HELP messenger_crypto_queue_depth Crypto jobs waiting for a worker\n"
+        << "# TYPE messenger_crypto_queue_depth gauge\n"
+        << "messenger_crypto_queue_depth " << cryptoQueueDepth_.load() << "\n";
+
+    // ── messages partitions ──────────────────────────────────────────────────
+    out << "\n# HELP messenger_messages_partitions Attached partitions of the messages table\n"
+        << "# TYPE messenger_messages_partitions gauge\n"
+        << "messenger_messages_partitions " << partitions_.size() << "\n"
+        << "\n# HELP messenger_messages_partition_bytes Total size of a messages partition\n"
+        << "# TYPE messenger_messages_partition_bytes gauge\n";
+    for (auto& p : partitions_)
+        out << "messenger_messages_partition_bytes{partition=\"" << p.name << "\"} " << p.totalBytes << "\n";
+    out << "\n# HELP messenger_messages_partition_index_bytes Index size of a messages partition\n"
+        << "# TYPE messenger_messages_partition_index_bytes gauge\n";
+    for (auto& p : partitions_)
+        out << "messenger_messages_partition_index_bytes{partition=\"" << p.name << "\"} " << p.indexBytes << "\n";
+    out << "\n# HELP messenger_messages_partition_rows Estimated rows in a messages partition\n"
+        << "# TYPE messenger_messages_partition_rows gauge\n";
+    for (auto& p : partitions_)
+        out << "messenger_messages_partition_rows{partition=\"" << p.name << "\"} " << p.estRows << "\n";
+    out << "\n# HELP messenger_partition_maintenance_runs_total Partition maintenance runs led by this process\n"
+        << "# TYPE messenger_partition_maintenance_runs_total counter\n"
+        << "messenger_partition_maintenance_runs_total{result=\"ok\"} " << partMaintOk_.load() << "\n"
+        << "messenger_partition_maintenance_runs_total{result=\"error\"} " << partMaintFailed_.load() << "\n";
 
     return out.str();
 }
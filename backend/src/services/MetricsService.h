@@ -4,6 +4,8 @@
 #include <map>
 #include <mutex>
 #include <chrono>
+#include <sstream>
+#include <vector>
 
 /// Thread-safe Prometheus text-format metrics registry.
 /// Exposes a single /metrics endpoint without external library deps.
@@ -22,6 +24,51 @@ public:
     void wsConnect();
     void wsDisconnect();
 
+    // Gauge: Redis pub/sub channels this process is subscribed to
+    void setRedisChannels(long long n);
+
+    // WebSocket outbound backpressure
+    void wsOutboundCongested(long long delta);  // gauge: connections over the byte watermark
+    void wsOutboundHeld(long long delta);       // gauge: coalesced frames awaiting drain
+    void wsOutboundCoalesced();                 // counter: frames superseded while congested
+    void wsOutboundDropped(size_t bytes);       // counter: frames/bytes dropped while congested
+    void wsSlowConsumerEvicted();               // counter: connections closed for staying slow
+
+    // Typing indicators (TypingTracker)
+    void wsTypingReport(bool published);        // counter: client reports, published vs throttled
+    void wsTypingSetsSent(size_t chats);        // counter: batched per-chat typing frames fanned out
+
+    // Presence (PresenceService)
+    void presenceAnnounced(const std::string& status);  // counter: cluster-wide transitions published
+    void presenceObserverLookup(bool hit);              // counter: observer-set cache hits/misses
+    void presenceFramesSent(size_t n);                  // counter: batched frames queued to local users
+    void presenceStatusLookup(size_t local, size_t redis);  // counter: online-status answers by source
+
+    // Object storage (ObjectStore)
+    void objectStoreRequest(bool ok);   // counter: MinIO requests by outcome
+    void objectStoreQueued();           // counter: requests that waited for an in-flight slot
+    void fileUpload(bool deduplicated); // counter: uploads stored vs resolved to existing content
+    void pendingUploadsExpired(size_t n);  // counter: direct uploads reaped uncompleted (UploadSweeper)
+
+    // Image variants (ImagePipeline)
+    void imageVariants(bool ok);        // counter: images whose variants were stored vs failed
+    void imageVariantsSkipped();        // counter: images left without variants, queue full
+
+    // Crypto worker pool (CryptoPool): per-op queue-wait and run-time histograms
+    void observeCrypto(const std::string& op, double waitSeconds, double runSeconds);
+    void cryptoRejected(const std::string& op);
+    void setCryptoQueueDepth(long long n);
+
+    // messages table partitions (PartitionManager): replaced wholesale on each refresh
+    struct PartitionStat {
+        std::string name;
+        long long   totalBytes = 0;   // heap + indexes + toast
+        long long   indexBytes = 0;
+        long long   estRows    = 0;   // pg_class.reltuples
+    };
+    void setMessagePartitions(std::vector<PartitionStat> parts);
+    void partitionMaintenanceRun(bool ok);
+
     // Render Prometheus text format
     std::string expose() const;
 
@@ -47,6 +94,45 @@ private:
     };
     std::map<std::string, HistBucket> latHist_;  // key = method+path
 
+    static void observe(HistBucket& h, double seconds);
+    static void writeHistogram(std::ostringstream& out, const std::string& name,
+                               const std::string& labels, const HistBucket& h);
+
+    std::map<std::string, HistBucket> cryptoWait_;     // key = op
+    std::map<std::string, HistBucket> cryptoRun_;      // key = op
+    std::map<std::string, long long>  cryptoRejected_; // key = op
+    std::atomic<long long> cryptoQueueDepth_{0};
+
+    std::vector<PartitionStat> partitions_;
+    std::atomic<long long> partMaintOk_{0};
+    std::atomic<long long> partMaintFailed_{0};
+
     std::atomic<long long> wsActive_{0};
     std::atomic<long long> wsTotal_{0};
+    std::atomic<long long> redisChannels_{0};
+    std::atomic<long long> wsCongested_{0};
+    std::atomic<long long> wsHeld_{0};
+    std::atomic<long long> wsCoalesced_{0};
+    std::atomic<long long> wsDroppedFrames_{0};
+    std::atomic<long long> wsDroppedBytes_{0};
+    std::atomic<long long> wsEvicted_{0};
+    std::atomic<long long> wsTypingPublished_{0};
+    std::atomic<long long> wsTypingThrottled_{0};
+    std::atomic<long long> wsTypingSets_{0};
+    std::atomic<long long> presenceOnline_{0};
+    std::atomic<long long> presenceOffline_{0};
+    std::atomic<long long> presenceObsHit_{0};
+    std::atomic<long long> presenceObsMiss_{0};
+    std::atomic<long long> presenceFrames_{0};
+    std::atomic<long long> presenceStatusLocal_{0};
+    std::atomic<long long> presenceStatusRedis_{0};
+    std::atomic<long long> objectStoreOk_{0};
+    std::atomic<long long> objectStoreFailed_{0};
+    std::atomic<long long> objectStoreQueued_{0};
+    std::atomic<long long> fileUploadsStored_{0};
+    std::atomic<long long> fileUploadsDeduplicated_{0};
+    std::atomic<long long> pendingUploadsExpired_{0};
+    std::atomic<long long> imageVariantsOk_{0};
+    std::atomic<long long> imageVariantsFailed_{0};
+    std::atomic<long long> imageVariantsSkipped_{0};
 };
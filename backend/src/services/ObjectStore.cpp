@@ -0,0 +1,385 @@
+#include "ObjectStore.h"
+#include "CryptoPool.h"
+#include "MetricsService.h"
+#include "../config/Config.h"
+#include "../utils/MinioPresign.h"
+#include <drogon/HttpAppFramework.h>
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+using minio_presign::sha256Hex;
+using minio_presign::uriEncode;
+
+namespace {
+
+// S3 refuses parts under 5 MiB (except the last) and uploads over 10000 parts
+constexpr size_t kMinPartSize = 5 * 1024 * 1024;
+constexpr size_t kMaxParts    = 10000;
+
+std::string objectUri(const std::string& bucket, const std::string& key) {
+    return "/" + uriEncode(bucket + "/" + key, /*encodeSlash=*/false);
+}
+
+// `uri` from objectUri(); `query` canonical (see minio_presign::signRequest).
+drogon::HttpRequestPtr signedRequest(drogon::HttpMethod method, const std::string& uri,
+                                     const std::string& query, std::string body,
+                                     const std::string& contentType = "",
+                                     const std::string& payloadSha = "") {
+    const auto& cfg = Config::get();
+    auto req = drogon::HttpRequest::newHttpRequest();
+    req->setMethod(method);
+    req->setPathEncode(false);  // uri and query are sent exactly as signed
+    req->setPath(query.empty() ? uri : uri + "?" + query);
+
+    auto sig = minio_presign::signRequest(
+        req->methodString(), cfg.minioEndpoint, uri, query, contentType,
+        payloadSha.empty() ? sha256Hex(body) : payloadSha,
+        cfg.minioAccessKey, cfg.minioSecretKey);
+
+    if (!contentType.empty()) req->setContentTypeString(contentType);
+    req->setBody(std::move(body));
+    req->addHeader("x-amz-date",           sig.amzDate);
+    req->addHeader("x-amz-content-sha256", sig.contentSha);
+    req->addHeader("Authorization",        sig.authorization);
+    return req;
+}
+
+bool failed(drogon::ReqResult result, const drogon::HttpResponsePtr& resp) {
+    return result != drogon::ReqResult::Ok || !resp || resp->statusCode() >= 300;
+}
+
+std::string describe(const drogon::HttpResponsePtr& resp) {
+    return resp ? std::to_string(resp->statusCode()) : "no response";
+}
+
+// Text of the first <tag>…</tag> in `xml`, or "".
+std::string xmlText(std::string_view xml, const std::string& tag) {
+    auto open = xml.find("<" + tag + ">");
+    if (open == std::string_view::npos) return {};
+    open += tag.size() + 2;
+    auto close = xml.find("</" + tag + ">", open);
+    if (close == std::string_view::npos) return {};
+    return std::string(xml.substr(open, close - open));
+}
+
+void createMultipart(const std::string& uri, const std::string& contentType,
+                     std::function<void(std::string)> cb) {
+    // The object's content type is fixed when the multipart upload is created
+    auto req = signedRequest(drogon::Post, uri, "uploads=", {}, contentType);
+    ObjectStore::instance().send(req, [cb = std::move(cb)](drogon::ReqResult result,
+                                                           const drogon::HttpResponsePtr& resp) {
+        std::string uploadId = resp ? xmlText(resp->body(), "UploadId") : std::string();
+        if (failed(result, resp) || uploadId.empty()) {
+            LOG_ERROR << "MinIO CreateMultipartUpload failed: " << describe(resp);
+            uploadId.clear();
+        }
+        cb(std::move(uploadId));
+    });
+}
+
+// Best effort: MinIO also reaps stale multipart uploads on its own.
+void abortMultipart(const std::string& uri, const std::string& uploadId) {
+    auto req = signedRequest(drogon::Delete, uri, "uploadId=" + uriEncode(uploadId), {});
+    ObjectStore::instance().send(req, [](drogon::ReqResult result,
+                                         const drogon::HttpResponsePtr& resp) {
+        if (failed(result, resp))
+            LOG_WARN << "MinIO AbortMultipartUpload failed: " << describe(resp);
+    });
+}
+
+void completeMultipart(const std::string& uri, const std::string& uploadId,
+                       const std::vector<std::string>& etags, bool abortOnFailure,
+                       ObjectStore::Done done) {
+    std::string xml = "<CompleteMultipartUpload>";
+    for (size_t i = 0; i < etags.size(); ++i) {
+        xml += "<Part><PartNumber>" + std::to_string(i + 1) + "</PartNumber><ETag>" +
+               etags[i] + "</ETag></Part>";
+    }
+    xml += "</CompleteMultipartUpload>";
+
+    auto req = signedRequest(drogon::Post, uri, "uploadId=" + uriEncode(uploadId), std::move(xml));
+    ObjectStore::instance().send(req, [uri, uploadId, abortOnFailure, done = std::move(done)](
+            drogon::ReqResult result, const drogon::HttpResponsePtr& resp) {
+        // S3 may report a failed completion inside a 200 response
+        if (failed(result, resp) || resp->body().find("<Error>") != std::string_view::npos) {
+            LOG_ERROR << "MinIO CompleteMultipartUpload failed: " << describe(resp);
+            if (abortOnFailure) abortMultipart(uri, uploadId);
+            return done(false);
+        }
+        done(true);
+    });
+}
+
+// State carried from one part of a server-side multipart upload to the next.
+struct Upload {
+    std::string              uri;
+    const char*              data = nullptr;
+    size_t                   size = 0;
+    size_t                   partSize = 0;
+    std::string              uploadId;
+    std::vector<std::string> etags;        // one per finished part
+    ObjectStore::Done        done;
+};
+using UploadPtr = std::shared_ptr<Upload>;
+
+void sendPart(const UploadPtr& u, size_t index);
+
+// Copy, hash and send part `index`. Runs on a crypto worker: a part is up to
+// MINIO_PART_SIZE_MB, too much to copy and hash on the IO loop that called back.
+void uploadPart(const UploadPtr& u, size_t index) {
+    size_t offset = index * u->partSize;
+    size_t len    = std::min(u->partSize, u->size - offset);
+    std::string query = "partNumber=" + std::to_string(index + 1) +
+                        "&uploadId=" + uriEncode(u->uploadId);
+    auto req = signedRequest(drogon::Put, u->uri, query, std::string(u->data + offset, len));
+    ObjectStore::instance().send(req, [u, index](drogon::ReqResult result,
+                                                 const drogon::HttpResponsePtr& resp) {
+        std::string etag = resp ? resp->getHeader("etag") : std::string();
+        if (failed(result, resp) || etag.empty()) {
+            LOG_ERROR << "MinIO UploadPart " << index + 1 << " failed: " << describe(resp);
+            abortMultipart(u->uri, u->uploadId);
+            return u->done(false);
+        }
+        u->etags.push_back(std::move(etag));
+        sendPart(u, index + 1);
+    });
+}
+
+void sendPart(const UploadPtr& u, size_t index) {
+    if (index * u->partSize >= u->size)
+        return completeMultipart(u->uri, u->uploadId, u->etags, true, u->done);
+    // With the pool saturated, a stalled loop beats a failed upload
+    if (!CryptoPool::instance().submit("upload_part", [u, index] { uploadPart(u, index); }))
+        uploadPart(u, index);
+}
+
+} // namespace
+
+ObjectStore& ObjectStore::instance() {
+    static ObjectStore inst;
+    return inst;
+}
+
+ObjectStore::ObjectStore() {
+    const auto& cfg = Config::get();
+    partSize_    = std::max(kMinPartSize,
+                            static_cast<size_t>(std::max(0, cfg.minioPartSizeMb)) * 1024 * 1024);
+    maxInFlight_ = static_cast<size_t>(std::max(1, cfg.minioMaxInflightPerLoop));
+    timeoutSec_  = std::max(0, cfg.minioRequestTimeoutSec);
+}
+
+size_t ObjectStore::partSizeFor(size_t objectSize) const {
+    return std::max(partSize_, (objectSize + kMaxParts - 1) / kMaxParts);
+}
+
+void ObjectStore::start() {
+    const auto& cfg = Config::get();
+    const std::string url = "http://" + cfg.minioEndpoint;
+    const size_t perLoop  = static_cast<size_t>(std::max(1, cfg.minioClientsPerLoop));
+    const size_t nLoops   = drogon::app().getThreadNum();
+
+    for (size_t i = 0; i < nLoops; ++i) {
+        auto pool  = std::make_unique<LoopPool>();
+        pool->loop = drogon::app().getIOLoop(i);
+        for (size_t c = 0; c < perLoop; ++c) {
+            Client client;
+            client.http = drogon::HttpClient::newHttpClient(url, pool->loop);
+            client.http->setPipeliningDepth(static_cast<size_t>(std::max(0, cfg.minioPipelining)));
+            pool->clients.push_back(std::move(client));
+        }
+        byLoop_[pool->loop] = pool.get();
+        pools_.push_back(std::move(pool));
+    }
+    started_.store(true, std::memory_order_release);
+
+    if (cfg.minioHealthIntervalSec > 0) {
+        for (auto& pool : pools_) {
+            LoopPool* p = pool.get();
+            p->loop->runEvery(static_cast<double>(cfg.minioHealthIntervalSec),
+                              [this, p] { probe(*p); });
+        }
+    }
+    LOG_INFO << "Object store: " << perLoop << " MinIO client(s) on each of "
+             << nLoops << " IO loop(s), " << maxInFlight_ << " in flight per loop";
+}
+
+void ObjectStore::send(const drogon::HttpRequestPtr& req, drogon::HttpReqCallback cb) {
+    if (!started_.load(std::memory_order_acquire) || pools_.empty()) {
+        // Before start(): a one-off client, which the pending request keeps alive
+        auto client = drogon::HttpClient::newHttpClient("http://" + Config::get().minioEndpoint);
+        client->sendRequest(req, [client, cb = std::move(cb)](
+                drogon::ReqResult result, const drogon::HttpResponsePtr& resp) {
+            MetricsService::instance().objectStoreRequest(!failed(result, resp));
+            cb(result, resp);
+        }, timeoutSec_);
+        return;
+    }
+
+    LoopPool* pool;
+    auto it = byLoop_.find(trantor::EventLoop::getEventLoopOfCurrentThread());
+    if (it != byLoop_.end()) {
+        pool = it->second;
+    } else {
+        pool = pools_[nextPool_.fetch_add(1, std::memory_order_relaxed) % pools_.size()].get();
+    }
+    if (pool->loop->isInLoopThread()) {
+        dispatch(*pool, req, std::move(cb));
+    } else {
+        pool->loop->queueInLoop([this, pool, req, cb = std::move(cb)]() mutable {
+            dispatch(*pool, std::move(req), std::move(cb));
+        });
+    }
+}
+
+void ObjectStore::dispatch(LoopPool& pool, drogon::HttpRequestPtr req, drogon::HttpReqCallback cb) {
+    if (pool.inFlight >= maxInFlight_) {
+        MetricsService::instance().objectStoreQueued();
+        pool.waiting.push_back({std::move(req), std::move(cb)});
+        return;
+    }
+
+    // Least loaded healthy client; if none is healthy, least loaded overall
+    size_t best = 0;
+    for (size_t i = 1; i < pool.clients.size(); ++i) {
+        const auto& a = pool.clients[i];
+        const auto& b = pool.clients[best];
+        if (a.healthy != b.healthy ? a.healthy : a.inFlight < b.inFlight) best = i;
+    }
+
+    ++pool.inFlight;
+    ++pool.clients[best].inFlight;
+    pool.clients[best].http->sendRequest(req,
+        [this, &pool, best, cb = std::move(cb)](drogon::ReqResult result,
+                                                const drogon::HttpResponsePtr& resp) {
+            --pool.inFlight;
+            --pool.clients[best].inFlight;
+            // Only transport failures say anything about the connection
+            if (result != drogon::ReqResult::Ok) pool.clients[best].healthy = false;
+            MetricsService::instance().objectStoreRequest(!failed(result, resp));
+
+            cb(result, resp);
+
+            while (!pool.waiting.empty() && pool.inFlight < maxInFlight_) {
+                auto next = std::move(pool.waiting.front());
+                pool.waiting.pop_front();
+                dispatch(pool, std::move(next.req), std::move(next.cb));
+            }
+        }, timeoutSec_);
+}
+
+void ObjectStore::probe(LoopPool& pool) {
+    for (size_t i = 0; i < pool.clients.size(); ++i) {
+        // Busy clients are evidently connected; probing them would only queue
+        if (pool.clients[i].inFlight > 0) continue;
+        auto req = drogon::HttpRequest::newHttpRequest();
+        req->setMethod(drogon::Get);
+        req->setPath("/minio/health/live");
+        pool.clients[i].http->sendRequest(req,
+            [&pool, i](drogon::ReqResult result, const drogon::HttpResponsePtr& resp) {
+                bool ok = !failed(result, resp);
+                if (ok != pool.clients[i].healthy)
+                    LOG_WARN << "MinIO client " << i << " is now " << (ok ? "healthy" : "unhealthy");
+                pool.clients[i].healthy = ok;
+            }, timeoutSec_);
+    }
+}
+
+void ObjectStore::put(const std::string& bucket, const std::string& key,
+                      const std::string& contentType,
+                      const char* data, size_t size,
+                      const std::string& payloadSha, Done done) {
+    std::string uri = objectUri(bucket, key);
+    size_t partSize = partSizeFor(size);
+
+    if (size <= partSize) {
+        auto req = signedRequest(drogon::Put, uri, {}, std::string(data, size),
+                                 contentType, payloadSha);
+        send(req, [done = std::move(done)](drogon::ReqResult result,
+                                           const drogon::HttpResponsePtr& resp) {
+            if (failed(result, resp)) {
+                LOG_ERROR << "MinIO PUT failed: " << describe(resp);
+                return done(false);
+            }
+            done(true);
+        });
+        return;
+    }
+
+    auto u = std::make_shared<Upload>();
+    u->uri      = uri;
+    u->data     = data;
+    u->size     = size;
+    u->partSize = partSize;
+    u->done     = std::move(done);
+    createMultipart(uri, contentType, [u](std::string uploadId) {
+        if (uploadId.empty()) return u->done(false);
+        u->uploadId = std::move(uploadId);
+        u->etags.reserve((u->size + u->partSize - 1) / u->partSize);
+        sendPart(u, 0);
+    });
+}
+
+void ObjectStore::head(const std::string& bucket, const std::string& key,
+                       std::function<void(bool ok, const ObjectInfo& info)> cb) {
+    auto req = signedRequest(drogon::Head, objectUri(bucket, key), {}, {});
+    send(req, [cb = std::move(cb)](drogon::ReqResult result,
+                                   const drogon::HttpResponsePtr& resp) {
+        ObjectInfo info;
+        if (result == drogon::ReqResult::Ok && resp && resp->statusCode() == drogon::k404NotFound)
+            return cb(true, info);
+        if (failed(result, resp)) {
+            LOG_ERROR << "MinIO HEAD failed: " << describe(resp);
+            return cb(false, info);
+        }
+        info.found       = true;
+        info.size        = std::atoll(resp->getHeader("content-length").c_str());
+        info.contentType = resp->getHeader("content-type");
+        cb(true, info);
+    });
+}
+
+void ObjectStore::get(const std::string& bucket, const std::string& key,
+                      std::function<void(const drogon::HttpResponsePtr& obj)> cb) {
+    auto req = signedRequest(drogon::Get, objectUri(bucket, key), {}, {});
+    send(req, [cb = std::move(cb)](drogon::ReqResult result,
+                                   const drogon::HttpResponsePtr& resp) {
+        if (failed(result, resp)) {
+            LOG_ERROR << "MinIO GET failed: " << describe(resp);
+            return cb(nullptr);
+        }
+        cb(resp);
+    });
+}
+
+void ObjectStore::remove(const std::string& bucket, const std::string& key, Done done) {
+    auto req = signedRequest(drogon::Delete, objectUri(bucket, key), {}, {});
+    send(req, [done = std::move(done)](drogon::ReqResult result,
+                                       const drogon::HttpResponsePtr& resp) {
+        if (failed(result, resp)) {
+            LOG_ERROR << "MinIO DELETE failed: " << describe(resp);
+            return done(false);
+        }
+        done(true);
+    });
+}
+
+void ObjectStore::createMultipartUpload(const std::string& bucket, const std::string& key,
+                                        const std::string& contentType,
+                                        std::function<void(std::string uploadId)> cb) {
+    createMultipart(objectUri(bucket, key), contentType, std::move(cb));
+}
+
+void ObjectStore::completeMultipartUpload(const std::string& bucket, const std::string& key,
+                                          const std::string& uploadId,
+                                          const std::vector<std::string>& etags, Done done) {
+    completeMultipart(objectUri(bucket, key), uploadId, etags, false, std::move(done));
+}
+
+void ObjectStore::abortMultipartUpload(const std::string& bucket, const std::string& key,
+                                       const std::string& uploadId) {
+    abortMultipart(objectUri(bucket, key), uploadId);
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <drogon/HttpClient.h>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// Writes to MinIO (S3 API, SigV4-signed) on behalf of the API.
+///
+/// Objects up to MINIO_PART_SIZE_MB go up in a single PUT. Larger ones become a
+/// multipart upload whose parts are copied out of the caller's buffer,
+/// hashed and signed on the CryptoPool (off the IO loops) and sent one at a
+/// time, so an upload holds at most one part in memory however large the file.
+/// Uploaded request bodies are spooled to disk and mapped by Drogon, which
+/// makes `data` cheap even for big files.
+///
+/// Every request goes through a per-IO-loop pool of MINIO_CLIENTS_PER_LOOP
+/// keep-alive clients, so uploads reuse warm connections instead of paying a
+/// TCP handshake (and leaving a TIME_WAIT socket) each. A loop keeps at most
+/// MINIO_MAX_INFLIGHT_PER_LOOP requests outstanding and queues the rest. A
+/// client whose request failed at the network level is avoided until a
+/// health probe (GET /minio/health/live every MINIO_HEALTH_INTERVAL_SEC, which
+/// also keeps idle connections open) succeeds on it again.
+class ObjectStore {
+public:
+    static ObjectStore& instance();
+
+    /// Build the per-loop pools and start health probes. Call once the app is
+    /// running; until then requests use a one-off client.
+    void start();
+
+    using Done = std::function<void(bool ok)>;
+
+    /// Store `size` bytes at `data` as `bucket`/`key`. `data` must stay valid
+    /// until `done` runs; capture its owner in `done`. `done` runs on a Drogon
+    /// IO loop. `payloadSha` is the hex SHA-256 of the data if the caller has
+    /// it already, which spares a single PUT hashing it again; else "".
+    void put(const std::string& bucket, const std::string& key,
+             const std::string& contentType,
+             const char* data, size_t size,
+             const std::string& payloadSha, Done done);
+
+    struct ObjectInfo {
+        bool        found = false;
+        long long   size  = 0;
+        std::string contentType;
+    };
+    /// Look up `bucket`/`key`. `ok` is false only when MinIO could not answer;
+    /// a missing object is ok with `info.found` false.
+    void head(const std::string& bucket, const std::string& key,
+              std::function<void(bool ok, const ObjectInfo& info)> cb);
+
+    /// Fetch `bucket`/`key` whole. `cb` gets the response, whose body is the
+    /// object, or nullptr when it is missing or MinIO could not answer.
+    void get(const std::string& bucket, const std::string& key,
+             std::function<void(const drogon::HttpResponsePtr& obj)> cb);
+
+    void remove(const std::string& bucket, const std::string& key, Done done);
+
+    /// Multipart upload whose parts the client sends itself, through presigned
+    /// part URLs. `cb` gets the upload id, or "" on failure. Completing takes
+    /// the parts' ETags in part-number order; a failed completion leaves the
+    /// upload open so the client can retry.
+    void createMultipartUpload(const std::string& bucket, const std::string& key,
+                               const std::string& contentType,
+                               std::function<void(std::string uploadId)> cb);
+    void completeMultipartUpload(const std::string& bucket, const std::string& key,
+                                 const std::string& uploadId,
+                                 const std::vector<std::string>& etags, Done done);
+    /// Abandon an open multipart upload and free its parts. Best effort:
+    /// failures are only logged.
+    void abortMultipartUpload(const std::string& bucket, const std::string& key,
+                              const std::string& uploadId);
+
+    /// Send a request already signed for MinIO through the calling loop's pool
+    /// (any loop's when called off the IO threads).
+    void send(const drogon::HttpRequestPtr& req, drogon::HttpReqCallback cb);
+
+    /// Part size for an object of `objectSize` bytes: MINIO_PART_SIZE_MB, grown
+    /// to stay within S3's 10000 parts. Objects no larger go up in one PUT.
+    size_t partSizeFor(size_t objectSize) const;
+
+    ObjectStore(const ObjectStore&) = delete;
+    ObjectStore& operator=(const ObjectStore&) = delete;
+
+private:
+    ObjectStore();
+
+    struct Client {
+        drogon::HttpClientPtr http;
+        size_t                inFlight = 0;
+        bool                  healthy  = true;
+    };
+    struct Pending {
+        drogon::HttpRequestPtr  req;
+        drogon::HttpReqCallback cb;
+    };
+    // Touched only on `loop`.
+    struct LoopPool {
+        trantor::EventLoop* loop = nullptr;
+        std::vector<Client> clients;
+        size_t              inFlight = 0;
+        std::deque<Pending> waiting;
+    };
+
+    void dispatch(LoopPool& pool, drogon::HttpRequestPtr req, drogon::HttpReqCallback cb);
+    void probe(LoopPool& pool);
+
+    size_t partSize_;
+    size_t maxInFlight_;
+    double timeoutSec_;
+
+    // Filled once by start(), before started_ is set; read-only afterwards.
+    std::vector<std::unique_ptr<LoopPool>>                 pools_;
+    std::unordered_map<trantor::EventLoop*, LoopPool*>     byLoop_;
+    std::atomic<bool>                                      started_{false};
+    std::atomic<size_t>                                    nextPool_{0};  // off-loop callers
+};
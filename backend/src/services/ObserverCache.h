@@ -0,0 +1,117 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/// Presence observer sets: user → everyone who shares a chat with them.
+///
+/// Each entry also records the user's chats, indexed chat → cached users, so
+/// a membership change in a chat drops exactly the sets it can affect: the
+/// joining/leaving user's own and those of everyone already in the chat.
+/// Loads record epoch() before querying and put() discards them if any
+/// invalidation happened in between. Entries expire after `ttl`; when full,
+/// the cache starts over rather than tracking recency (as MembershipCache).
+class ObserverCache {
+public:
+    using Clock     = std::chrono::steady_clock;
+    using Observers = std::shared_ptr<const std::vector<long long>>;
+
+    ObserverCache(size_t maxUsers, Clock::duration ttl)
+        : maxUsers_(maxUsers), ttl_(ttl) {}
+
+    // Cached observers of `userId`, or nullptr on a miss.
+    Observers get(long long userId, Clock::time_point now) {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = users_.find(userId);
+        if (it == users_.end()) return nullptr;
+        if (it->second.expires <= now) {
+            eraseUser(it);
+            return nullptr;
+        }
+        return it->second.observers;
+    }
+
+    std::uint64_t epoch() const {
+        std::lock_guard<std::mutex> lk(mu_);
+        return epoch_;
+    }
+
+    // Cache a load started at `epoch`. Returns false if it was discarded.
+    bool put(long long userId, std::vector<long long> chats, Observers observers,
+             std::uint64_t epoch, Clock::time_point now) {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (epoch != epoch_ || maxUsers_ == 0) return false;
+        auto it = users_.find(userId);
+        if (it != users_.end()) {
+            eraseUser(it);
+        } else if (users_.size() >= maxUsers_) {
+            users_.clear();
+            byChat_.clear();
+        }
+        for (long long c : chats) byChat_[c].insert(userId);
+        users_.emplace(userId, Entry{std::move(observers), std::move(chats), now + ttl_});
+        return true;
+    }
+
+    // `userId` joined or left `chatId`.
+    void dropMember(long long chatId, long long userId) {
+        std::lock_guard<std::mutex> lk(mu_);
+        ++epoch_;
+        auto it = users_.find(userId);
+        if (it != users_.end()) eraseUser(it);
+        dropChatLocked(chatId);
+    }
+
+    // `chatId` was deleted.
+    void dropChat(long long chatId) {
+        std::lock_guard<std::mutex> lk(mu_);
+        ++epoch_;
+        dropChatLocked(chatId);
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lk(mu_);
+        return users_.size();
+    }
+
+private:
+    struct Entry {
+        Observers              observers;
+        std::vector<long long> chats;
+        Clock::time_point      expires;
+    };
+    using UserMap = std::unordered_map<long long, Entry>;
+
+    void eraseUser(UserMap::iterator it) {
+        for (long long c : it->second.chats) {
+            auto bit = byChat_.find(c);
+            if (bit == byChat_.end()) continue;
+            bit->second.erase(it->first);
+            if (bit->second.empty()) byChat_.erase(bit);
+        }
+        users_.erase(it);
+    }
+
+    void dropChatLocked(long long chatId) {
+        auto bit = byChat_.find(chatId);
+        if (bit == byChat_.end()) return;
+        auto members = std::move(bit->second);
+        byChat_.erase(bit);
+        for (long long u : members) {
+            auto it = users_.find(u);
+            if (it != users_.end()) eraseUser(it);
+        }
+    }
+
+    const size_t          maxUsers_;
+    const Clock::duration ttl_;
+
+    mutable std::mutex                                            mu_;
+    UserMap                                                       users_;
+    std::unordered_map<long long, std::unordered_set<long long>> byChat_;
+    std::uint64_t                                                 epoch_ = 0;
+};
@@ -0,0 +1,118 @@
+#include "PartitionManager.h"
+#include "MetricsService.h"
+#include "../config/Config.h"
+#include <drogon/drogon.h>
+#include <drogon/nosql/RedisClient.h>
+#include <trantor/utils/Logger.h>
+#include <unistd.h>
+#include <algorithm>
+
+static const char* const kLockKey = "partition_maint:lock";
+
+PartitionManager& PartitionManager::instance() {
+    static PartitionManager inst;
+    return inst;
+}
+
+PartitionManager::PartitionManager() {
+    char host[256] = {0};
+    gethostname(host, sizeof(host) - 1);
+    lockToken_ = std::string(host) + ":" + std::to_string(getpid());
+}
+
+void PartitionManager::start() {
+    const int interval = Config::get().partitionMaintIntervalSec;
+    if (interval <= 0) {
+        LOG_INFO << "Partition maintenance disabled (PARTITION_MAINT_INTERVAL_SEC=0)";
+        return;
+    }
+    auto loop = drogon::app().getLoop();
+    // First run shortly after startup, then on the interval
+    loop->runAfter(10.0, [this] { tick(); });
+    loop->runEvery(static_cast<double>(interval), [this] { tick(); });
+}
+
+// Stats are refreshed once per tick: by maintain() when this node runs it, so
+// they include any partitions it created or retired, else here.
+void PartitionManager::tick() {
+    auto redis = drogon::app().getRedisClient();
+    if (!redis) return maintain();
+
+    // Held for one interval and never released early, so the whole cluster
+    // runs maintenance at most once per interval.
+    const int ttl = std::max(60, Config::get().partitionMaintIntervalSec);
+    redis->execCommandAsync(
+        [this](const drogon::nosql::RedisResult& r) {
+            if (r.isNil()) return refreshStats();   // another node holds the lock
+            maintain();
+        },
+        [this](const std::exception& e) {
+            LOG_WARN << "partition maintenance lock: " << e.what() << " (running locally)";
+            maintain();
+        },
+        "SET %s %s NX EX %d", kLockKey, lockToken_.c_str(), ttl);
+}
+
+void PartitionManager::maintain() {
+    const auto& cfg = Config::get();
+    auto db = drogon::app().getDbClient();
+    db->execSqlAsync(
+        "SELECT messages_ensure_partitions($1) AS created",
+        [this, db](const drogon::orm::Result& r) {
+            const auto& cfg = Config::get();
+            int created = r[0]["created"].as<int>();
+            if (created > 0)
+                LOG_INFO << "partition maintenance: created " << created << " messages partition(s)";
+
+            if (cfg.partitionRetentionMonths <= 0) {
+                MetricsService::instance().partitionMaintenanceRun(true);
+                return refreshStats();
+            }
+            db->execSqlAsync(
+                "SELECT messages_retire_partitions($1, $2) AS retired",
+                [this](const drogon::orm::Result& rr) {
+                    int retired = rr[0]["retired"].as<int>();
+                    if (retired > 0)
+                        LOG_INFO << "partition maintenance: retired " << retired
+                                 << " messages partition(s) (" << Config::get().partitionRetentionMode << ")";
+                    MetricsService::instance().partitionMaintenanceRun(true);
+                    refreshStats();
+                },
+                [this](const drogon::orm::DrogonDbException& e) {
+                    LOG_ERROR << "messages_retire_partitions: " << e.base().what();
+                    MetricsService::instance().partitionMaintenanceRun(false);
+                    refreshStats();
+                },
+                cfg.partitionRetentionMonths, cfg.partitionRetentionMode);
+        },
+        [this](const drogon::orm::DrogonDbException& e) {
+            LOG_ERROR << "messages_ensure_partitions: " << e.base().what();
+            MetricsService::instance().partitionMaintenanceRun(false);
+            refreshStats();
+        },
+        cfg.partitionMonthsAhead);
+}
+
+void PartitionManager::refreshStats() {
+    auto db = drogon::app().getDbClient();
+    db->execSqlAsync(
+        "SELECT c.relname AS name, pg_total_relation_size(c.oid) AS total_bytes, "
+        "       pg_indexes_size(c.oid) AS index_bytes, GREATEST(c.reltuples, 0)::BIGINT AS est_rows "
+        "FROM pg_inherits i JOIN pg_class c ON c.oid = i.inhrelid "
+        "WHERE i.inhparent = 'messages'::regclass "
+        "ORDER BY c.relname",
+        [](const drogon::orm::Result& r) {
+            std::vector<MetricsService::PartitionStat> parts;
+            parts.reserve(r.size());
+            for (const auto& row : r) {
+                parts.push_back({row["name"].as<std::string>(),
+                                 row["total_bytes"].as<long long>(),
+                                 row["index_bytes"].as<long long>(),
+                                 row["est_rows"].as<long long>()});
+            }
+            MetricsService::instance().setMessagePartitions(std::move(parts));
+        },
+        [](const drogon::orm::DrogonDbException& e) {
+            LOG_WARN << "partition stats: " << e.base().what();
+        });
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+
+/// Keeps the monthly partitions of `messages` rolling.
+///
+/// Every PARTITION_MAINT_INTERVAL_SEC each node refreshes the partition
+/// size gauges on /metrics, and whichever node takes the Redis lock
+/// "partition_maint:lock" for that interval runs the maintenance functions
+/// from V24: create the next PARTITION_MONTHS_AHEAD months (moving any rows
+/// stranded in messages_default), then, if PARTITION_RETENTION_MONTHS is
+/// set, detach or drop partitions past the horizon. Without Redis every node
+/// runs it; the SQL functions serialise on an advisory lock either way.
+class PartitionManager {
+public:
+    static PartitionManager& instance();
+
+    /// Schedule the periodic run on the main loop. Call once the app is
+    /// running (DB and Redis clients exist); no-op if the interval is 0.
+    void start();
+
+    PartitionManager(const PartitionManager&) = delete;
+    PartitionManager& operator=(const PartitionManager&) = delete;
+
+private:
+    PartitionManager();
+
+    void tick();
+    void maintain();
+    void refreshStats();
+
+    std::string lockToken_;   // identifies this process as lock holder
+};
@@ -0,0 +1,392 @@
+#include "PresenceService.h"
+#include "MetricsService.h"
+#include "../config/Config.h"
+#include "../ws/RedisChannelMux.h"
+#include "../ws/WsHandler.h"
+#include <drogon/drogon.h>
+#include <drogon/nosql/RedisClient.h>
+#include <trantor/utils/Logger.h>
+#include <json/json.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+
+static const char* const kChannel = "presence";
+static constexpr size_t kHeartbeatChunk = 500;
+
+// KEYS[1] presence:<uid>; ARGV node, now, expires, ttl (ms).
+// Returns how many other nodes already had the user online.
+static const char* const kOnlineScript =
+    "local live = redis.call('ZCOUNT', KEYS[1], ARGV[2], '+inf') "
+    "redis.call('ZADD', KEYS[1], ARGV[3], ARGV[1]) "
+    "redis.call('PEXPIRE', KEYS[1], ARGV[4]) "
+    "return live";
+
+// KEYS[1] presence:<uid>; ARGV node, now. Returns nodes still online.
+static const char* const kOfflineScript =
+    "redis.call('ZREM', KEYS[1], ARGV[1]) "
+    "return redis.call('ZCOUNT', KEYS[1], ARGV[2], '+inf')";
+
+// ARGV "id,id,...", node, now, expires, ttl. Builds the key names itself so a
+// chunk of users costs one command (fine on a single Redis, not on Cluster).
+static const char* const kHeartbeatScript =
+    "for id in string.gmatch(ARGV[1], '%d+') do "
+    "  local k = 'presence:' .. id "
+    "  redis.call('ZREMRANGEBYSCORE', k, '-inf', ARGV[3]) "
+    "  redis.call('ZADD', k, ARGV[4], ARGV[2]) "
+    "  redis.call('PEXPIRE', k, ARGV[5]) "
+    "end "
+    "return 0";
+
+// ARGV "id,id,...", now. Returns the ids with at least one live node entry.
+static const char* const kLookupScript =
+    "local out = {} "
+    "for id in string.gmatch(ARGV[1], '%d+') do "
+    "  if redis.call('ZCOUNT', 'presence:' .. id, ARGV[2], '+inf') > 0 then "
+    "    out[#out + 1] = tonumber(id) "
+    "  end "
+    "end "
+    "return out";
+
+static constexpr size_t kStatusCacheMax = 100000;
+
+static long long wallMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static std::string toJsonStr(const Json::Value& v) {
+    Json::StreamWriterBuilder wb;
+    wb["indentation"] = "";
+    return Json::writeString(wb, v);
+}
+
+PresenceService& PresenceService::instance() {
+    static PresenceService inst;
+    return inst;
+}
+
+PresenceService::PresenceService()
+    : observers_(static_cast<size_t>(std::max(0, Config::get().presenceObserverCacheSize)),
+                 std::chrono::seconds(std::max(1, Config::get().presenceObserverTtlSec))) {
+    char host[256] = {0};
+    gethostname(host, sizeof(host) - 1);
+    // Random suffix: a restarted container keeps its hostname and pid
+    std::random_device rd;
+    char suffix[9];
+    snprintf(suffix, sizeof(suffix), "%08x", rd());
+    nodeId_ = std::string(host) + ":" + std::to_string(getpid()) + ":" + suffix;
+}
+
+void PresenceService::start() {
+    RedisChannelMux::instance().acquire(kChannel,
+        [this](const std::string&, const std::string& msg) {
+            applyAnnouncement(msg);
+        });
+    const auto& cfg = Config::get();
+    auto loop = drogon::app().getLoop();
+    loop->runEvery(std::max(cfg.presenceBatchMs, 50) / 1000.0, [this] { flush(); });
+    loop->runEvery(std::max(cfg.presenceTtlSec, 3) / 3.0, [this] { heartbeat(); });
+}
+
+// ── Transitions ───────────────────────────────────────────────────────────
+
+void PresenceService::userOnline(long long userId, const std::string& username) {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        localOnline_.insert(userId);
+    }
+    auto redis = drogon::app().getRedisClient();
+    if (!redis) return announce(userId, username, "online");
+
+    const long long ttlMs = std::max(3, Config::get().presenceTtlSec) * 1000LL;
+    const long long now   = wallMs();
+    redis->execCommandAsync(
+        [this, userId, username](const drogon::nosql::RedisResult& r) {
+            // Already online on another node: observers saw nothing change
+            if (r.type() == drogon::nosql::RedisResultType::kInteger && r.asInteger() > 0) return;
+            announce(userId, username, "online");
+        },
+        [this, userId, username](const std::exception& e) {
+            LOG_WARN << "presence online (user " << userId << "): " << e.what();
+            announce(userId, username, "online");
+        },
+        "EVAL %s 1 presence:%lld %s %lld %lld %lld",
+        kOnlineScript, userId, nodeId_.c_str(), now, now + ttlMs, ttlMs);
+}
+
+void PresenceService::userOffline(long long userId, const std::string& username) {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        localOnline_.erase(userId);
+    }
+    auto redis = drogon::app().getRedisClient();
+    if (!redis) return announce(userId, username, "offline");
+
+    redis->execCommandAsync(
+        [this, userId, username](const drogon::nosql::RedisResult& r) {
+            // Still online on another node
+            if (r.type() == drogon::nosql::RedisResultType::kInteger && r.asInteger() > 0) return;
+            announce(userId, username, "offline");
+        },
+        [this, userId, username](const std::exception& e) {
+            LOG_WARN << "presence offline (user " << userId << "): " << e.what();
+            announce(userId, username, "offline");
+        },
+        "EVAL %s 1 presence:%lld %s %lld",
+        kOfflineScript, userId, nodeId_.c_str(), wallMs());
+}
+
+void PresenceService::announce(long long userId, const std::string& username,
+                               const std::string& status) {
+    auto db = drogon::app().getDbClient();
+    db->execSqlAsync(
+        "SELECT COALESCE(us.last_seen_visibility, 'everyone') AS visibility "
+        "FROM users u LEFT JOIN user_settings us ON us.user_id = u.id "
+        "WHERE u.id = $1",
+        [this, userId, username, status](const drogon::orm::Result& r) {
+            std::string visibility = r.empty() ? "everyone" : r[0]["visibility"].as<std::string>();
+            std::string msg = status + " " + std::to_string(userId) + " " + visibility + " " + username;
+            MetricsService::instance().presenceAnnounced(status);
+
+            auto redis = drogon::app().getRedisClient();
+            if (!redis) return applyAnnouncement(msg);
+            redis->execCommandAsync(
+                [](const drogon::nosql::RedisResult&) {},
+                [](const std::exception& e) {
+                    LOG_ERROR << "Redis PUBLISH (presence) error: " << e.what();
+                },
+                "PUBLISH %s %s", kChannel, msg.c_str());
+        },
+        [userId](const drogon::orm::DrogonDbException& e) {
+            LOG_ERROR << "presence settings query error for user " << userId
+                      << ": " << e.base().what();
+        },
+        userId);
+}
+
+// ── Status lookups ───────────────────────────────────────────────────────
+
+void PresenceService::rememberStatus(long long userId, bool online) {
+    auto ttl = std::chrono::milliseconds(Config::get().presenceStatusCacheMs);
+    if (ttl.count() <= 0) return;
+    std::lock_guard<std::mutex> lk(statusMu_);
+    // Full: start over rather than track recency
+    if (statusCache_.size() >= kStatusCacheMax) statusCache_.clear();
+    statusCache_[userId] = Status{online, ObserverCache::Clock::now() + ttl};
+}
+
+void PresenceService::lookupOnline(std::vector<long long> userIds,
+                                   std::function<void(std::unordered_set<long long>)> cb) {
+    std::unordered_set<long long> online;
+    std::vector<long long> misses;
+    for (long long id : userIds)
+        if (WsHandler::isUserActiveLocally(id)) online.insert(id);
+    {
+        auto now = ObserverCache::Clock::now();
+        std::lock_guard<std::mutex> lk(statusMu_);
+        for (long long id : userIds) {
+            if (online.count(id)) continue;
+            auto it = statusCache_.find(id);
+            if (it == statusCache_.end() || it->second.expires <= now) {
+                misses.push_back(id);
+            } else if (it->second.online) {
+                online.insert(id);
+            }
+        }
+    }
+    MetricsService::instance().presenceStatusLookup(userIds.size() - misses.size(), misses.size());
+
+    auto redis = drogon::app().getRedisClient();
+    if (misses.empty() || !redis) return cb(std::move(online));
+
+    std::string list;
+    for (long long id : misses) {
+        list += std::to_string(id);
+        list += ',';
+    }
+    redis->execCommandAsync(
+        [this, cb, online, misses](const drogon::nosql::RedisResult& r) mutable {
+            std::unordered_set<long long> found;
+            if (r.type() == drogon::nosql::RedisResultType::kArray)
+                for (const auto& e : r.asArray()) found.insert(e.asInteger());
+            for (long long id : misses) rememberStatus(id, found.count(id) > 0);
+            online.insert(found.begin(), found.end());
+            cb(std::move(online));
+        },
+        [cb, online](const std::exception& e) mutable {
+            LOG_WARN << "presence lookup: " << e.what();
+            cb(std::move(online));
+        },
+        "EVAL %s 0 %s %lld", kLookupScript, list.c_str(), wallMs());
+}
+
+void PresenceService::isOnline(long long userId, std::function<void(bool)> cb) {
+    lookupOnline({userId}, [userId, cb = std::move(cb)](std::unordered_set<long long> online) {
+        cb(online.count(userId) > 0);
+    });
+}
+
+// ── Fan-out ──────────────────────────────────────────────────────────────
+
+void PresenceService::applyAnnouncement(std::string_view msg) {
+    // "<status> <user_id> <visibility> <username>"
+    auto sp1 = msg.find(' ');
+    if (sp1 == std::string_view::npos) return;
+    auto sp2 = msg.find(' ', sp1 + 1);
+    if (sp2 == std::string_view::npos) return;
+    auto sp3 = msg.find(' ', sp2 + 1);
+    if (sp3 == std::string_view::npos) return;
+
+    long long userId = std::atoll(std::string(msg.substr(sp1 + 1, sp2 - sp1 - 1)).c_str());
+    if (userId <= 0) return;
+    Change change{std::string(msg.substr(sp3 + 1)), std::string(msg.substr(0, sp1)),
+                  std::string(msg.substr(sp2 + 1, sp3 - sp2 - 1))};
+    rememberStatus(userId, change.status == "online");
+
+    withObservers(userId, [this, userId, change](ObserverCache::Observers obs) {
+        std::vector<long long> local;
+        for (long long o : *obs)
+            if (WsHandler::hasLocalConnections(o)) local.push_back(o);
+        if (local.empty()) return;
+
+        std::lock_guard<std::mutex> lk(mu_);
+        changes_[userId] = change;
+        for (long long o : local) pending_[o].push_back(userId);
+    });
+}
+
+void PresenceService::withObservers(long long userId,
+                                    std::function<void(ObserverCache::Observers)> cb) {
+    if (auto obs = observers_.get(userId, ObserverCache::Clock::now())) {
+        MetricsService::instance().presenceObserverLookup(true);
+        return cb(obs);
+    }
+    MetricsService::instance().presenceObserverLookup(false);
+
+    auto epoch = observers_.epoch();
+    auto db = drogon::app().getDbClient();
+    db->execSqlAsync(
+        // The user's chats, then everyone sharing any of them
+        "SELECT chat_id, NULL::BIGINT AS user_id FROM chat_members WHERE user_id = $1 "
+        "UNION ALL "
+        "SELECT NULL, o.user_id FROM ("
+        "  SELECT DISTINCT cm2.user_id FROM chat_members cm1 "
+        "  JOIN chat_members cm2 ON cm1.chat_id = cm2.chat_id "
+        "  WHERE cm1.user_id = $1 AND cm2.user_id != $1) o",
+        [this, cb, userId, epoch](const drogon::orm::Result& r) {
+            std::vector<long long> chats, users;
+            for (const auto& row : r) {
+                if (!row["chat_id"].isNull()) chats.push_back(row["chat_id"].as<long long>());
+                else users.push_back(row["user_id"].as<long long>());
+            }
+            auto obs = std::make_shared<const std::vector<long long>>(std::move(users));
+            observers_.put(userId, std::move(chats), obs, epoch, ObserverCache::Clock::now());
+            cb(obs);
+        },
+        [userId](const drogon::orm::DrogonDbException& e) {
+            LOG_ERROR << "presence observers query error for user " << userId
+                      << ": " << e.base().what();
+        },
+        userId);
+}
+
+void PresenceService::flush() {
+    std::unordered_map<long long, Change> changes;
+    std::unordered_map<long long, std::vector<long long>> pending;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        changes.swap(changes_);
+        pending.swap(pending_);
+    }
+    if (pending.empty()) return;
+
+    // Observers of the same subjects share one pair of serialized frames
+    struct Frames {
+        std::shared_ptr<const std::string> admin;    // every entry in full
+        std::shared_ptr<const std::string> member;   // privacy applied; null if empty
+        std::string key;
+    };
+    std::map<std::vector<long long>, Frames> built;
+
+    for (auto& [observer, subjects] : pending) {
+        std::sort(subjects.begin(), subjects.end());
+        subjects.erase(std::unique(subjects.begin(), subjects.end()), subjects.end());
+
+        auto it = built.find(subjects);
+        if (it == built.end()) {
+            Json::Value admin, member;
+            admin["type"]  = member["type"]  = "presence";
+            admin["users"] = member["users"] = Json::arrayValue;
+            for (long long uid : subjects) {
+                const auto& c = changes[uid];
+                Json::Value full;
+                full["user_id"]  = Json::Int64(uid);
+                full["username"] = c.username;
+                full["status"]   = c.status;
+                admin["users"].append(full);
+                if (c.visibility == "everyone") {
+                    member["users"].append(full);
+                } else if (c.visibility == "approx_only") {
+                    Json::Value approx;
+                    approx["user_id"]          = Json::Int64(uid);
+                    approx["username"]         = c.username;
+                    approx["privacy"]          = "approx_only";
+                    approx["last_seen_bucket"] = c.status == "online" ? "online" : "recently";
+                    member["users"].append(approx);
+                }
+                // "nobody": admins only
+            }
+            Frames f;
+            f.admin = std::make_shared<const std::string>(toJsonStr(admin));
+            if (!member["users"].empty())
+                f.member = std::make_shared<const std::string>(toJsonStr(member));
+            // A single-user frame may be superseded by that user's next one
+            if (subjects.size() == 1)
+                f.key = WsDispatch::coalesceKey("presence", 0, subjects.front());
+            it = built.emplace(subjects, std::move(f)).first;
+        }
+        WsHandler::deliverPresence(observer, it->second.admin, it->second.member, it->second.key);
+    }
+    MetricsService::instance().presenceFramesSent(pending.size());
+}
+
+void PresenceService::heartbeat() {
+    auto redis = drogon::app().getRedisClient();
+    if (!redis) return;
+    std::vector<long long> ids;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        ids.assign(localOnline_.begin(), localOnline_.end());
+    }
+    const long long ttlMs = std::max(3, Config::get().presenceTtlSec) * 1000LL;
+    const long long now   = wallMs();
+    for (size_t i = 0; i < ids.size(); i += kHeartbeatChunk) {
+        std::string list;
+        for (size_t j = i; j < std::min(ids.size(), i + kHeartbeatChunk); ++j) {
+            list += std::to_string(ids[j]);
+            list += ',';
+        }
+        redis->execCommandAsync(
+            [](const drogon::nosql::RedisResult&) {},
+            [](const std::exception& e) {
+                LOG_WARN << "presence heartbeat: " << e.what();
+            },
+            "EVAL %s 0 %s %s %lld %lld %lld",
+            kHeartbeatScript, list.c_str(), nodeId_.c_str(), now, now + ttlMs, ttlMs);
+    }
+}
+
+// ── Observer invalidation ────────────────────────────────────────────────
+
+void PresenceService::invalidateMember(long long chatId, long long userId) {
+    observers_.dropMember(chatId, userId);
+}
+
+void PresenceService::invalidateChat(long long chatId) {
+    observers_.dropChat(chatId);
+}
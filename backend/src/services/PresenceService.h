@@ -0,0 +1,96 @@
+#pragma once
+#include "ObserverCache.h"
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/// Online/offline presence across the cluster.
+///
+/// WsHandler reports when a user's first active connection on this node
+/// appears (userOnline) and when the last one goes away after the offline
+/// debounce (userOffline). Each node keeps a Redis sorted set
+/// "presence:<user_id>" of the nodes that have the user online, scored by
+/// expiry and heartbeated every PRESENCE_TTL_SEC / 3, so a transition is only
+/// announced when it changes the cluster-wide state and a crashed node's
+/// entries lapse on their own.
+///
+/// An announcement is one PUBLISH on the "presence" channel,
+/// "<status> <user_id> <visibility> <username>". Every node resolves the
+/// user's observers (co-members of any chat) from an ObserverCache,
+/// invalidated through MembershipCache on joins, leaves and chat deletes,
+/// and queues the change for those observers that are connected locally.
+/// Every PRESENCE_BATCH_MS each such observer gets a single frame listing all
+/// changes since the previous flush:
+///   { "type": "presence", "users": [{ "user_id": 7, "username": "alice", "status": "online" }, ...] }
+/// Users whose last_seen_visibility is not "everyone" appear in full to
+/// admins only; "approx_only" users appear to others as
+///   { "user_id": 7, "username": "alice", "privacy": "approx_only", "last_seen_bucket": "recently" }
+/// Without Redis, announcements stay on this node.
+///
+/// lookupOnline() reads the same sorted sets, so online status reported over
+/// HTTP (chat list, profiles) is right whichever node the peer is on.
+class PresenceService {
+public:
+    static PresenceService& instance();
+
+    /// Subscribe to the presence channel and start the heartbeat and flush
+    /// timers. Call once the app is running.
+    void start();
+
+    void userOnline(long long userId, const std::string& username);
+    void userOffline(long long userId, const std::string& username);
+
+    /// Which of `userIds` are online anywhere in the cluster. Users active on
+    /// this node are answered locally, others from a short-lived status cache
+    /// that announcements keep current; the remaining misses cost a single
+    /// Redis round-trip for the whole batch. `cb` may run inline or on a
+    /// Redis callback thread; if Redis fails it gets local knowledge only.
+    void lookupOnline(std::vector<long long> userIds,
+                      std::function<void(std::unordered_set<long long>)> cb);
+    void isOnline(long long userId, std::function<void(bool)> cb);
+
+    /// Membership changed; called by MembershipCache for local and remote
+    /// invalidations alike.
+    void invalidateMember(long long chatId, long long userId);
+    void invalidateChat(long long chatId);
+
+    PresenceService(const PresenceService&) = delete;
+    PresenceService& operator=(const PresenceService&) = delete;
+
+private:
+    PresenceService();
+
+    // Look up visibility and publish one announcement.
+    void announce(long long userId, const std::string& username, const std::string& status);
+    // Handle an announcement from any node (including this one).
+    void applyAnnouncement(std::string_view msg);
+    void withObservers(long long userId, std::function<void(ObserverCache::Observers)> cb);
+    void flush();
+    void heartbeat();
+    void rememberStatus(long long userId, bool online);
+
+    struct Change {
+        std::string username;
+        std::string status;       // "online" | "offline"
+        std::string visibility;   // "everyone" | "approx_only" | "nobody"
+    };
+
+    std::string   nodeId_;        // member name in presence:<user_id>
+    ObserverCache observers_;
+
+    std::mutex                                                mu_;
+    std::unordered_set<long long>                             localOnline_;  // heartbeated by this node
+    std::unordered_map<long long, Change>                     changes_;      // subject → latest change
+    std::unordered_map<long long, std::vector<long long>>     pending_;      // observer → subjects
+
+    struct Status {
+        bool                             online = false;
+        ObserverCache::Clock::time_point expires;
+    };
+    std::mutex                               statusMu_;
+    std::unordered_map<long long, Status>    statusCache_;  // cluster-wide answers, PRESENCE_STATUS_CACHE_MS
+};
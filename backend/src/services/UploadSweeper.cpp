@@ -0,0 +1,54 @@
+#include "UploadSweeper.h"
+#include "MetricsService.h"
+#include "ObjectStore.h"
+#include "../config/Config.h"
+#include <drogon/drogon.h>
+#include <trantor/utils/Logger.h>
+
+// Rows reaped per statement; a full batch is followed at once by another.
+static const int kSweepBatch = 500;
+
+UploadSweeper& UploadSweeper::instance() {
+    static UploadSweeper inst;
+    return inst;
+}
+
+void UploadSweeper::start() {
+    const int interval = Config::get().uploadSweepIntervalSec;
+    if (interval <= 0) {
+        LOG_INFO << "Pending upload sweep disabled (UPLOAD_SWEEP_INTERVAL_SEC=0)";
+        return;
+    }
+    drogon::app().getLoop()->runEvery(static_cast<double>(interval), [this] { sweep(); });
+}
+
+void UploadSweeper::sweep() {
+    auto db = drogon::app().getDbClient();
+    db->execSqlAsync(
+        "DELETE FROM files WHERE id IN ("
+        "  SELECT id FROM files "
+        "  WHERE status = 'pending' AND upload_expires_at < NOW() - $1::INT * INTERVAL '1 second' "
+        "  ORDER BY upload_expires_at LIMIT $2::INT FOR UPDATE SKIP LOCKED) "
+        "RETURNING bucket, object_key, COALESCE(upload_id, '') AS upload_id",
+        [this](const drogon::orm::Result& r) {
+            auto& store = ObjectStore::instance();
+            for (const auto& row : r) {
+                std::string bucket    = row["bucket"].as<std::string>();
+                std::string objectKey = row["object_key"].as<std::string>();
+                std::string uploadId  = row["upload_id"].as<std::string>();
+                // Parts already sent are only freed by the abort; a presigned
+                // PUT may have landed without the client completing it.
+                if (!uploadId.empty()) store.abortMultipartUpload(bucket, objectKey, uploadId);
+                store.remove(bucket, objectKey, [](bool) {});
+            }
+            if (!r.empty()) {
+                LOG_INFO << "upload sweep: removed " << r.size() << " expired pending upload(s)";
+                MetricsService::instance().pendingUploadsExpired(r.size());
+            }
+            if (r.size() == static_cast<size_t>(kSweepBatch)) sweep();
+        },
+        [](const drogon::orm::DrogonDbException& e) {
+            LOG_ERROR << "upload sweep: " << e.base().what();
+        },
+        Config::get().uploadSweepIntervalSec, kSweepBatch);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+/// Reaps direct uploads that were never completed.
+///
+/// POST /files/upload-url inserts a 'pending' files row (and, for large
+/// files, opens an S3 multipart upload) before any bytes arrive, expiring
+/// with its presigned URLs (upload_expires_at). Every
+/// UPLOAD_SWEEP_INTERVAL_SEC each node deletes pending rows expired for at
+/// least one more interval, so a PUT started just before expiry can still
+/// finish and /complete. It aborts their multipart upload and removes
+/// whatever object a client left behind. Rows are claimed with
+/// DELETE … RETURNING, so nodes sweeping at the same time never handle the
+/// same row twice.
+class UploadSweeper {
+public:
+    static UploadSweeper& instance();
+
+    /// Schedule the periodic sweep on the main loop. Call once the app is
+    /// running; no-op if the interval is 0.
+    void start();
+
+    UploadSweeper(const UploadSweeper&) = delete;
+    UploadSweeper& operator=(const UploadSweeper&) = delete;
+
+private:
+    UploadSweeper() = default;
+
+    void sweep();
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <charconv>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/// Keyset cursor for message history and search pages.
+///
+/// `messages` is partitioned by created_at, so a page boundary expressed as
+/// (created_at, id) lets the planner prune to the partitions at the boundary
+/// and walk idx_messages_chat_created from there, where an id alone makes it
+/// probe every partition. The token is "<created_at as epoch µs>_<id>" and is
+/// opaque to clients: they echo back the `cursor` field of a message.
+namespace msg_cursor {
+
+struct Cursor {
+    long long createdUs = 0;   // created_at, microseconds since the Unix epoch
+    long long id        = 0;
+};
+
+inline std::string encode(long long createdUs, long long id) {
+    return std::to_string(createdUs) + "_" + std::to_string(id);
+}
+
+/// Parse a token from encode(). Rejects anything else, including trailing
+/// characters and non-positive ids.
+inline std::optional<Cursor> decode(std::string_view s) {
+    auto sep = s.find('_');
+    if (sep == std::string_view::npos || sep == 0) return std::nullopt;
+
+    Cursor c;
+    const char* end = s.data() + sep;
+    auto r1 = std::from_chars(s.data(), end, c.createdUs);
+    if (r1.ec != std::errc() || r1.ptr != end) return std::nullopt;
+
+    end = s.data() + s.size();
+    auto r2 = std::from_chars(s.data() + sep + 1, end, c.id);
+    if (r2.ec != std::errc() || r2.ptr != end || c.id <= 0) return std::nullopt;
+    return c;
+}
+
+}  // namespace msg_cursor
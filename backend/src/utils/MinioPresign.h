@@ -1,12 +1,23 @@
 #pragma once
-// MinioPresign.h — AWS SigV4 presigned GET URL generator for MinIO
+// MinioPresign.h — AWS SigV4 for MinIO: presigned GET URLs and signed
+// request headers for the API's own object-storage calls.
 // Header-only: include wherever presigned URLs are needed.
+//
+// Presigning is on the hot path (buildMsgJson signs up to 3 URLs per message
+// row, listChats 2 per chat), so two caches sit in front of the HMAC work:
+//   - the 4-step SigV4 signing key, which only changes with the UTC date;
+//   - finished URLs per (bucket, key, ttl). Signing time is rounded down to a
+//     window of ttl/4, so within a window every caller gets the byte-identical
+//     URL (browser/CDN cacheable) and each URL stays valid for >= 3/4 ttl.
 
+#include <array>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
-#include <sstream>
-#include <iomanip>
-#include <ctime>
 #include <openssl/hmac.h>
 #include <openssl/sha.h>
 #include <openssl/evp.h>
@@ -14,37 +25,47 @@
 namespace minio_presign {
 
 static inline std::string toHex(const unsigned char* d, size_t len) {
-    std::ostringstream ss;
-    for (size_t i = 0; i < len; i++)
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)d[i];
-    return ss.str();
+    static const char kDigits[] = "0123456789abcdef";
+    std::string out(len * 2, '\0');
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i]     = kDigits[d[i] >> 4];
+        out[2 * i + 1] = kDigits[d[i] & 0x0f];
+    }
+    return out;
 }
 
 // S3-style URI encoding: encode all characters except unreserved
 // (A-Z, a-z, 0-9, '-', '_', '.', '~').  When encodeSlash is false,
 // '/' is also preserved (use for URI path components).
 static inline std::string uriEncode(const std::string& s, bool encodeSlash = true) {
-    std::ostringstream enc;
+    static const char kDigits[] = "0123456789ABCDEF";
+    std::string enc;
+    enc.reserve(s.size() + s.size() / 2);
     for (unsigned char c : s) {
         if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
             (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.' || c == '~') {
-            enc << c;
+            enc += static_cast<char>(c);
         } else if (c == '/' && !encodeSlash) {
-            enc << '/';
+            enc += '/';
         } else {
-            enc << '%' << std::hex << std::uppercase
-                << std::setw(2) << std::setfill('0') << (int)c;
+            enc += '%';
+            enc += kDigits[c >> 4];
+            enc += kDigits[c & 0x0f];
         }
     }
-    return enc.str();
+    return enc;
 }
 
-static inline std::string sha256Hex(const std::string& s) {
+static inline std::string sha256Hex(const char* data, size_t len) {
     unsigned char h[SHA256_DIGEST_LENGTH];
-    SHA256(reinterpret_cast<const unsigned char*>(s.data()), s.size(), h);
+    SHA256(reinterpret_cast<const unsigned char*>(data), len, h);
     return toHex(h, SHA256_DIGEST_LENGTH);
 }
 
+static inline std::string sha256Hex(const std::string& s) {
+    return sha256Hex(s.data(), s.size());
+}
+
 static inline std::vector<unsigned char> hmacSha256Raw(const std::string& key,
                                                         const std::string& msg) {
     std::vector<unsigned char> h(32); unsigned int hlen = 0;
@@ -75,29 +96,166 @@ static inline std::vector<unsigned char> sigV4SigningKey(const std::string& secr
     return hmacSha256Raw(kService, "aws4_request");
 }
 
-// Generate a presigned GET URL for MinIO (S3-compatible).
-// endpoint:  "minio:9000" or "http://minio:9000"
-// publicUrl: if non-empty, rewrites the internal base URL to this
-//            (e.g., "https://behappy.rest/minio")
-// ttlSeconds: URL expiry in seconds
-inline std::string generatePresignedUrl(const std::string& endpoint,
-                                         const std::string& publicUrl,
-                                         const std::string& bucket,
-                                         const std::string& key,
-                                         const std::string& accessKey,
-                                         const std::string& secretKey,
-                                         int ttlSeconds = 900) {
-    if (key.empty()) return "";
+// UTC "YYYYMMDD" and "YYYYMMDDTHHMMSSZ" for `t` (thread-safe, no static tm).
+static inline void amzDates(std::time_t t, std::string& date, std::string& datetime) {
+    std::tm utc{};
+    gmtime_r(&t, &utc);
+    char dateBuf[9], timeBuf[17];
+    std::strftime(dateBuf, sizeof(dateBuf), "%Y%m%d", &utc);
+    std::strftime(timeBuf, sizeof(timeBuf), "%Y%m%dT%H%M%SZ", &utc);
+    date.assign(dateBuf, 8);
+    datetime.assign(timeBuf, 16);
+}
+
+// ── Caches (shared across translation units: non-static inline) ────────────
 
+namespace detail {
+
+struct SigningKeyEntry {
+    std::string secret, date, region, service;
+    std::vector<unsigned char> key;
+};
+
+struct SigningKeyCache {
+    std::mutex mu;
+    // Two slots so requests straddling midnight UTC don't thrash
+    std::array<SigningKeyEntry, 2> slots;
+    size_t next = 0;
+};
+
+inline SigningKeyCache& signingKeyCache() {
+    static SigningKeyCache c;
+    return c;
+}
+
+struct UrlEntry {
+    std::string url;
+    std::time_t signedAt;
+};
+
+constexpr size_t kUrlShards        = 16;
+constexpr size_t kUrlMaxPerShard   = 8192;
+
+struct UrlShard {
+    std::mutex mu;
+    std::unordered_map<std::string, UrlEntry> map;
+};
+
+inline UrlShard& urlShard(const std::string& cacheKey) {
+    static std::array<UrlShard, kUrlShards> shards;
+    return shards[std::hash<std::string>{}(cacheKey) % kUrlShards];
+}
+
+} // namespace detail
+
+// SigV4 signing key for (secret, date, region, service), computed once per UTC day.
+inline std::vector<unsigned char> cachedSigningKey(const std::string& secretKey,
+                                                   const std::string& date,
+                                                   const std::string& region,
+                                                   const std::string& service) {
+    auto& c = detail::signingKeyCache();
+    {
+        std::lock_guard<std::mutex> lk(c.mu);
+        for (const auto& e : c.slots) {
+            if (!e.key.empty() && e.date == date && e.secret == secretKey &&
+                e.region == region && e.service == service)
+                return e.key;
+        }
+    }
+    auto key = sigV4SigningKey(secretKey, date, region, service);
+    std::lock_guard<std::mutex> lk(c.mu);
+    c.slots[c.next] = {secretKey, date, region, service, key};
+    c.next = (c.next + 1) % c.slots.size();
+    return key;
+}
+
+// SigV4 header values for a request the API itself sends to MinIO.
+struct SignedHeaders {
+    std::string amzDate;        // x-amz-date
+    std::string contentSha;     // x-amz-content-sha256
+    std::string authorization;  // Authorization
+};
+
+// Sign `method` `uri`?`query` for `host`. `uri` must already be URI-encoded and
+// `query` in canonical form (parameters sorted, values encoded, "name=" for
+// valueless ones); send exactly these. content-type is signed when given.
+inline SignedHeaders signRequest(const std::string& method,
+                                 const std::string& host,
+                                 const std::string& uri,
+                                 const std::string& query,
+                                 const std::string& contentType,
+                                 const std::string& payloadSha,
+                                 const std::string& accessKey,
+                                 const std::string& secretKey) {
     const std::string region  = "us-east-1";
     const std::string service = "s3";
 
-    std::time_t now = std::time(nullptr);
-    char dateBuf[9], timeBuf[17];
-    std::tm* utc = std::gmtime(&now);
-    std::strftime(dateBuf, sizeof(dateBuf), "%Y%m%d", utc);
-    std::strftime(timeBuf, sizeof(timeBuf), "%Y%m%dT%H%M%SZ", utc);
-    std::string date(dateBuf), datetime(timeBuf);
+    std::string date, datetime;
+    amzDates(std::time(nullptr), date, datetime);
+
+    // Canonical headers (must be sorted alphabetically)
+    std::string canonicalHeaders;
+    std::string signedHeaders;
+    if (!contentType.empty()) {
+        canonicalHeaders += "content-type:" + contentType + "\n";
+        signedHeaders    += "content-type;";
+    }
+    canonicalHeaders +=
+        "host:" + host + "\n"
+        "x-amz-content-sha256:" + payloadSha + "\n"
+        "x-amz-date:" + datetime + "\n";
+    signedHeaders += "host;x-amz-content-sha256;x-amz-date";
+
+    std::string canonicalRequest =
+        method + "\n" + uri + "\n" + query + "\n" +
+        canonicalHeaders + "\n" +
+        signedHeaders + "\n" +
+        payloadSha;
+
+    std::string credScope = date + "/" + region + "/" + service + "/aws4_request";
+    std::string stringToSign =
+        "AWS4-HMAC-SHA256\n" + datetime + "\n" + credScope + "\n" +
+        sha256Hex(canonicalRequest);
+
+    auto kSigning = cachedSigningKey(secretKey, date, region, service);
+    unsigned char h[32]; unsigned int hlen = 0;
+    HMAC(EVP_sha256(), kSigning.data(), static_cast<int>(kSigning.size()),
+         reinterpret_cast<const unsigned char*>(stringToSign.data()),
+         stringToSign.size(), h, &hlen);
+
+    SignedHeaders out;
+    out.amzDate       = datetime;
+    out.contentSha    = payloadSha;
+    out.authorization = "AWS4-HMAC-SHA256 Credential=" + accessKey + "/" + credScope +
+                        ", SignedHeaders=" + signedHeaders +
+                        ", Signature=" + toHex(h, hlen);
+    return out;
+}
+
+// Rounding window for presign timestamps: a quarter of the TTL.
+inline std::time_t presignWindow(int ttlSeconds) {
+    return ttlSeconds >= 4 ? ttlSeconds / 4 : 1;
+}
+
+// Build a presigned `method` URL signed as of `signedAt` (uncached).
+// `extraQuery` is appended to the signed query string and must already be
+// canonical: encoded, sorted, and with names sorting after "X-Amz-*" (S3's
+// lowercase ones such as partNumber and uploadId do).
+inline std::string presignAt(const std::string& method,
+                             const std::string& endpoint,
+                             const std::string& publicUrl,
+                             const std::string& bucket,
+                             const std::string& key,
+                             const std::string& accessKey,
+                             const std::string& secretKey,
+                             int ttlSeconds,
+                             std::time_t signedAt,
+                             const std::string& extraQuery = "") {
+    const std::string region  = "us-east-1";
+    const std::string service = "s3";
+
+    std::string date, datetime;
+    amzDates(signedAt, date, datetime);
 
     // Canonical URI: encode path components but preserve '/'
     std::string uri = "/" + uriEncode(bucket + "/" + key, /*encodeSlash=*/false);
@@ -107,25 +265,27 @@ inline std::string generatePresignedUrl(const std::string& endpoint,
 
     // Query params must be URI-encoded per S3 SigV4 spec
     // ('/' in credential → %2F)
-    std::ostringstream qs;
-    qs << "X-Amz-Algorithm=AWS4-HMAC-SHA256"
-       << "&X-Amz-Credential=" << uriEncode(credential)
-       << "&X-Amz-Date=" << datetime
-       << "&X-Amz-Expires=" << ttlSeconds
-       << "&X-Amz-SignedHeaders=host";
+    std::string qs;
+    qs.reserve(256);
+    qs += "X-Amz-Algorithm=AWS4-HMAC-SHA256";
+    qs += "&X-Amz-Credential=";    qs += uriEncode(credential);
+    qs += "&X-Amz-Date=";          qs += datetime;
+    qs += "&X-Amz-Expires=";       qs += std::to_string(ttlSeconds);
+    qs += "&X-Amz-SignedHeaders=host";
+    if (!extraQuery.empty()) { qs += '&'; qs += extraQuery; }
 
     std::string host = endpoint;
     if (host.find("://") != std::string::npos)
         host = host.substr(host.find("://") + 3);
 
     std::string canonicalRequest =
-        "GET\n" + uri + "\n" + qs.str() + "\nhost:" + host + "\n\nhost\nUNSIGNED-PAYLOAD";
+        method + "\n" + uri + "\n" + qs + "\nhost:" + host + "\n\nhost\nUNSIGNED-PAYLOAD";
 
     std::string stringToSign =
         "AWS4-HMAC-SHA256\n" + datetime + "\n" + credScope + "\n" +
         sha256Hex(canonicalRequest);
 
-    auto kSigning = sigV4SigningKey(secretKey, date, region, service);
+    auto kSigning = cachedSigningKey(secretKey, date, region, service);
     unsigned char h[32]; unsigned int hlen = 0;
     HMAC(EVP_sha256(), kSigning.data(), static_cast<int>(kSigning.size()),
          reinterpret_cast<const unsigned char*>(stringToSign.data()),
@@ -133,7 +293,7 @@ inline std::string generatePresignedUrl(const std::string& endpoint,
     std::string signature = toHex(h, hlen);
 
     std::string scheme = "http://";
-    std::string url = scheme + host + uri + "?" + qs.str() + "&X-Amz-Signature=" + signature;
+    std::string url = scheme + host + uri + "?" + qs + "&X-Amz-Signature=" + signature;
 
     if (!publicUrl.empty()) {
         std::string internalBase = scheme + host;
@@ -143,4 +303,88 @@ inline std::string generatePresignedUrl(const std::string& endpoint,
     return url;
 }
 
+// Build a presigned GET URL signed as of `signedAt` (uncached).
+inline std::string presignGetAt(const std::string& endpoint,
+                                const std::string& publicUrl,
+                                const std::string& bucket,
+                                const std::string& key,
+                                const std::string& accessKey,
+                                const std::string& secretKey,
+                                int ttlSeconds,
+                                std::time_t signedAt) {
+    return presignAt("GET", endpoint, publicUrl, bucket, key,
+                     accessKey, secretKey, ttlSeconds, signedAt);
+}
+
+// Presigned PUT URL for a direct client upload of `key`, or of one part of
+// multipart upload `uploadId` when `partNumber` > 0. Not cached: every
+// upload URL is used once.
+inline std::string generatePresignedPutUrl(const std::string& endpoint,
+                                           const std::string& publicUrl,
+                                           const std::string& bucket,
+                                           const std::string& key,
+                                           const std::string& accessKey,
+                                           const std::string& secretKey,
+                                           int ttlSeconds,
+                                           int partNumber = 0,
+                                           const std::string& uploadId = "") {
+    std::string extra;
+    if (partNumber > 0)
+        extra = "partNumber=" + std::to_string(partNumber) + "&uploadId=" + uriEncode(uploadId);
+    return presignAt("PUT", endpoint, publicUrl, bucket, key,
+                     accessKey, secretKey, ttlSeconds, std::time(nullptr), extra);
+}
+
+// Generate a presigned GET URL for MinIO (S3-compatible).
+// endpoint:  "minio:9000" or "http://minio:9000"
+// publicUrl: if non-empty, rewrites the internal base URL to this
+//            (e.g., "https://behappy.rest/minio")
+// ttlSeconds: URL expiry in seconds
+//
+// Cached per (bucket, key, ttl) for the current signing window; endpoint,
+// publicUrl and credentials are assumed process-wide (they come from Config).
+inline std::string generatePresignedUrl(const std::string& endpoint,
+                                         const std::string& publicUrl,
+                                         const std::string& bucket,
+                                         const std::string& key,
+                                         const std::string& accessKey,
+                                         const std::string& secretKey,
+                                         int ttlSeconds = 900) {
+    if (key.empty()) return "";
+
+    const std::time_t window   = presignWindow(ttlSeconds);
+    const std::time_t signedAt = (std::time(nullptr) / window) * window;
+
+    std::string cacheKey;
+    cacheKey.reserve(bucket.size() + key.size() + 12);
+    cacheKey += bucket;
+    cacheKey += '/';
+    cacheKey += key;
+    cacheKey += '#';
+    cacheKey += std::to_string(ttlSeconds);
+
+    auto& shard = detail::urlShard(cacheKey);
+    {
+        std::lock_guard<std::mutex> lk(shard.mu);
+        auto it = shard.map.find(cacheKey);
+        if (it != shard.map.end() && it->second.signedAt == signedAt)
+            return it->second.url;
+    }
+
+    std::string url = presignGetAt(endpoint, publicUrl, bucket, key,
+                                   accessKey, secretKey, ttlSeconds, signedAt);
+
+    std::lock_guard<std::mutex> lk(shard.mu);
+    if (shard.map.size() >= detail::kUrlMaxPerShard) {
+        // Drop entries from earlier windows; if everything is current, start over
+        for (auto it = shard.map.begin(); it != shard.map.end();) {
+            if (it->second.signedAt != signedAt) it = shard.map.erase(it);
+            else ++it;
+        }
+        if (shard.map.size() >= detail::kUrlMaxPerShard) shard.map.clear();
+    }
+    shard.map[cacheKey] = {url, signedAt};
+    return url;
+}
+
 } // namespace minio_presign
@@ -0,0 +1,112 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/// Lock-striped id → connections registry used for chat and user fan-out.
+///
+/// Ids hash onto kShards independent shards, each with its own mutex, so
+/// subscribe/close/broadcast for unrelated chats never contend. Each id maps
+/// to an immutable, shared vector (copy-on-write): writers copy, edit and swap
+/// under the shard lock; readers take a snapshot (one refcount bump) and
+/// iterate and send with no lock held.
+template <typename Conn, size_t kShards = 64>
+class ConnRegistry {
+public:
+    using List     = std::vector<Conn>;
+    using Snapshot = std::shared_ptr<const List>;
+
+    static_assert((kShards & (kShards - 1)) == 0, "kShards must be a power of two");
+
+    // Current recipients for `id`, or nullptr. Safe to iterate without locks.
+    Snapshot snapshot(long long id) const {
+        const auto& sh = shard(id);
+        std::lock_guard<std::mutex> lk(sh.mu);
+        auto it = sh.map.find(id);
+        return it == sh.map.end() ? nullptr : it->second;
+    }
+
+    // Add `c` under `id`; returns false if it was already present.
+    // The list stays ordered by Conn's operator< (stable for equal keys), which
+    // lets callers group entries, e.g. by owning event loop.
+    bool add(long long id, const Conn& c) {
+        return mutate(id, [&c](List& v) {
+            for (const auto& x : v) if (x == c) return false;
+            v.insert(std::upper_bound(v.begin(), v.end(), c), c);
+            return true;
+        });
+    }
+
+    // Add `c` under each of `ids`, taking each shard's lock once rather than
+    // once per id. Returns the ids `c` was not already present under.
+    std::vector<long long> addMany(const std::vector<long long>& ids, const Conn& c) {
+        std::array<std::vector<long long>, kShards> byShard;
+        for (long long id : ids) byShard[shardIndex(id)].push_back(id);
+
+        std::vector<long long> added;
+        for (size_t i = 0; i < kShards; ++i) {
+            if (byShard[i].empty()) continue;
+            auto& sh = shards_[i];
+            std::lock_guard<std::mutex> lk(sh.mu);
+            for (long long id : byShard[i]) {
+                auto it = sh.map.find(id);
+                List next = (it != sh.map.end()) ? *it->second : List{};
+                if (std::find(next.begin(), next.end(), c) != next.end()) continue;
+                next.insert(std::upper_bound(next.begin(), next.end(), c), c);
+                auto snap = std::make_shared<const List>(std::move(next));
+                if (it != sh.map.end()) it->second = std::move(snap);
+                else sh.map.emplace(id, std::move(snap));
+                added.push_back(id);
+            }
+        }
+        return added;
+    }
+
+    // Remove `c` from `id`; returns false if it was not present.
+    bool remove(long long id, const Conn& c) {
+        return mutate(id, [&c](List& v) {
+            auto before = v.size();
+            v.erase(std::remove(v.begin(), v.end(), c), v.end());
+            return v.size() != before;
+        });
+    }
+
+    // Atomically edit the list for `id` under its shard lock and publish the
+    // result (an emptied list removes the id). `f(List&)` must not block.
+    template <typename F>
+    auto mutate(long long id, F&& f) {
+        auto& sh = shard(id);
+        std::lock_guard<std::mutex> lk(sh.mu);
+        auto it = sh.map.find(id);
+        List next = (it != sh.map.end()) ? *it->second : List{};
+        auto result = f(next);
+        if (next.empty()) {
+            if (it != sh.map.end()) sh.map.erase(it);
+        } else if (it != sh.map.end()) {
+            it->second = std::make_shared<const List>(std::move(next));
+        } else {
+            sh.map.emplace(id, std::make_shared<const List>(std::move(next)));
+        }
+        return result;
+    }
+
+private:
+    struct Shard {
+        mutable std::mutex                        mu;
+        std::unordered_map<long long, Snapshot>   map;
+    };
+
+    static size_t shardIndex(long long id) {
+        // Fibonacci hashing spreads sequential ids across shards
+        return static_cast<size_t>((static_cast<std::uint64_t>(id) * 0x9E3779B97F4A7C15ull) >> 32)
+               & (kShards - 1);
+    }
+    Shard&       shard(long long id)       { return shards_[shardIndex(id)]; }
+    const Shard& shard(long long id) const { return shards_[shardIndex(id)]; }
+
+    std::array<Shard, kShards> shards_;
+};
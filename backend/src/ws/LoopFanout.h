@@ -0,0 +1,46 @@
+#pragma once
+#include <trantor/net/EventLoop.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// A registry entry bound to the IO loop that owns the connection.
+/// Ordered by loop so ConnRegistry keeps each id's list grouped per loop;
+/// equality is by connection only.
+template <typename Conn>
+struct LoopBound {
+    Conn                conn;
+    trantor::EventLoop* loop = nullptr;
+
+    bool operator==(const LoopBound& o) const { return conn == o.conn; }
+    bool operator<(const LoopBound& o)  const { return loop < o.loop; }
+};
+
+/// Deliver one message to every recipient on the recipient's own event loop.
+///
+/// `list` must be grouped by loop (ConnRegistry keeps it that way). Each
+/// contiguous run becomes a single task posted to that loop, so a broadcast to
+/// N connections spread over L loops costs at most L cross-thread wakeups
+/// instead of N, and the message bytes are shared rather than copied per
+/// recipient. The run owned by the calling thread's loop is written inline.
+template <typename Conn, typename Send>
+void fanOutByLoop(std::shared_ptr<const std::vector<LoopBound<Conn>>> list,
+                  std::shared_ptr<const std::string> msg,
+                  Send send) {
+    const size_t n = list->size();
+    size_t i = 0;
+    while (i < n) {
+        trantor::EventLoop* loop = (*list)[i].loop;
+        size_t j = i + 1;
+        while (j < n && (*list)[j].loop == loop) ++j;
+
+        if (!loop || loop->isInLoopThread()) {
+            for (size_t k = i; k < j; ++k) send((*list)[k].conn, *msg);
+        } else {
+            loop->queueInLoop([list, msg, send, i, j] {
+                for (size_t k = i; k < j; ++k) send((*list)[k].conn, *msg);
+            });
+        }
+        i = j;
+    }
+}
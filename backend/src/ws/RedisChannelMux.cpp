@@ -0,0 +1,126 @@
+#include "RedisChannelMux.h"
+#include "../config/Config.h"
+#include "../services/MetricsService.h"
+#include <drogon/drogon.h>
+#include <drogon/nosql/RedisClient.h>
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+
+RedisChannelMux& RedisChannelMux::instance() {
+    static RedisChannelMux inst;
+    return inst;
+}
+
+void RedisChannelMux::setDispatcher(Dispatcher dispatcher) {
+    std::lock_guard<std::mutex> lk(mu_);
+    dispatcher_ = std::move(dispatcher);
+}
+
+std::shared_ptr<drogon::nosql::RedisSubscriber>
+RedisChannelMux::subscriberFor(const std::string& channel) {
+    if (pool_.empty()) {
+        auto redis = drogon::app().getRedisClient();
+        if (!redis) return nullptr;
+        int n = std::max(1, Config::get().redisSubConnections);
+        pool_.reserve(n);
+        for (int i = 0; i < n; ++i) pool_.push_back(redis->newSubscriber());
+        LOG_INFO << "Redis pub/sub multiplexer: " << n << " subscriber connection(s)";
+    }
+    return pool_[std::hash<std::string>{}(channel) % pool_.size()];
+}
+
+void RedisChannelMux::publishGauge() const {
+    MetricsService::instance().setRedisChannels(static_cast<long long>(channels_.size()));
+}
+
+bool RedisChannelMux::acquire(const std::string& channel, Dispatcher handler) {
+    std::lock_guard<std::mutex> lk(mu_);
+    size_t before = channels_.size();
+    bool ok = acquireLocked(channel, std::move(handler));
+    if (channels_.size() != before) publishGauge();
+    return ok;
+}
+
+std::vector<bool> RedisChannelMux::acquireMany(const std::vector<std::string>& channels) {
+    std::lock_guard<std::mutex> lk(mu_);
+    size_t before = channels_.size();
+    std::vector<bool> taken;
+    taken.reserve(channels.size());
+    for (const auto& ch : channels) taken.push_back(acquireLocked(ch, {}));
+    if (channels_.size() != before) publishGauge();
+    return taken;
+}
+
+bool RedisChannelMux::acquireLocked(const std::string& channel, Dispatcher handler) {
+    auto it = channels_.find(channel);
+    if (it != channels_.end()) {
+        // Already subscribed (possibly inside its grace period) — just take a ref.
+        it->second.refs++;
+        return true;
+    }
+
+    auto sub = subscriberFor(channel);
+    if (!sub) return false;
+
+    try {
+        // Channels share one dispatcher (the channel name carries the routing
+        // key) unless the caller brought its own handler.
+        sub->subscribe(channel,
+            [d = handler ? std::move(handler) : dispatcher_](const std::string& ch,
+                                                              const std::string& msg) {
+                try {
+                    if (d) d(ch, msg);
+                } catch (const std::exception& e) {
+                    LOG_ERROR << "Redis dispatch error on " << ch << ": " << e.what();
+                }
+            });
+        channels_[channel].refs = 1;
+    } catch (const std::exception& e) {
+        // No ref taken: the caller must not release() this channel
+        LOG_ERROR << "Failed to subscribe to Redis channel " << channel
+                  << ": " << e.what();
+        return false;
+    }
+    return true;
+}
+
+void RedisChannelMux::release(const std::string& channel) {
+    std::uint64_t gen;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = channels_.find(channel);
+        if (it == channels_.end() || it->second.refs <= 0) return;
+        if (--it->second.refs > 0) return;
+        gen = ++it->second.gen;
+    }
+
+    double grace = Config::get().redisUnsubGraceSec;
+    if (grace <= 0) {
+        expire(channel, gen);
+        return;
+    }
+    drogon::app().getLoop()->runAfter(grace, [this, channel, gen] {
+        expire(channel, gen);
+    });
+}
+
+void RedisChannelMux::expire(const std::string& channel, std::uint64_t gen) {
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = channels_.find(channel);
+    // Re-acquired (refs > 0) or released again later (newer gen owns the timer)
+    if (it == channels_.end() || it->second.refs > 0 || it->second.gen != gen) return;
+    channels_.erase(it);
+    publishGauge();
+    if (pool_.empty()) return;
+    try {
+        pool_[std::hash<std::string>{}(channel) % pool_.size()]->unsubscribe(channel);
+    } catch (const std::exception& e) {
+        LOG_ERROR << "Failed to unsubscribe from Redis channel " << channel
+                  << ": " << e.what();
+    }
+}
+
+size_t RedisChannelMux::channelCount() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return channels_.size();
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <drogon/nosql/RedisSubscriber.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// Multiplexes Redis pub/sub channels over a small, fixed pool of subscriber
+/// connections. Each channel is pinned to one pooled connection by hash, so the
+/// number of Redis sockets per process is bounded by REDIS_SUB_CONNECTIONS no
+/// matter how many chat/user channels are live.
+///
+/// Channels are reference counted: the first acquire() SUBSCRIBEs, and the
+/// last release() schedules an UNSUBSCRIBE after REDIS_UNSUB_GRACE_SEC so a
+/// client reconnecting or re-opening a chat does not flap the subscription.
+///
+/// Messages go to a single dispatcher that routes by channel name
+/// ("chat:<id>", "user:<id>"), unless the channel was acquired with its own
+/// handler (process-wide control channels such as "membership").
+class RedisChannelMux {
+public:
+    using Dispatcher = std::function<void(const std::string& channel,
+                                          const std::string& message)>;
+
+    static RedisChannelMux& instance();
+
+    // Install the channel-name dispatcher. Must be set before the first acquire().
+    void setDispatcher(Dispatcher dispatcher);
+
+    // Take a reference on a channel, subscribing on the 0 → 1 transition.
+    // `handler`, if given, receives this channel's messages instead of the
+    // shared dispatcher (only consulted when the subscription is created).
+    // Returns false, without taking a ref, when Redis is not configured (caller
+    // falls back to local-only) or the SUBSCRIBE failed.
+    bool acquire(const std::string& channel, Dispatcher handler = {});
+
+    // acquire() for several channels under one lock (e.g. all of a user's chats
+    // on connect). Element i says whether channels[i] got a ref.
+    std::vector<bool> acquireMany(const std::vector<std::string>& channels);
+
+    // Drop a reference; on 1 → 0 the channel is unsubscribed after the grace period
+    // unless it is re-acquired first.
+    void release(const std::string& channel);
+
+    // Number of channels currently subscribed on this process (including those
+    // waiting out their unsubscribe grace period).
+    size_t channelCount() const;
+
+private:
+    RedisChannelMux() = default;
+
+    struct Channel {
+        long long     refs = 0;
+        std::uint64_t gen  = 0;   // bumped on every release-to-zero; stale timers no-op
+    };
+
+    // Lazily builds the pool on first use (Redis clients exist only after app().run()).
+    // Must be called under mu_.
+    std::shared_ptr<drogon::nosql::RedisSubscriber> subscriberFor(const std::string& channel);
+
+    // acquire() body. Must be called under mu_; does not update the gauge.
+    bool acquireLocked(const std::string& channel, Dispatcher handler);
+
+    // Timer callback: unsubscribe if the channel is still unreferenced.
+    void expire(const std::string& channel, std::uint64_t gen);
+
+    // Must be called under mu_.
+    void publishGauge() const;
+
+    mutable std::mutex mu_;
+    std::vector<std::shared_ptr<drogon::nosql::RedisSubscriber>> pool_;
+    std::unordered_map<std::string, Channel> channels_;
+    Dispatcher dispatcher_;
+};
@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/// Per-(chat, user) typing state for one node.
+///
+/// Sender side: clients report typing on every keystroke; shouldPublish()
+/// lets at most one report per (chat, user) through per `throttle` window.
+///
+/// Receiver side: published reports from every node are fed to observe().
+/// A typist stays in the chat's set until `ttl` passes without a fresh report
+/// or stop() is called (the user sent a message). collect() runs on a timer
+/// and returns the full typing set of each chat whose set changed since the
+/// previous call, so subscribers get one frame per chat per tick instead of
+/// one per report. `ttl` should exceed `throttle` or a steady typist flickers.
+class TypingTracker {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Typist {
+        long long   userId = 0;
+        std::string username;
+    };
+    using ChatSet = std::pair<long long, std::vector<Typist>>;  // chatId, typists by userId
+
+    TypingTracker(Clock::duration throttle, Clock::duration ttl)
+        : throttle_(throttle), ttl_(ttl) {}
+
+    // A local client reported typing. True if the report should be published.
+    bool shouldPublish(long long chatId, long long userId, Clock::time_point now) {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto [it, inserted] = lastPublish_.try_emplace(Key{chatId, userId}, now);
+        if (inserted) return true;
+        if (now - it->second < throttle_) return false;
+        it->second = now;
+        return true;
+    }
+
+    // A published report arrived (from any node). Only a user who was not
+    // already typing changes the chat's set.
+    void observe(long long chatId, long long userId, std::string username,
+                 Clock::time_point now) {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto& chat = chats_[chatId];
+        auto [it, inserted] = chat.typists.try_emplace(userId);
+        it->second.expires = now + ttl_;
+        if (inserted) {
+            it->second.username = std::move(username);
+            chat.dirty = true;
+        }
+    }
+
+    // The user stopped typing (sent a message): leave the set now, and let
+    // their next keystroke publish without waiting out the throttle.
+    void stop(long long chatId, long long userId) {
+        std::lock_guard<std::mutex> lk(mu_);
+        lastPublish_.erase(Key{chatId, userId});
+        auto it = chats_.find(chatId);
+        if (it != chats_.end() && it->second.typists.erase(userId) > 0)
+            it->second.dirty = true;
+    }
+
+    // Expire stale typists and return the current set of every chat that
+    // changed since the last call (an empty set means nobody is typing).
+    std::vector<ChatSet> collect(Clock::time_point now) {
+        std::lock_guard<std::mutex> lk(mu_);
+        std::vector<ChatSet> out;
+        for (auto it = chats_.begin(); it != chats_.end();) {
+            auto& chat = it->second;
+            for (auto t = chat.typists.begin(); t != chat.typists.end();) {
+                if (t->second.expires <= now) {
+                    t = chat.typists.erase(t);
+                    chat.dirty = true;
+                } else {
+                    ++t;
+                }
+            }
+            if (chat.dirty) {
+                std::vector<Typist> set;
+                set.reserve(chat.typists.size());
+                for (const auto& [uid, e] : chat.typists) set.push_back({uid, e.username});
+                std::sort(set.begin(), set.end(),
+                          [](const Typist& a, const Typist& b) { return a.userId < b.userId; });
+                out.emplace_back(it->first, std::move(set));
+                chat.dirty = false;
+            }
+            if (chat.typists.empty()) it = chats_.erase(it);
+            else ++it;
+        }
+        // Throttle entries only matter within their window
+        for (auto it = lastPublish_.begin(); it != lastPublish_.end();) {
+            if (now - it->second >= throttle_) it = lastPublish_.erase(it);
+            else ++it;
+        }
+        return out;
+    }
+
+private:
+    struct Key {
+        long long chatId;
+        long long userId;
+        bool operator==(const Key& o) const { return chatId == o.chatId && userId == o.userId; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            return static_cast<size_t>(static_cast<std::uint64_t>(k.chatId) * 0x9E3779B97F4A7C15ull
+                                       ^ static_cast<std::uint64_t>(k.userId));
+        }
+    };
+    struct Entry {
+        std::string       username;
+        Clock::time_point expires;
+    };
+    struct ChatState {
+        std::unordered_map<long long, Entry> typists;
+        bool dirty = false;
+    };
+
+    const Clock::duration throttle_;
+    const Clock::duration ttl_;
+
+    std::mutex                                          mu_;
+    std::unordered_map<Key, Clock::time_point, KeyHash> lastPublish_;
+    std::unordered_map<long long, ChatState>            chats_;
+};
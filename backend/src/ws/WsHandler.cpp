@@ -1,43 +1,57 @@
 #include "WsHandler.h"
+#include "RedisChannelMux.h"
+#include "TypingTracker.h"
 #include "../services/JwtService.h"
 #include "../services/MetricsService.h"
+#include "../services/MembershipCache.h"
+#include "../services/PresenceService.h"
+#include "../config/Config.h"
 #include <drogon/nosql/RedisClient.h>
-#include <drogon/nosql/RedisSubscriber.h>
 #include <drogon/orm/DbClient.h>
 #include <trantor/utils/Logger.h>
 #include <json/json.h>
+#include <cstdlib>
 #include <sstream>
-#include <unordered_set>
 
 // ── Static members ─────────────────────────────────────────────────────────
-std::mutex WsHandler::s_mu;
-std::unordered_map<long long, std::vector<drogon::WebSocketConnectionPtr>> WsHandler::s_subs;
-std::unordered_map<long long, bool> WsHandler::s_redisSubs;
-std::unordered_map<long long, bool> WsHandler::s_redisUserSubs;
-std::mutex WsHandler::s_userMu;
-std::unordered_map<long long, std::vector<drogon::WebSocketConnectionPtr>> WsHandler::s_userConns;
+WsHandler::Registry WsHandler::s_subs;
+WsHandler::Registry WsHandler::s_userConns;
+std::mutex WsHandler::s_timerMu;
 std::unordered_map<long long, trantor::TimerId> WsHandler::s_offlineTimers;
 
-// Keep Redis subscriber objects alive so callbacks remain valid
-static std::mutex s_redisSubMu;
-static std::unordered_map<long long,
-       std::shared_ptr<drogon::nosql::RedisSubscriber>> s_redisSubPtrs;
-
-bool WsHandler::isUserOnline(long long userId) {
-    std::lock_guard<std::mutex> lk(s_userMu);
-    auto it = s_userConns.find(userId);
-    if (it == s_userConns.end() || it->second.empty()) return false;
+bool WsHandler::isUserActiveLocally(long long userId) {
+    auto conns = s_userConns.snapshot(userId);
+    if (!conns) return false;
     // User is online only if at least one live, active connection exists
-    for (const auto& conn : it->second) {
-        if (!conn || conn->disconnected()) continue;
-        auto ctx = conn->getContext<ConnCtx>();
+    for (const auto& e : *conns) {
+        if (!e.conn || e.conn->disconnected()) continue;
+        auto ctx = e.conn->getContext<ConnCtx>();
         if (ctx && ctx->active) return true;
     }
     return false;
 }
 
+// Drop dead connections and report whether any connection other than `self`
+// is active. Runs inside Registry::mutate (under the user's shard lock).
+bool WsHandler::pruneAndCheckActive(Registry::List& vec,
+                                    const drogon::WebSocketConnectionPtr& self) {
+    vec.erase(std::remove_if(vec.begin(), vec.end(),
+        [](const Subscriber& e) {
+            return !e.conn || e.conn->disconnected();
+        }), vec.end());
+    for (const auto& e : vec) {
+        if (e.conn == self) continue;
+        auto cctx = e.conn->getContext<ConnCtx>();
+        if (cctx && cctx->active) return true;
+    }
+    return false;
+}
+
 // ── Helpers ────────────────────────────────────────────────────────────────
 
+// Upper bound on chat_ids in one subscribe_many frame
+static constexpr unsigned kMaxSubscribeBatch = 5000;
+
 static Json::Value parseJson(const std::string& s) {
     Json::Value root;
     Json::CharReaderBuilder rb;
@@ -67,21 +81,97 @@ static void sendError(const drogon::WebSocketConnectionPtr& conn,
     sendJson(conn, e);
 }
 
+// ── Outbound backpressure ──────────────────────────────────────────────────
+// Every fan-out frame goes through deliverFrame on the connection's own loop.
+// Congestion is signalled by the TCP output buffer crossing WS_OUTBOUND_MAX_BYTES
+// (high-water callback) and cleared when it fully drains (write-complete).
+// While congested: typing/presence frames are coalesced (latest per key wins),
+// everything else is dropped and the client is told to resync once drained;
+// a connection still congested after WS_SLOW_CONSUMER_SEC is evicted.
+
+void WsHandler::deliverFrame(const drogon::WebSocketConnectionPtr& conn,
+                             const std::string& msg, const std::string& coalesceKey) {
+    try {
+        if (!conn || conn->disconnected()) return;
+        auto ctx = conn->getContext<ConnCtx>();
+        if (!ctx || !ctx->congested) {
+            conn->send(msg);
+            return;
+        }
+        auto& metrics = MetricsService::instance();
+        if (!coalesceKey.empty()) {
+            auto [it, inserted] = ctx->held.try_emplace(coalesceKey, msg);
+            if (!inserted) it->second = msg;
+            metrics.wsOutboundCoalesced();
+            if (inserted) metrics.wsOutboundHeld(+1);
+            return;
+        }
+        ctx->droppedWhileCongested = true;
+        metrics.wsOutboundDropped(msg.size());
+    } catch (const std::exception& e) {
+        LOG_ERROR << "WS fan-out send error: " << e.what();
+    }
+}
+
+void WsHandler::onOutboundHighWater(const drogon::WebSocketConnectionPtr& conn) {
+    auto ctx = conn->getContext<ConnCtx>();
+    if (!ctx || ctx->congested) return;
+    ctx->congested = true;
+    unsigned episode = ++ctx->congestionEpisode;
+    MetricsService::instance().wsOutboundCongested(+1);
+
+    // Evict if this congestion episode outlives the grace period
+    std::weak_ptr<drogon::WebSocketConnection> weak = conn;
+    ctx->loop->runAfter(Config::get().wsSlowConsumerSec, [weak, episode] {
+        auto c = weak.lock();
+        if (!c || c->disconnected()) return;
+        auto cctx = c->getContext<ConnCtx>();
+        if (!cctx || !cctx->congested || cctx->congestionEpisode != episode) return;
+        LOG_WARN << "Evicting slow WebSocket consumer (user " << cctx->userId << ")";
+        MetricsService::instance().wsSlowConsumerEvicted();
+        c->forceClose();
+    });
+}
+
+void WsHandler::onOutboundDrained(const drogon::WebSocketConnectionPtr& conn) {
+    auto ctx = conn->getContext<ConnCtx>();
+    if (!ctx || !ctx->congested) return;
+    ctx->congested = false;
+    MetricsService::instance().wsOutboundCongested(-1);
+    MetricsService::instance().wsOutboundHeld(-static_cast<long long>(ctx->held.size()));
+
+    // Flush the latest coalesced typing/presence state, then ask for a resync
+    // if anything non-coalescable was dropped.
+    auto held = std::move(ctx->held);
+    ctx->held.clear();
+    for (auto& [key, frame] : held) conn->send(frame);
+    if (ctx->droppedWhileCongested) {
+        ctx->droppedWhileCongested = false;
+        Json::Value r;
+        r["type"] = "resync_required";
+        sendJson(conn, r);
+    }
+}
+
 // ── Broadcast to local subscribers ────────────────────────────────────────
 
 void WsHandler::broadcast(long long chatId, const Json::Value& payload) {
+    broadcastRaw(chatId, toJsonStr(payload),
+                 WsDispatch::coalesceKey(payload["type"].asString(), chatId,
+                                         payload.get("user_id", 0).asInt64()));
+}
+
+void WsHandler::broadcastRaw(long long chatId, std::string_view payload,
+                             std::string coalesceKey) {
     try {
-        std::lock_guard<std::mutex> lk(s_mu);
-        auto it = s_subs.find(chatId);
-        if (it == s_subs.end()) return;
-        std::string msg = toJsonStr(payload);
-        for (auto& conn : it->second) {
-            try {
-                if (conn && !conn->disconnected()) conn->send(msg);
-            } catch (const std::exception& e) {
-                LOG_ERROR << "WS broadcast send error: " << e.what();
-            }
-        }
+        // Snapshot under the shard lock; delivery runs on each connection's own loop
+        auto conns = s_subs.snapshot(chatId);
+        if (!conns) return;
+        fanOutByLoop(std::move(conns), std::make_shared<const std::string>(payload),
+                     [key = std::move(coalesceKey)](const drogon::WebSocketConnectionPtr& c,
+                                                    const std::string& m) {
+                         deliverFrame(c, m, key);
+                     });
     } catch (const std::exception& e) {
         LOG_ERROR << "WS broadcast error for chat " << chatId << ": " << e.what();
     }
@@ -90,112 +180,190 @@ void WsHandler::broadcast(long long chatId, const Json::Value& payload) {
 // ── Broadcast to all connections of a specific user ──────────────────────────
 
 void WsHandler::broadcastToUser(long long userId, const Json::Value& payload) {
+    broadcastToUserRaw(userId, toJsonStr(payload),
+                       WsDispatch::coalesceKey(payload["type"].asString(), userId,
+                                               payload.get("user_id", 0).asInt64()));
+}
+
+void WsHandler::broadcastToUserRaw(long long userId, std::string_view payload,
+                                   std::string coalesceKey) {
     try {
-        std::lock_guard<std::mutex> lk(s_userMu);
-        auto it = s_userConns.find(userId);
-        if (it == s_userConns.end()) return;
-        std::string msg = toJsonStr(payload);
-        for (auto& conn : it->second) {
-            try {
-                if (conn && !conn->disconnected()) conn->send(msg);
-            } catch (const std::exception& e) {
-                LOG_ERROR << "WS broadcastToUser send error: " << e.what();
-            }
-        }
+        auto conns = s_userConns.snapshot(userId);
+        if (!conns) return;
+        fanOutByLoop(std::move(conns), std::make_shared<const std::string>(payload),
+                     [key = std::move(coalesceKey)](const drogon::WebSocketConnectionPtr& c,
+                                                    const std::string& m) {
+                         deliverFrame(c, m, key);
+                     });
     } catch (const std::exception& e) {
         LOG_ERROR << "WS broadcastToUser error for user " << userId << ": " << e.what();
     }
 }
 
-// ── Redis subscription ─────────────────────────────────────────────────────
+// ── Typing indicators ──────────────────────────────────────────────────────
+// Client reports are throttled per (chat, user) before publishing. Every node
+// feeds the published reports into its TypingTracker and, once per tick, sends
+// local subscribers the full typing set of each chat whose set changed.
+
+static void deliverTypingSets();
+
+static TypingTracker& typingTracker() {
+    static TypingTracker tracker(std::chrono::milliseconds(Config::get().wsTypingThrottleMs),
+                                 std::chrono::milliseconds(Config::get().wsTypingTtlMs));
+    static std::once_flag once;
+    std::call_once(once, [] {
+        drogon::app().getLoop()->runEvery(std::max(Config::get().wsTypingTickMs, 50) / 1000.0,
+                                          deliverTypingSets);
+    });
+    return tracker;
+}
 
-void WsHandler::subscribeToRedis(long long chatId) {
-    {
-        std::lock_guard<std::mutex> lk(s_mu);
-        if (s_redisSubs.count(chatId)) return;
-        s_redisSubs[chatId] = true;
+static void deliverTypingSets() {
+    auto sets = typingTracker().collect(TypingTracker::Clock::now());
+    if (sets.empty()) return;
+    for (auto& [chatId, typists] : sets) {
+        Json::Value payload;
+        payload["type"]    = "typing";
+        payload["chat_id"] = Json::Int64(chatId);
+        payload["users"]   = Json::arrayValue;
+        for (const auto& t : typists) {
+            Json::Value u;
+            u["user_id"]  = Json::Int64(t.userId);
+            u["username"] = t.username;
+            payload["users"].append(u);
+        }
+        // Latest set per chat wins on a congested connection
+        WsHandler::broadcastRaw(chatId, toJsonStr(payload),
+                                WsDispatch::coalesceKey("typing", chatId, 0));
     }
+    MetricsService::instance().wsTypingSetsSent(sets.size());
+}
 
-    std::string channel = "chat:" + std::to_string(chatId);
-    auto redis = drogon::app().getRedisClient();
-    if (!redis) {
-        LOG_WARN << "Redis not configured; WebSocket fan-out is local-only";
-        return;
-    }
+// A typing report published by any node (payload carries the username).
+static void observeTyping(long long chatId, long long userId, std::string_view payload) {
+    if (userId <= 0) return;
+    auto p = parseJson(std::string(payload));
+    typingTracker().observe(chatId, userId, p.get("username", "").asString(),
+                            TypingTracker::Clock::now());
+}
 
-    try {
-        // Store the subscriber so its callback remains valid for the process lifetime
-        auto subscriber = redis->newSubscriber();
-        subscriber->subscribe(
-            channel,
-            [chatId](const std::string& /*channel*/, const std::string& msg) {
-                try {
-                    auto payload = parseJson(msg);
-                    WsHandler::broadcast(chatId, payload);
-                } catch (const std::exception& e) {
-                    LOG_ERROR << "Redis subscribe callback error for chat "
-                              << chatId << ": " << e.what();
-                }
-            }
-        );
-        {
-            std::lock_guard<std::mutex> lk(s_redisSubMu);
-            s_redisSubPtrs[chatId] = std::move(subscriber);
+// ── Redis subscription ─────────────────────────────────────────────────────
+// All chat:<id> / user:<id> channels share the pooled connections owned by
+// RedisChannelMux; incoming messages are routed here by channel name.
+
+static void dispatchRedisMessage(const std::string& channel, const std::string& msg) {
+    auto colon = channel.find(':');
+    if (colon == std::string::npos) return;
+    long long id = std::atoll(channel.c_str() + colon + 1);
+    if (id <= 0) return;
+
+    // Forward the published bytes as-is; only the envelope header is inspected.
+    auto env = WsDispatch::decodeEnvelope(msg);
+    auto key = WsDispatch::coalesceKey(env.type, env.scopeId, env.subjectId);
+    if (channel.compare(0, colon, "chat") == 0) {
+        // Typing reaches subscribers only through the batched per-chat sets
+        if (env.type == "typing") {
+            observeTyping(id, env.subjectId, env.payload);
+            return;
         }
-    } catch (const std::exception& e) {
-        LOG_ERROR << "Failed to subscribe to Redis channel " << channel
-                  << ": " << e.what();
-        std::lock_guard<std::mutex> lk(s_mu);
-        s_redisSubs.erase(chatId);
+        // A sent message ends its sender's typing
+        if (env.type == "message" && env.subjectId > 0)
+            typingTracker().stop(id, env.subjectId);
+        WsHandler::broadcastRaw(id, env.payload, std::move(key));
+    } else if (channel.compare(0, colon, "user") == 0) {
+        WsHandler::broadcastToUserRaw(id, env.payload, std::move(key));
     }
 }
 
-// ── Redis user-channel subscription ──────────────────────────────────────────
+static void ensureRedisDispatcher() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        RedisChannelMux::instance().setDispatcher(dispatchRedisMessage);
+    });
+}
 
-void WsHandler::subscribeToUserRedis(long long userId) {
-    {
-        std::lock_guard<std::mutex> lk(s_userMu);
-        if (s_redisUserSubs.count(userId)) return;
-        s_redisUserSubs[userId] = true;
-    }
+bool WsHandler::subscribeToRedis(long long chatId) {
+    ensureRedisDispatcher();
+    if (RedisChannelMux::instance().acquire("chat:" + std::to_string(chatId))) return true;
+    LOG_WARN << "Redis subscribe for chat " << chatId << " failed or Redis not configured; "
+                "fan-out is local-only";
+    return false;
+}
 
-    std::string channel = "user:" + std::to_string(userId);
-    auto redis = drogon::app().getRedisClient();
-    if (!redis) {
-        LOG_WARN << "Redis not configured; user-channel fan-out is local-only";
-        return;
-    }
+bool WsHandler::subscribeToUserRedis(long long userId) {
+    ensureRedisDispatcher();
+    if (RedisChannelMux::instance().acquire("user:" + std::to_string(userId))) return true;
+    LOG_WARN << "Redis subscribe for user " << userId << " failed or Redis not configured; "
+                "user-channel fan-out is local-only";
+    return false;
+}
 
-    try {
-        auto subscriber = redis->newSubscriber();
-        subscriber->subscribe(
-            channel,
-            [userId](const std::string& /*channel*/, const std::string& msg) {
-                try {
-                    auto payload = parseJson(msg);
-                    WsHandler::broadcastToUser(userId, payload);
-                } catch (const std::exception& e) {
-                    LOG_ERROR << "Redis user subscribe callback error for user "
-                              << userId << ": " << e.what();
-                }
+void WsHandler::subscribeChats(const drogon::WebSocketConnectionPtr& conn,
+                               const std::shared_ptr<ConnCtx>& ctx,
+                               const std::vector<long long>& chatIds) {
+    // Called from a DB callback; register on the connection's loop, as for
+    // "subscribe", so handleConnectionClosed sees every entry we add.
+    ctx->loop->runInLoop([this, conn, ctx, chatIds] {
+        if (conn->disconnected()) return;
+        auto added = s_subs.addMany(chatIds, {conn, ctx->loop});
+        if (!added.empty()) {
+            ctx->subscriptions.insert(ctx->subscriptions.end(), added.begin(), added.end());
+            std::vector<std::string> channels;
+            channels.reserve(added.size());
+            for (long long chatId : added) channels.push_back("chat:" + std::to_string(chatId));
+            ensureRedisDispatcher();
+            auto taken = RedisChannelMux::instance().acquireMany(channels);
+            size_t failed = 0;
+            for (size_t i = 0; i < added.size(); ++i) {
+                if (taken[i]) ctx->redisChats.push_back(added[i]);
+                else ++failed;
             }
-        );
-        {
-            std::lock_guard<std::mutex> lk(s_redisSubMu);
-            // Use negative keys for user channels to avoid collisions with chat channels
-            s_redisSubPtrs[-userId] = std::move(subscriber);
+            if (failed > 0)
+                LOG_WARN << "Redis subscribe failed for " << failed << " chat(s) or Redis not "
+                            "configured; fan-out for them is local-only";
         }
-    } catch (const std::exception& e) {
-        LOG_ERROR << "Failed to subscribe to Redis channel " << channel
-                  << ": " << e.what();
-        std::lock_guard<std::mutex> lk(s_userMu);
-        s_redisUserSubs.erase(userId);
-    }
+        Json::Value ok;
+        ok["type"]     = "subscribed";
+        ok["chat_ids"] = Json::arrayValue;
+        for (long long chatId : chatIds) ok["chat_ids"].append(Json::Int64(chatId));
+        sendJson(conn, ok);
+    });
+}
+
+void WsHandler::subscribeAll(const drogon::WebSocketConnectionPtr& conn,
+                             const std::shared_ptr<ConnCtx>& ctx) {
+    auto db = drogon::app().getDbClient();
+    db->execSqlAsync(
+        "SELECT chat_id FROM chat_members WHERE user_id = $1",
+        [this, conn, ctx](const drogon::orm::Result& r) {
+            try {
+                std::vector<long long> ids;
+                ids.reserve(r.size());
+                for (const auto& row : r) ids.push_back(row["chat_id"].as<long long>());
+                subscribeChats(conn, ctx, ids);
+            } catch (const std::exception& e) {
+                LOG_ERROR << "WS subscribe_all callback error: " << e.what();
+            }
+        },
+        [conn](const drogon::orm::DrogonDbException& e) {
+            LOG_ERROR << "WS subscribe_all: " << e.base().what();
+            sendError(conn, "Internal error");
+        },
+        ctx->userId);
+}
+
+void WsHandler::unsubscribeFromRedis(long long chatId) {
+    RedisChannelMux::instance().release("chat:" + std::to_string(chatId));
+}
+
+void WsHandler::unsubscribeFromUserRedis(long long userId) {
+    RedisChannelMux::instance().release("user:" + std::to_string(userId));
 }
 
 // ── Offline debounce ─────────────────────────────────────────────────────
 
 void WsHandler::cancelOfflineTimer(long long userId) {
+    std::lock_guard<std::mutex> lk(s_timerMu);
     auto it = s_offlineTimers.find(userId);
     if (it != s_offlineTimers.end()) {
         drogon::app().getLoop()->invalidateTimer(it->second);
@@ -203,112 +371,54 @@ void WsHandler::cancelOfflineTimer(long long userId) {
     }
 }
 
-// ── Presence broadcast ────────────────────────────────────────────────────
-
-// Helper: compute approximate last-seen bucket string
-static std::string lastSeenBucket(const std::string& status) {
-    if (status == "online") return "online";
-    // For offline, we don't have exact time here — just report "recently"
-    return "recently";
+void WsHandler::scheduleOffline(long long uid, const std::string& uname) {
+    std::lock_guard<std::mutex> lk(s_timerMu);
+    auto it = s_offlineTimers.find(uid);
+    if (it != s_offlineTimers.end()) {
+        drogon::app().getLoop()->invalidateTimer(it->second);
+        s_offlineTimers.erase(it);
+    }
+    // Debounce: delay offline broadcast by 5s
+    auto timerId = drogon::app().getLoop()->runAfter(5.0, [uid, uname]() {
+        if (!isUserActiveLocally(uid)) {
+            PresenceService::instance().userOffline(uid, uname);
+            auto db = drogon::app().getDbClient();
+            db->execSqlAsync(
+                "UPDATE users SET last_activity = NOW() WHERE id = $1",
+                [](const drogon::orm::Result&) {},
+                [](const drogon::orm::DrogonDbException&) {},
+                uid);
+        }
+        std::lock_guard<std::mutex> lk(s_timerMu);
+        s_offlineTimers.erase(uid);
+    });
+    s_offlineTimers[uid] = timerId;
 }
 
-void WsHandler::broadcastPresence(long long userId, const std::string& username,
-                                   const std::string& status) {
-    auto db = drogon::app().getDbClient();
+// ── Presence delivery ─────────────────────────────────────────────────────
 
-    // First query the user's last_seen_visibility setting
-    db->execSqlAsync(
-        "SELECT COALESCE(us.last_seen_visibility, 'everyone') AS visibility "
-        "FROM users u LEFT JOIN user_settings us ON us.user_id = u.id "
-        "WHERE u.id = $1",
-        [userId, username, status](const drogon::orm::Result& r) {
-            std::string visibility = "everyone";
-            if (!r.empty()) {
-                visibility = r[0]["visibility"].as<std::string>();
-            }
+bool WsHandler::hasLocalConnections(long long userId) {
+    return s_userConns.snapshot(userId) != nullptr;
+}
 
-            // Build payloads for different audience types
-            Json::Value fullPayload;
-            fullPayload["type"]     = "presence";
-            fullPayload["user_id"]  = Json::Int64(userId);
-            fullPayload["username"] = username;
-            fullPayload["status"]   = status;
-
-            Json::Value approxPayload;
-            approxPayload["type"]     = "presence";
-            approxPayload["user_id"]  = Json::Int64(userId);
-            approxPayload["username"] = username;
-            approxPayload["privacy"]  = "approx_only";
-            approxPayload["last_seen_bucket"] = lastSeenBucket(status);
-
-            if (visibility == "everyone") {
-                // Send once per unique observer via their user channel (not per-chat).
-                // Old approach published to each chat channel, causing N duplicates
-                // for observers in N shared chats.
-                auto db2 = drogon::app().getDbClient();
-                db2->execSqlAsync(
-                    "SELECT DISTINCT cm2.user_id FROM chat_members cm1 "
-                    "JOIN chat_members cm2 ON cm1.chat_id = cm2.chat_id "
-                    "WHERE cm1.user_id = $1 AND cm2.user_id != $1",
-                    [fullPayload](const drogon::orm::Result& r2) {
-                        for (const auto& row : r2) {
-                            long long observerId = row["user_id"].as<long long>();
-                            WsDispatch::publishToUser(observerId, fullPayload);
-                        }
-                    },
-                    [userId](const drogon::orm::DrogonDbException& e) {
-                        LOG_ERROR << "broadcastPresence DB error for user " << userId
-                                  << ": " << e.base().what();
-                    },
-                    userId);
-            } else {
-                // For 'approx_only' and 'nobody': local filtered broadcast
-                // with connection deduplication (one send per connection).
-                auto db2 = drogon::app().getDbClient();
-                db2->execSqlAsync(
-                    "SELECT chat_id FROM chat_members WHERE user_id = $1",
-                    [visibility, fullPayload, approxPayload](const drogon::orm::Result& r2) {
-                        std::string fullMsg   = toJsonStr(fullPayload);
-                        std::string approxMsg = toJsonStr(approxPayload);
-                        std::unordered_set<void*> sent;
-
-                        std::lock_guard<std::mutex> lk(s_mu);
-                        for (const auto& row : r2) {
-                            long long chatId = row["chat_id"].as<long long>();
-                            auto it = s_subs.find(chatId);
-                            if (it == s_subs.end()) continue;
-
-                            for (auto& conn : it->second) {
-                                try {
-                                    if (!conn || conn->disconnected()) continue;
-                                    if (!sent.insert(conn.get()).second) continue;
-                                    auto ctx = conn->getContext<ConnCtx>();
-                                    if (!ctx) continue;
-
-                                    if (ctx->isAdmin) {
-                                        conn->send(fullMsg);
-                                    } else if (visibility == "approx_only") {
-                                        conn->send(approxMsg);
-                                    }
-                                    // visibility == "nobody": non-admins get nothing
-                                } catch (const std::exception& e) {
-                                    LOG_ERROR << "WS presence send error: " << e.what();
-                                }
-                            }
-                        }
-                    },
-                    [userId](const drogon::orm::DrogonDbException& e) {
-                        LOG_ERROR << "broadcastPresence DB error for user " << userId
-                                  << ": " << e.base().what();
-                    },
-                    userId);
-            }
-        },
-        [userId](const drogon::orm::DrogonDbException& e) {
-            LOG_ERROR << "broadcastPresence settings query error for user " << userId
-                      << ": " << e.base().what();
-        },
-        userId);
+void WsHandler::deliverPresence(long long userId,
+                                std::shared_ptr<const std::string> adminFrame,
+                                std::shared_ptr<const std::string> frame,
+                                std::string coalesceKey) {
+    try {
+        auto conns = s_userConns.snapshot(userId);
+        if (!conns) return;
+        fanOutByLoop(std::move(conns), std::move(adminFrame),
+                     [frame = std::move(frame), key = std::move(coalesceKey)](
+                         const drogon::WebSocketConnectionPtr& c, const std::string& adminMsg) {
+                         auto ctx = c ? c->getContext<ConnCtx>() : nullptr;
+                         if (!ctx) return;
+                         if (ctx->isAdmin) deliverFrame(c, adminMsg, key);
+                         else if (frame)   deliverFrame(c, *frame, key);
+                     });
+    } catch (const std::exception& e) {
+        LOG_ERROR << "WS presence delivery error for user " << userId << ": " << e.what();
+    }
 }
 
 // ── WebSocket lifecycle ────────────────────────────────────────────────────
@@ -318,7 +428,23 @@ void WsHandler::handleNewConnection(const drogon::HttpRequestPtr& req,
     try {
         MetricsService::instance().wsConnect();
         auto ctx = std::make_shared<ConnCtx>();
+        // Drogon calls this on the IO loop that owns the connection
+        ctx->loop = trantor::EventLoop::getEventLoopOfCurrentThread();
         conn->setContext(ctx);
+
+        // Backpressure signals from the underlying TCP output buffer
+        if (auto tcp = req->getConnectionPtr().lock()) {
+            std::weak_ptr<drogon::WebSocketConnection> weak = conn;
+            tcp->setHighWaterMarkCallback(
+                [weak](const trantor::TcpConnectionPtr&, size_t) {
+                    if (auto c = weak.lock()) onOutboundHighWater(c);
+                },
+                static_cast<size_t>(Config::get().wsOutboundMaxBytes));
+            tcp->setWriteCompleteCallback(
+                [weak](const trantor::TcpConnectionPtr&) {
+                    if (auto c = weak.lock()) onOutboundDrained(c);
+                });
+        }
         LOG_INFO << "WebSocket opened from " << conn->peerAddr().toIpPort();
     } catch (const std::exception& e) {
         LOG_ERROR << "WS handleNewConnection error: " << e.what();
@@ -334,65 +460,29 @@ void WsHandler::handleConnectionClosed(const drogon::WebSocketConnectionPtr& con
         MetricsService::instance().wsDisconnect();
         auto ctx = conn->getContext<ConnCtx>();
         if (ctx) {
-            {
-                std::lock_guard<std::mutex> lk(s_mu);
-                for (long long chatId : ctx->subscriptions) {
-                    auto& vec = s_subs[chatId];
-                    vec.erase(std::remove(vec.begin(), vec.end(), conn), vec.end());
-                }
+            if (ctx->congested) {
+                ctx->congested = false;
+                MetricsService::instance().wsOutboundCongested(-1);
+                MetricsService::instance().wsOutboundHeld(
+                    -static_cast<long long>(ctx->held.size()));
+                ctx->held.clear();
             }
+            for (long long chatId : ctx->subscriptions) s_subs.remove(chatId, {conn, ctx->loop});
+            // Drop this connection's channel refs; the mux unsubscribes after a grace period
+            for (long long chatId : ctx->redisChats) unsubscribeFromRedis(chatId);
+            if (ctx->userChannelHeld) unsubscribeFromUserRedis(ctx->userId);
 
             // Remove from user connections and broadcast offline if user state changed
             if (ctx->authed && ctx->userId > 0) {
-                bool shouldBroadcastOffline = false;
-                {
-                    std::lock_guard<std::mutex> lk(s_userMu);
-                    auto it = s_userConns.find(ctx->userId);
-                    if (it != s_userConns.end()) {
-                        auto& vec = it->second;
-                        // Remove this connection + prune stale (disconnected) connections
-                        bool wasOnline = ctx->active;
+                bool wasOnline = ctx->active;
+                // Remove this connection + prune stale (disconnected) connections
+                bool anyActive = s_userConns.mutate(ctx->userId,
+                    [&conn](Registry::List& vec) {
                         vec.erase(std::remove_if(vec.begin(), vec.end(),
-                            [&conn](const drogon::WebSocketConnectionPtr& c) {
-                                return c == conn || !c || c->disconnected();
-                            }), vec.end());
-                        if (vec.empty()) {
-                            s_userConns.erase(it);
-                            shouldBroadcastOffline = wasOnline;
-                        } else {
-                            // Check if any remaining connection is still active
-                            bool anyActive = false;
-                            for (const auto& c : vec) {
-                                auto cctx = c->getContext<ConnCtx>();
-                                if (cctx && cctx->active) { anyActive = true; break; }
-                            }
-                            shouldBroadcastOffline = wasOnline && !anyActive;
-                        }
-                    }
-                }
-                if (shouldBroadcastOffline) {
-                    // Debounce: delay offline broadcast by 10s
-                    long long uid = ctx->userId;
-                    std::string uname = ctx->username;
-                    {
-                        std::lock_guard<std::mutex> lk2(s_userMu);
-                        cancelOfflineTimer(uid);
-                        auto timerId = drogon::app().getLoop()->runAfter(5.0, [this, uid, uname]() {
-                            if (!isUserOnline(uid)) {
-                                broadcastPresence(uid, uname, "offline");
-                                auto db = drogon::app().getDbClient();
-                                db->execSqlAsync(
-                                    "UPDATE users SET last_activity = NOW() WHERE id = $1",
-                                    [](const drogon::orm::Result&) {},
-                                    [](const drogon::orm::DrogonDbException&) {},
-                                    uid);
-                            }
-                            std::lock_guard<std::mutex> lk(s_userMu);
-                            s_offlineTimers.erase(uid);
-                        });
-                        s_offlineTimers[uid] = timerId;
-                    }
-                }
+                            [&conn](const Subscriber& e) { return e.conn == conn; }), vec.end());
+                        return pruneAndCheckActive(vec, conn);
+                    });
+                if (wasOnline && !anyActive) scheduleOffline(ctx->userId, ctx->username);
             }
         }
         LOG_INFO << "WebSocket closed";
@@ -429,6 +519,11 @@ void WsHandler::handleNewMessage(const drogon::WebSocketConnectionPtr& conn,
                 conn->forceClose();
                 return;
             }
+            if (ctx->userChannelHeld && ctx->userId != claims->userId) {
+                // Re-auth as a different user: hand back the old user-channel ref
+                unsubscribeFromUserRedis(ctx->userId);
+                ctx->userChannelHeld = false;
+            }
             ctx->userId  = claims->userId;
             ctx->authed  = true;
             ctx->isAdmin = claims->isAdmin;
@@ -442,43 +537,34 @@ void WsHandler::handleNewMessage(const drogon::WebSocketConnectionPtr& conn,
                 [this, ctx, conn](const drogon::orm::Result& r) {
                     if (!r.empty()) ctx->username = r[0]["username"].as<std::string>();
                     // Track user connection for presence
-                    bool shouldBroadcastOnline = false;
-                    {
-                        std::lock_guard<std::mutex> lk(s_userMu);
-                        auto& vec = s_userConns[ctx->userId];
-                        // Prune stale (disconnected) connections before checking state
-                        vec.erase(std::remove_if(vec.begin(), vec.end(),
-                            [](const drogon::WebSocketConnectionPtr& c) {
-                                return !c || c->disconnected();
-                            }), vec.end());
-                        // Was user already online (any existing active connection)?
-                        bool wasOnline = false;
-                        for (const auto& c : vec) {
-                            auto cctx = c->getContext<ConnCtx>();
-                            if (cctx && cctx->active) { wasOnline = true; break; }
-                        }
-                        vec.push_back(conn);
-                        // Broadcast online only if this connection is active and user wasn't already
-                        shouldBroadcastOnline = ctx->active && !wasOnline;
-                    }
-                    if (shouldBroadcastOnline) {
-                        {
-                            std::lock_guard<std::mutex> lk2(s_userMu);
-                            cancelOfflineTimer(ctx->userId);
-                        }
-                        broadcastPresence(ctx->userId, ctx->username, "online");
+                    bool wasOnline = s_userConns.mutate(ctx->userId,
+                        [&conn, &ctx](Registry::List& vec) {
+                            // Prune stale connections; was user already online elsewhere?
+                            bool other = pruneAndCheckActive(vec, conn);
+                            Subscriber self{conn, ctx->loop};
+                            if (std::find(vec.begin(), vec.end(), self) == vec.end())
+                                vec.insert(std::upper_bound(vec.begin(), vec.end(), self), self);
+                            return other;
+                        });
+                    // Broadcast online only if this connection is active and user wasn't already
+                    if (ctx->active && !wasOnline) {
+                        cancelOfflineTimer(ctx->userId);
+                        PresenceService::instance().userOnline(ctx->userId, ctx->username);
                     }
                 },
                 [](const drogon::orm::DrogonDbException&) {},
                 ctx->userId);
 
-            // Subscribe to per-user Redis channel for user-scoped events
-            subscribeToUserRedis(ctx->userId);
+            // Subscribe to per-user Redis channel for user-scoped events (one ref per connection)
+            if (!ctx->userChannelHeld) ctx->userChannelHeld = subscribeToUserRedis(ctx->userId);
 
             Json::Value ok;
             ok["type"]    = "auth_ok";
             ok["user_id"] = Json::Int64(ctx->userId);
             sendJson(conn, ok);
+
+            // Reconnects subscribe to every chat with a single query
+            if (msg.get("subscribe_all", false).asBool()) subscribeAll(conn, ctx);
             return;
         }
 
@@ -508,32 +594,15 @@ void WsHandler::handleNewMessage(const drogon::WebSocketConnectionPtr& conn,
 
                 // If this connection was away, transition to active
                 if (!ctx->active) {
-                    bool broadcastOnline = false;
-                    {
-                        std::lock_guard<std::mutex> lk(s_userMu);
-                        bool hadOtherActive = false;
-                        auto it = s_userConns.find(ctx->userId);
-                        if (it != s_userConns.end()) {
-                            auto& vec = it->second;
-                            vec.erase(std::remove_if(vec.begin(), vec.end(),
-                                [](const drogon::WebSocketConnectionPtr& c) {
-                                    return !c || c->disconnected();
-                                }), vec.end());
-                            for (const auto& c : vec) {
-                                if (c == conn) continue;
-                                auto cctx = c->getContext<ConnCtx>();
-                                if (cctx && cctx->active) { hadOtherActive = true; break; }
-                            }
-                        }
-                        ctx->active = true;
-                        broadcastOnline = !hadOtherActive;
-                    }
-                    if (broadcastOnline) {
-                        {
-                            std::lock_guard<std::mutex> lk2(s_userMu);
-                            cancelOfflineTimer(ctx->userId);
-                        }
-                        broadcastPresence(ctx->userId, ctx->username, "online");
+                    bool hadOtherActive = s_userConns.mutate(ctx->userId,
+                        [&conn, &ctx](Registry::List& vec) {
+                            bool other = pruneAndCheckActive(vec, conn);
+                            ctx->active = true;
+                            return other;
+                        });
+                    if (!hadOtherActive) {
+                        cancelOfflineTimer(ctx->userId);
+                        PresenceService::instance().userOnline(ctx->userId, ctx->username);
                     }
                 }
             }
@@ -545,40 +614,79 @@ void WsHandler::handleNewMessage(const drogon::WebSocketConnectionPtr& conn,
             long long chatId = msg["chat_id"].asInt64();
             if (chatId <= 0) { sendError(conn, "Invalid chat_id"); return; }
 
-            long long userId = ctx->userId;
-            auto db = drogon::app().getDbClient();
-            db->execSqlAsync(
-                "SELECT 1 FROM chat_members WHERE chat_id = $1 AND user_id = $2",
-                [this, conn, ctx, chatId](const drogon::orm::Result& r) {
+            MembershipCache::instance().lookup(chatId, ctx->userId,
+                [this, conn, ctx, chatId](const MembershipCache::Membership& m) {
                     try {
                         if (conn->disconnected()) return;
-                        if (r.empty()) {
+                        if (m.failed) {
+                            sendError(conn, "Internal error");
+                            return;
+                        }
+                        if (!m.isMember) {
                             sendError(conn, "Not a member of this chat");
                             return;
                         }
-                        {
-                            std::lock_guard<std::mutex> lk(s_mu);
-                            auto& vec = s_subs[chatId];
-                            if (std::find(vec.begin(), vec.end(), conn) == vec.end()) {
-                                vec.push_back(conn);
+                        // Register on the connection's loop, serialized with
+                        // handleConnectionClosed: either the close handler sees
+                        // this subscription, or we see the connection closed.
+                        ctx->loop->runInLoop([this, conn, ctx, chatId] {
+                            if (conn->disconnected()) return;
+                            if (s_subs.add(chatId, {conn, ctx->loop})) {
                                 ctx->subscriptions.push_back(chatId);
+                                if (subscribeToRedis(chatId)) ctx->redisChats.push_back(chatId);
                             }
-                        }
-                        subscribeToRedis(chatId);
-                        Json::Value ok;
-                        ok["type"]    = "subscribed";
-                        ok["chat_id"] = Json::Int64(chatId);
-                        sendJson(conn, ok);
+                            Json::Value ok;
+                            ok["type"]    = "subscribed";
+                            ok["chat_id"] = Json::Int64(chatId);
+                            sendJson(conn, ok);
+                        });
                     } catch (const std::exception& e) {
                         LOG_ERROR << "WS subscribe callback error: " << e.what();
                     }
+                });
+            return;
+        }
+
+        // ── subscribe_many / subscribe_all ─────────────────────────────────
+        if (type == "subscribe_all") {
+            subscribeAll(conn, ctx);
+            return;
+        }
+        if (type == "subscribe_many") {
+            const auto& ids = msg["chat_ids"];
+            if (!ids.isArray() || ids.empty() || ids.size() > kMaxSubscribeBatch) {
+                sendError(conn, "Invalid chat_ids");
+                return;
+            }
+            // Postgres array literal for = ANY($2)
+            std::string arr = "{";
+            for (const auto& v : ids) {
+                long long chatId = v.asInt64();
+                if (chatId <= 0) { sendError(conn, "Invalid chat_ids"); return; }
+                if (arr.size() > 1) arr += ',';
+                arr += std::to_string(chatId);
+            }
+            arr += '}';
+
+            auto db = drogon::app().getDbClient();
+            db->execSqlAsync(
+                "SELECT chat_id FROM chat_members WHERE user_id = $1 AND chat_id = ANY($2::BIGINT[])",
+                [this, conn, ctx](const drogon::orm::Result& r) {
+                    try {
+                        // Chats the user is not a member of are left out of the ack
+                        std::vector<long long> ok;
+                        ok.reserve(r.size());
+                        for (const auto& row : r) ok.push_back(row["chat_id"].as<long long>());
+                        subscribeChats(conn, ctx, ok);
+                    } catch (const std::exception& e) {
+                        LOG_ERROR << "WS subscribe_many callback error: " << e.what();
+                    }
                 },
                 [conn](const drogon::orm::DrogonDbException& e) {
-                    if (conn->disconnected()) return;
-                    LOG_ERROR << "WS subscribe membership check: " << e.base().what();
+                    LOG_ERROR << "WS subscribe_many: " << e.base().what();
                     sendError(conn, "Internal error");
                 },
-                chatId, userId);
+                ctx->userId, arr);
             return;
         }
 
@@ -587,6 +695,12 @@ void WsHandler::handleNewMessage(const drogon::WebSocketConnectionPtr& conn,
             long long chatId = msg["chat_id"].asInt64();
             if (chatId <= 0) { sendError(conn, "Invalid chat_id"); return; }
 
+            // Clients report on every keystroke; publish at most once per throttle window
+            bool publish = typingTracker().shouldPublish(chatId, ctx->userId,
+                                                         TypingTracker::Clock::now());
+            MetricsService::instance().wsTypingReport(publish);
+            if (!publish) return;
+
             // Build typing payload with sender info
             Json::Value payload;
             payload["type"]    = "typing";
@@ -611,64 +725,22 @@ void WsHandler::handleNewMessage(const drogon::WebSocketConnectionPtr& conn,
             bool newActive = (status == "active");
             if (ctx->active == newActive) return; // No change
 
-            bool broadcastOnline  = false;
-            bool broadcastOffline = false;
-            {
-                std::lock_guard<std::mutex> lk(s_userMu);
-                // Prune stale connections, then check if any OTHER is active
-                bool hadOtherActive = false;
-                auto it = s_userConns.find(ctx->userId);
-                if (it != s_userConns.end()) {
-                    auto& vec = it->second;
-                    vec.erase(std::remove_if(vec.begin(), vec.end(),
-                        [](const drogon::WebSocketConnectionPtr& c) {
-                            return !c || c->disconnected();
-                        }), vec.end());
-                    for (const auto& c : vec) {
-                        if (c == conn) continue;
-                        auto cctx = c->getContext<ConnCtx>();
-                        if (cctx && cctx->active) { hadOtherActive = true; break; }
-                    }
-                }
-                // Apply the change
-                ctx->active = newActive;
+            // Prune stale connections, check if any OTHER is active, apply the change
+            bool hadOtherActive = s_userConns.mutate(ctx->userId,
+                [&conn, &ctx, newActive](Registry::List& vec) {
+                    bool other = pruneAndCheckActive(vec, conn);
+                    ctx->active = newActive;
+                    return other;
+                });
 
-                if (newActive && !hadOtherActive) {
+            if (!hadOtherActive) {
+                if (newActive) {
                     // Was offline (no active connections), now online
-                    broadcastOnline = true;
-                } else if (!newActive && !hadOtherActive) {
-                    // This was the only active connection, now offline
-                    broadcastOffline = true;
-                }
-            }
-
-            if (broadcastOnline) {
-                {
-                    std::lock_guard<std::mutex> lk2(s_userMu);
                     cancelOfflineTimer(ctx->userId);
-                }
-                broadcastPresence(ctx->userId, ctx->username, "online");
-            } else if (broadcastOffline) {
-                // Debounce: delay offline broadcast by 10s
-                long long uid = ctx->userId;
-                std::string uname = ctx->username;
-                {
-                    std::lock_guard<std::mutex> lk2(s_userMu);
-                    cancelOfflineTimer(uid);
-                    auto timerId = drogon::app().getLoop()->runAfter(5.0, [this, uid, uname]() {
-                        if (!isUserOnline(uid)) {
-                            broadcastPresence(uid, uname, "offline");
-                            auto db = drogon::app().getDbClient();
-                            db->execSqlAsync(
-                                "UPDATE users SET last_activity = NOW() WHERE id = $1",
-                                [](const drogon::orm::Result&) {},
-                                [](const drogon::orm::DrogonDbException&) {},
-                                uid);
-                        }
-                        std::lock_guard<std::mutex> lk(s_userMu);
-                        s_offlineTimers.erase(uid);
-                    });
-                    s_offlineTimers[uid] = timerId;
+                    PresenceService::instance().userOnline(ctx->userId, ctx->username);
+                } else {
+                    // This was the only active connection, now offline
+                    scheduleOffline(ctx->userId, ctx->username);
                 }
             }
             return;
@@ -687,48 +759,102 @@ void WsHandler::handleNewMessage(const drogon::WebSocketConnectionPtr& conn,
 // ── Static helper called from MessagesController after DB insert ───────────
 // Publishes to Redis → all nodes pick it up and fan-out locally.
 namespace WsDispatch {
-void publishMessage(long long chatId, const Json::Value& payload) {
+
+std::string encodeEnvelope(const std::string& type, long long scopeId,
+                           long long subjectId, const std::string& json) {
+    std::string out;
+    out.reserve(type.size() + json.size() + 44);
+    out += type;
+    out += ' ';
+    out += std::to_string(scopeId);
+    out += ' ';
+    out += std::to_string(subjectId);
+    out += '\n';
+    out += json;
+    return out;
+}
+
+// Parse a non-negative decimal at the start of `s`; advances past it.
+static long long parseId(std::string_view& s) {
+    long long id = 0;
+    size_t i = 0;
+    for (; i < s.size() && s[i] >= '0' && s[i] <= '9'; ++i) id = id * 10 + (s[i] - '0');
+    s.remove_prefix(i);
+    return id;
+}
+
+Envelope decodeEnvelope(std::string_view raw) {
+    Envelope env;
+    env.payload = raw;
+    // Bare JSON (no header) — published by an older node during a rolling deploy
+    if (raw.empty() || raw.front() == '{') return env;
+
+    auto nl = raw.find('\n');
+    if (nl == std::string_view::npos) return env;
+    auto header = raw.substr(0, nl);
+    env.payload = raw.substr(nl + 1);
+
+    auto sp = header.find(' ');
+    env.type = header.substr(0, sp);
+    if (sp == std::string_view::npos) return env;
+    header.remove_prefix(sp + 1);
+    env.scopeId = parseId(header);
+    if (!header.empty() && header.front() == ' ') {
+        header.remove_prefix(1);
+        env.subjectId = parseId(header);
+    }
+    return env;
+}
+
+std::string coalesceKey(std::string_view type, long long scopeId, long long subjectId) {
+    // Only ephemeral state that a later frame fully supersedes may be coalesced
+    if (type == "typing")
+        return "typing:" + std::to_string(scopeId) + ":" + std::to_string(subjectId);
+    if (type == "presence")
+        return "presence:" + std::to_string(subjectId);
+    return {};
+}
+
+static void publishEnvelope(const std::string& channel, const std::string& msg,
+                            const char* what) {
     auto redis = drogon::app().getRedisClient();
-    std::string channel = "chat:" + std::to_string(chatId);
-    std::string msg = ([&] {
-        Json::StreamWriterBuilder wb;
-        wb["indentation"] = "";
-        return Json::writeString(wb, payload);
-    })();
-
-    if (redis) {
-        redis->execCommandAsync(
-            [](const drogon::nosql::RedisResult&) {},
-            [](const std::exception& e) {
-                LOG_ERROR << "Redis PUBLISH error: " << e.what();
-            },
-            "PUBLISH %s %s", channel.c_str(), msg.c_str()
-        );
+    redis->execCommandAsync(
+        [](const drogon::nosql::RedisResult&) {},
+        [what](const std::exception& e) {
+            LOG_ERROR << what << ": " << e.what();
+        },
+        "PUBLISH %s %s", channel.c_str(), msg.c_str()
+    );
+}
+
+void publishMessage(long long chatId, const Json::Value& payload) {
+    // Serialized exactly once; subscribers forward these bytes untouched.
+    std::string json = toJsonStr(payload);
+    // New messages name their author in sender_id; it ends their typing on every node
+    long long subjectId = payload.isMember("user_id")
+        ? payload["user_id"].asInt64() : payload.get("sender_id", 0).asInt64();
+    std::string envelope = encodeEnvelope(payload["type"].asString(), chatId, subjectId, json);
+
+    if (drogon::app().getRedisClient()) {
+        publishEnvelope("chat:" + std::to_string(chatId), envelope, "Redis PUBLISH error");
     } else {
-        // Fallback: local broadcast only
-        WsHandler::broadcast(chatId, payload);
+        // Fallback: local delivery only, through the same path as a pub/sub message
+        dispatchRedisMessage("chat:" + std::to_string(chatId), envelope);
     }
 }
 void publishToUser(long long userId, const Json::Value& payload) {
-    auto redis = drogon::app().getRedisClient();
-    std::string channel = "user:" + std::to_string(userId);
-    std::string msg = ([&] {
-        Json::StreamWriterBuilder wb;
-        wb["indentation"] = "";
-        return Json::writeString(wb, payload);
-    })();
-
-    if (redis) {
-        redis->execCommandAsync(
-            [](const drogon::nosql::RedisResult&) {},
-            [](const std::exception& e) {
-                LOG_ERROR << "Redis PUBLISH (user) error: " << e.what();
-            },
-            "PUBLISH %s %s", channel.c_str(), msg.c_str()
-        );
+    std::string json = toJsonStr(payload);
+
+    if (drogon::app().getRedisClient()) {
+        publishEnvelope("user:" + std::to_string(userId),
+                        encodeEnvelope(payload["type"].asString(), userId,
+                                       payload.get("user_id", 0).asInt64(), json),
+                        "Redis PUBLISH (user) error");
     } else {
         // Fallback: local broadcast only
-        WsHandler::broadcastToUser(userId, payload);
+        WsHandler::broadcastToUserRaw(userId, json,
+                                      coalesceKey(payload["type"].asString(), userId,
+                                                  payload.get("user_id", 0).asInt64()));
     }
 }
 }  // namespace WsDispatch
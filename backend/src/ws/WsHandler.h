@@ -1,15 +1,22 @@
 #pragma once
 #include <drogon/WebSocketController.h>
 #include <drogon/PubSubService.h>
+#include "ConnRegistry.h"
+#include "LoopFanout.h"
+#include <atomic>
 #include <unordered_map>
 #include <mutex>
 #include <string>
+#include <string_view>
 
 /// WebSocket endpoint: /ws
 /// Protocol:
 ///   Client → Server:
 ///     { "type": "auth",      "token": "<access-jwt>", "active": true|false }
 ///     { "type": "subscribe", "chat_id": 42 }
+///     { "type": "subscribe_many", "chat_ids": [42, 43] }   — one membership query for the list
+///     { "type": "subscribe_all" }                          — every chat the user is in
+///     (or "subscribe_all": true on auth; answered with { "type": "subscribed", "chat_ids": [...] })
 ///     { "type": "typing",    "chat_id": 42 }
 ///     { "type": "presence_update", "status": "active"|"away" }
 ///     { "type": "ping" }                                   — keepalive only
@@ -19,8 +26,10 @@
 ///     { "type": "pong" }
 ///     { "type": "error", "message": "..." }
 ///     { "type": "message", "chat_id": 42, "sender_id": 7, "content": "hi", "id": 99, "created_at": "...", "reply_to_message_id": 50 }
-///     { "type": "typing",  "chat_id": 42, "user_id": 7, "username": "alice" }
-///     { "type": "presence", "user_id": 7, "status": "online" }
+///     { "type": "typing",  "chat_id": 42, "users": [{ "user_id": 7, "username": "alice" }] }
+///                                            — full set of users typing; [] when nobody is
+///     { "type": "presence", "users": [{ "user_id": 7, "username": "alice", "status": "online" }, ...] }
+///                                            — batched; see PresenceService for privacy variants
 ///     { "type": "reaction", "chat_id": 42, "message_id": 99, "user_id": 7, "emoji": "...", "action": "added|removed" }
 ///     { "type": "message_deleted", "chat_id": 42, "message_id": 99, "deleted_by": 7, "for_everyone": true }
 ///     { "type": "message_updated", "chat_id": 42, "message_id": 99, "content": "edited text", "updated_at": "..." }
@@ -28,15 +37,22 @@
 ///     { "type": "message_unpinned", "chat_id": 42, "message_id": 99 }
 ///     { "type": "read_receipt", "chat_id": 42, "user_id": 7, "last_read_msg_id": 500 }
 ///     { "type": "chat_created", "chat_id": 42, "chat_type": "group", "title": "...", "created_by": 1 }
-///     { "type": "chat_updated", "chat_id": 42, "title?": "...", "description?": "...", "avatar_url?": "..." }
+///     { "type": "chat_updated", "chat_id": 42, "title?": "...", "description?": "...", "avatar_url?": "...", "avatar_thumb_url?": "..." }
 ///     { "type": "chat_deleted", "chat_id": 42, "deleted_by": 1 }
 ///     { "type": "chat_member_joined", "chat_id": 42, "user_id": 7, "username": "alice", "display_name": "Alice" }
 ///     { "type": "chat_member_left", "chat_id": 42, "user_id": 7 }
-///     { "type": "user_profile_updated", "user_id": 7, "display_name?": "...", "avatar_url?": "..." }
+///     { "type": "user_profile_updated", "user_id": 7, "display_name?": "...", "avatar_url?": "...", "avatar_thumb_url?": "..." }
+///     { "type": "resync_required" }   — frames were dropped under backpressure; refetch state
 ///
 /// Fan-out uses Redis Pub/Sub:
 ///   - "chat:<chat_id>" for chat-scoped events (messages, typing, reactions, etc.)
 ///   - "user:<user_id>" for user-scoped events (chat_created, chat_deleted, profile updates)
+/// Typing is throttled per (chat, user) before publishing, and each node sends
+/// its subscribers the changed typing sets once per tick (see TypingTracker).
+/// Published messages carry a one-line envelope header "<type> <scope_id> <user_id>\n"
+/// followed by the finished JSON frame, which subscribers forward byte-for-byte.
+/// All channels are multiplexed over a small pool of subscriber connections
+/// (see RedisChannelMux), so Redis socket count does not grow with chat count.
 class WsHandler : public drogon::WebSocketController<WsHandler> {
 public:
     WS_PATH_LIST_BEGIN
@@ -54,12 +70,29 @@ public:
 
     // Push a JSON message to all connections subscribed to a chat (local fan-out).
     static void broadcast(long long chatId, const Json::Value& payload);
+    // Same, for an already-serialized JSON frame (sent verbatim, no reparse).
+    // `coalesceKey` (see WsDispatch::coalesceKey) marks frames that may be
+    // superseded for congested connections.
+    static void broadcastRaw(long long chatId, std::string_view payload,
+                             std::string coalesceKey = {});
 
     // Push a JSON message to all connections of a specific user (local fan-out).
     static void broadcastToUser(long long userId, const Json::Value& payload);
+    static void broadcastToUserRaw(long long userId, std::string_view payload,
+                                   std::string coalesceKey = {});
 
-    // Check if a user has any active WebSocket connections.
-    static bool isUserOnline(long long userId);
+    // Whether the user has an active connection on this node. For
+    // cluster-wide status use PresenceService::lookupOnline.
+    static bool isUserActiveLocally(long long userId);
+    // Whether the user has any connection (active or away) on this node.
+    static bool hasLocalConnections(long long userId);
+
+    // Presence batch for one user's connections (see PresenceService):
+    // admins get `adminFrame`, everyone else `frame` (nothing if null).
+    static void deliverPresence(long long userId,
+                                std::shared_ptr<const std::string> adminFrame,
+                                std::shared_ptr<const std::string> frame,
+                                std::string coalesceKey);
 
 private:
     // Per-connection state stored in conn->getContext()
@@ -67,40 +100,72 @@ private:
         long long userId   = 0;
         bool      authed   = false;
         bool      isAdmin  = false;
-        bool      active   = true;   // Whether this connection's tab/window is visible+focused
+        std::atomic<bool> active{true};  // Whether this connection's tab/window is visible+focused
         std::string username;
+        // Chat subscriptions — only touched on `loop`
         std::vector<long long> subscriptions;
+        std::vector<long long> redisChats;  // subscriptions holding a ref on Redis "chat:<id>"
+        bool      userChannelHeld = false;  // holds a ref on Redis "user:<userId>"
         std::chrono::steady_clock::time_point lastDbRefresh;  // Throttle DB last_activity updates
+        trantor::EventLoop* loop = nullptr;  // IO loop that owns the connection
+
+        // Outbound backpressure — only touched on `loop`
+        bool      congested = false;            // TCP output buffer above WS_OUTBOUND_MAX_BYTES
+        unsigned  congestionEpisode = 0;        // guards the slow-consumer eviction timer
+        bool      droppedWhileCongested = false;
+        std::unordered_map<std::string, std::string> held;  // coalesced typing/presence, latest wins
     };
 
-    // Subscribe this process to Redis channel "chat:<chatId>" if not already done.
-    void subscribeToRedis(long long chatId);
-
-    // Subscribe this process to Redis channel "user:<userId>" if not already done.
-    void subscribeToUserRedis(long long userId);
-
-    // Broadcast presence (online/offline) to all chats the user belongs to.
-    void broadcastPresence(long long userId, const std::string& username,
-                           const std::string& status);
-
-    // Map: chatId → list of local connections subscribed
-    static std::mutex                                              s_mu;
-    static std::unordered_map<long long,
-           std::vector<drogon::WebSocketConnectionPtr>>           s_subs;
-    // Set of Redis chat channels already subscribed
-    static std::unordered_map<long long, bool>                    s_redisSubs;
-    // Set of Redis user channels already subscribed
-    static std::unordered_map<long long, bool>                    s_redisUserSubs;
-
-    // Per-user connection tracking for presence
-    static std::mutex                                              s_userMu;
-    static std::unordered_map<long long,
-           std::vector<drogon::WebSocketConnectionPtr>>           s_userConns;
-    // Per-user pending offline timers (debounce offline broadcast by 10s)
+    // Write a fan-out frame, applying the congestion policy. Must run on the
+    // connection's loop.
+    static void deliverFrame(const drogon::WebSocketConnectionPtr& conn,
+                             const std::string& msg, const std::string& coalesceKey);
+    static void onOutboundHighWater(const drogon::WebSocketConnectionPtr& conn);
+    static void onOutboundDrained(const drogon::WebSocketConnectionPtr& conn);
+
+    // Take a reference on Redis channel "chat:<chatId>" (multiplexed over the
+    // shared RedisChannelMux connections); subscribes on first reference.
+    // False when no ref was taken (subscribe failed, or Redis not configured).
+    bool subscribeToRedis(long long chatId);
+
+    // Register the connection for every chat in `chatIds` (membership already
+    // checked) with one batched registry and Redis update, then acknowledge.
+    // Safe to call from any thread; the work runs on the connection's loop.
+    void subscribeChats(const drogon::WebSocketConnectionPtr& conn,
+                        const std::shared_ptr<ConnCtx>& ctx,
+                        const std::vector<long long>& chatIds);
+    // subscribe_all: one query for the user's chats.
+    void subscribeAll(const drogon::WebSocketConnectionPtr& conn,
+                      const std::shared_ptr<ConnCtx>& ctx);
+
+    // Take a reference on Redis channel "user:<userId>". False as above.
+    bool subscribeToUserRedis(long long userId);
+
+    // Drop a reference; the last one unsubscribes after REDIS_UNSUB_GRACE_SEC.
+    static void unsubscribeFromRedis(long long chatId);
+    static void unsubscribeFromUserRedis(long long userId);
+
+    // Registry entries carry the owning loop so broadcasts post one task per loop
+    using Subscriber = LoopBound<drogon::WebSocketConnectionPtr>;
+    using Registry   = ConnRegistry<Subscriber>;
+
+    // chatId → local connections subscribed (lock-striped, snapshot reads, grouped by loop)
+    static Registry                                                s_subs;
+    // userId → local connections, for presence and user-scoped events
+    static Registry                                                s_userConns;
+    // Per-user pending offline timers (debounce offline broadcast by 5s)
+    static std::mutex                                              s_timerMu;
     static std::unordered_map<long long, trantor::TimerId>        s_offlineTimers;
 
-    // Cancel a pending offline timer for the given user (must be called under s_userMu or externally safe)
+    // Cancel a pending offline timer for the given user.
     void cancelOfflineTimer(long long userId);
+    // (Re)arm the debounced offline broadcast for the given user.
+    void scheduleOffline(long long userId, const std::string& username);
+
+    // Prune dead connections from a user's list; true if any connection other
+    // than `self` is active. Called inside Registry::mutate.
+    static bool pruneAndCheckActive(Registry::List& vec,
+                                    const drogon::WebSocketConnectionPtr& self);
 };
 
 // Called by controllers after mutations are persisted.
@@ -110,4 +175,20 @@ namespace WsDispatch {
     void publishMessage(long long chatId, const Json::Value& payload);
     // Publish to user:<userId> channel (chat_created, chat_deleted, profile updates)
     void publishToUser(long long userId, const Json::Value& payload);
+
+    // Pub/sub wire format: "<type> <scope_id> <subject_id>\n<json>". The header lets
+    // subscribers route and filter without parsing the JSON body.
+    struct Envelope {
+        std::string_view type;
+        long long        scopeId = 0;
+        long long        subjectId = 0;  // acting/affected user ("user_id"), 0 if none
+        std::string_view payload;   // the JSON frame, sent to clients verbatim
+    };
+    std::string encodeEnvelope(const std::string& type, long long scopeId,
+                               long long subjectId, const std::string& json);
+    // Views into `raw`; messages without a header decode as payload-only.
+    Envelope decodeEnvelope(std::string_view raw);
+    // Key under which a frame may be superseded by a later one ("typing:<chat>:<user>",
+    // "presence:<user>"); empty for frames that must not be coalesced.
+    std::string coalesceKey(std::string_view type, long long scopeId, long long subjectId);
 }
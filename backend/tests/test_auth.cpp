@@ -68,3 +68,36 @@ TEST(JwtService, InvalidTokenReturnsNullopt) {
     EXPECT_FALSE(jwt.verify("not.a.token").has_value());
     EXPECT_FALSE(jwt.verify("eyJ.eyJ.bad_sig").has_value());
 }
+
+TEST(JwtService, CachedVerifyReturnsSameClaims) {
+    auto& jwt = JwtService::instance();
+    std::string token = jwt.createAccessToken(7, true);
+
+    auto first  = jwt.verify(token);
+    auto second = jwt.verify(token);  // served from the verified-token cache
+    ASSERT_TRUE(first.has_value());
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(second->userId, 7);
+    EXPECT_EQ(second->tokenType, "access");
+    EXPECT_TRUE(second->isAdmin);
+    EXPECT_EQ(second->exp, first->exp);
+}
+
+TEST(JwtService, CachedSignatureWithTamperedPayloadRejected) {
+    auto& jwt = JwtService::instance();
+    std::string token = jwt.createAccessToken(8);
+    ASSERT_TRUE(jwt.verify(token).has_value());
+
+    // Same signature segment, different payload: must not hit the cache
+    auto dot1 = token.find('.');
+    token[dot1 + 3] ^= 0x01;
+    EXPECT_FALSE(jwt.verify(token).has_value());
+}
+
+TEST(JwtService, VerifiesStringViewIntoHeader) {
+    auto& jwt = JwtService::instance();
+    std::string header = "Bearer " + jwt.createAccessToken(11);
+    auto claims = jwt.verify(std::string_view(header).substr(7));
+    ASSERT_TRUE(claims.has_value());
+    EXPECT_EQ(claims->userId, 11);
+}
@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+#include "ws/ConnRegistry.h"
+
+TEST(ConnRegistry, AddRemoveDedup) {
+    ConnRegistry<int, 4> reg;
+    EXPECT_TRUE(reg.add(1, 10));
+    EXPECT_FALSE(reg.add(1, 10));
+    EXPECT_TRUE(reg.add(1, 11));
+
+    auto snap = reg.snapshot(1);
+    ASSERT_TRUE(snap);
+    EXPECT_EQ(snap->size(), 2u);
+
+    EXPECT_TRUE(reg.remove(1, 10));
+    EXPECT_FALSE(reg.remove(1, 10));
+    EXPECT_TRUE(reg.remove(1, 11));
+    EXPECT_FALSE(reg.snapshot(1));  // emptied ids are dropped
+}
+
+TEST(ConnRegistry, SnapshotIsStableAcrossWrites) {
+    ConnRegistry<int, 4> reg;
+    reg.add(7, 1);
+    auto before = reg.snapshot(7);
+    reg.add(7, 2);
+    EXPECT_EQ(before->size(), 1u);
+    EXPECT_EQ(reg.snapshot(7)->size(), 2u);
+}
+
+TEST(ConnRegistry, AddManyReportsNewIdsOnly) {
+    ConnRegistry<int, 4> reg;
+    reg.add(2, 10);
+    auto added = reg.addMany({1, 2, 3, 3, 9}, 10);
+    std::sort(added.begin(), added.end());
+    EXPECT_EQ(added, (std::vector<long long>{1, 3, 9}));
+    for (long long id : {1, 2, 3, 9}) {
+        auto snap = reg.snapshot(id);
+        ASSERT_TRUE(snap);
+        EXPECT_EQ(snap->size(), 1u);
+    }
+}
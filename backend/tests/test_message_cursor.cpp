@@ -0,0 +1,22 @@
+#include <gtest/gtest.h>
+#include "utils/MessageCursor.h"
+
+TEST(MessageCursor, RoundTrip) {
+    auto tok = msg_cursor::encode(1767225600123456LL, 42);
+    EXPECT_EQ(tok, "1767225600123456_42");
+    auto c = msg_cursor::decode(tok);
+    ASSERT_TRUE(c.has_value());
+    EXPECT_EQ(c->createdUs, 1767225600123456LL);
+    EXPECT_EQ(c->id, 42);
+}
+
+TEST(MessageCursor, RejectsMalformed) {
+    EXPECT_FALSE(msg_cursor::decode(""));
+    EXPECT_FALSE(msg_cursor::decode("123"));
+    EXPECT_FALSE(msg_cursor::decode("_5"));
+    EXPECT_FALSE(msg_cursor::decode("123_"));
+    EXPECT_FALSE(msg_cursor::decode("123_0"));
+    EXPECT_FALSE(msg_cursor::decode("123_5x"));
+    EXPECT_FALSE(msg_cursor::decode("2026-01-01_5"));
+    EXPECT_FALSE(msg_cursor::decode("99999999999999999999_5"));
+}
@@ -36,3 +36,45 @@ TEST(MetricsService, WebSocketGauge) {
     m.wsDisconnect();
     m.wsDisconnect();
 }
+
+TEST(MetricsService, RedisChannelGauge) {
+    auto& m = MetricsService::instance();
+    m.setRedisChannels(7);
+
+    std::string exposed = m.expose();
+    EXPECT_NE(exposed.find("messenger_ws_redis_channels_active 7"), std::string::npos);
+
+    m.setRedisChannels(0);
+}
+
+TEST(MetricsService, CryptoHistograms) {
+    auto& m = MetricsService::instance();
+    m.observeCrypto("pbkdf2_verify", 0.001, 0.04);
+    m.cryptoRejected("pbkdf2_verify");
+
+    std::string exposed = m.expose();
+    EXPECT_NE(exposed.find("messenger_crypto_duration_seconds_bucket{op=\"pbkdf2_verify\""),
+              std::string::npos);
+    EXPECT_NE(exposed.find("messenger_crypto_queue_wait_seconds_count{op=\"pbkdf2_verify\"} 1"),
+              std::string::npos);
+    EXPECT_NE(exposed.find("messenger_crypto_rejected_total{op=\"pbkdf2_verify\"} 1"),
+              std::string::npos);
+}
+
+TEST(MetricsService, MessagePartitions) {
+    auto& m = MetricsService::instance();
+    m.setMessagePartitions({{"messages_2026_01", 8192, 4096, 10},
+                            {"messages_default", 16384, 8192, 0}});
+    m.partitionMaintenanceRun(true);
+
+    std::string exposed = m.expose();
+    EXPECT_NE(exposed.find("messenger_messages_partitions 2"), std::string::npos);
+    EXPECT_NE(exposed.find("messenger_messages_partition_bytes{partition=\"messages_2026_01\"} 8192"),
+              std::string::npos);
+    EXPECT_NE(exposed.find("messenger_messages_partition_index_bytes{partition=\"messages_default\"} 8192"),
+              std::string::npos);
+    EXPECT_NE(exposed.find("messenger_partition_maintenance_runs_total{result=\"ok\"}"),
+              std::string::npos);
+
+    m.setMessagePartitions({});
+}
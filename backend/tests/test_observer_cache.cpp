@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+#include "services/ObserverCache.h"
+
+using namespace std::chrono_literals;
+
+static ObserverCache::Observers obs(std::vector<long long> v) {
+    return std::make_shared<const std::vector<long long>>(std::move(v));
+}
+
+TEST(ObserverCache, MembershipChangeDropsAffectedSets) {
+    ObserverCache c(100, 60s);
+    auto now = ObserverCache::Clock::now();
+    // Chat 10: users 1, 2. Chat 20: users 1, 3. User 4 shares nothing with them.
+    ASSERT_TRUE(c.put(1, {10, 20}, obs({2, 3}), c.epoch(), now));
+    ASSERT_TRUE(c.put(2, {10}, obs({1}), c.epoch(), now));
+    ASSERT_TRUE(c.put(3, {20}, obs({1}), c.epoch(), now));
+    ASSERT_TRUE(c.put(4, {30}, obs({}), c.epoch(), now));
+
+    // User 5 joins chat 10: their own set and those of 1 and 2 go stale
+    c.dropMember(10, 5);
+    EXPECT_FALSE(c.get(1, now));
+    EXPECT_FALSE(c.get(2, now));
+    ASSERT_TRUE(c.get(3, now));
+    EXPECT_EQ(c.get(3, now)->size(), 1u);
+    EXPECT_TRUE(c.get(4, now));
+
+    c.dropChat(30);
+    EXPECT_FALSE(c.get(4, now));
+    EXPECT_EQ(c.size(), 1u);
+}
+
+TEST(ObserverCache, LoadRacingAnInvalidationIsDiscarded) {
+    ObserverCache c(100, 60s);
+    auto now = ObserverCache::Clock::now();
+    auto epoch = c.epoch();
+    c.dropMember(10, 1);
+    EXPECT_FALSE(c.put(1, {10}, obs({2}), epoch, now));
+    EXPECT_FALSE(c.get(1, now));
+}
+
+TEST(ObserverCache, ExpiryAndCapacity) {
+    ObserverCache c(2, 60s);
+    auto now = ObserverCache::Clock::now();
+    c.put(1, {10}, obs({2}), c.epoch(), now);
+    EXPECT_TRUE(c.get(1, now + 59s));
+    EXPECT_FALSE(c.get(1, now + 60s));
+
+    c.put(1, {10}, obs({2}), c.epoch(), now);
+    c.put(2, {10}, obs({1}), c.epoch(), now);
+    c.put(3, {20}, obs({}), c.epoch(), now);   // full: starts over
+    EXPECT_EQ(c.size(), 1u);
+    EXPECT_TRUE(c.get(3, now));
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include "utils/MinioPresign.h"
+#include <string>
+
+using namespace minio_presign;
+
+TEST(MinioPresign, UriEncode) {
+    EXPECT_EQ(uriEncode("a b/c~"), "a%20b%2Fc~");
+    EXPECT_EQ(uriEncode("a b/c~", false), "a%20b/c~");
+    EXPECT_EQ(toHex(reinterpret_cast<const unsigned char*>("\x01\xab"), 2), "01ab");
+    EXPECT_EQ(sha256Hex("abc"),
+              "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    EXPECT_EQ(sha256Hex("abcdef", 3), sha256Hex("abc"));
+}
+
+TEST(MinioPresign, CachedSigningKeyMatchesDerivation) {
+    auto direct = sigV4SigningKey("secret", "20240101", "us-east-1", "s3");
+    EXPECT_EQ(cachedSigningKey("secret", "20240101", "us-east-1", "s3"), direct);
+    EXPECT_EQ(cachedSigningKey("secret", "20240101", "us-east-1", "s3"), direct);
+    EXPECT_NE(cachedSigningKey("other", "20240101", "us-east-1", "s3"), direct);
+}
+
+TEST(MinioPresign, UrlStableWithinWindow) {
+    auto a = generatePresignedUrl("minio:9000", "", "b", "k/1.png", "ak", "sk", 900);
+    auto b = generatePresignedUrl("minio:9000", "", "b", "k/1.png", "ak", "sk", 900);
+    auto c = generatePresignedUrl("minio:9000", "", "b", "k/2.png", "ak", "sk", 900);
+    EXPECT_EQ(a, b);
+    EXPECT_NE(a, c);
+    EXPECT_EQ(a.rfind("http://minio:9000/b/k/1.png?", 0), 0u);
+    EXPECT_EQ(generatePresignedUrl("minio:9000", "", "b", "", "ak", "sk", 900), "");
+}
+
+TEST(MinioPresign, PublicUrlRewrite) {
+    auto url = presignGetAt("minio:9000", "https://example.com/minio", "b", "x",
+                            "ak", "sk", 900, 1704067200);
+    EXPECT_EQ(url.rfind("https://example.com/minio/b/x?", 0), 0u);
+    EXPECT_NE(url.find("X-Amz-Date=20240101T000000Z"), std::string::npos);
+    EXPECT_NE(url.find("X-Amz-Credential=ak%2F20240101%2Fus-east-1%2Fs3%2Faws4_request"),
+              std::string::npos);
+}
+
+TEST(MinioPresign, SignRequestHeaders) {
+    auto put = signRequest("PUT", "minio:9000", "/b/k", "", "image/png",
+                           sha256Hex("body"), "ak", "sk");
+    EXPECT_EQ(put.contentSha, sha256Hex("body"));
+    EXPECT_EQ(put.amzDate.size(), 16u);
+    EXPECT_EQ(put.authorization.rfind("AWS4-HMAC-SHA256 Credential=ak/", 0), 0u);
+    EXPECT_NE(put.authorization.find("SignedHeaders=content-type;host;x-amz-content-sha256;x-amz-date,"),
+              std::string::npos);
+
+    auto part = signRequest("PUT", "minio:9000", "/b/k", "partNumber=1&uploadId=u", "",
+                            sha256Hex("body"), "ak", "sk");
+    EXPECT_NE(part.authorization.find("SignedHeaders=host;x-amz-content-sha256;x-amz-date,"),
+              std::string::npos);
+}
+
+TEST(MinioPresign, PresignedPutUrls) {
+    auto put = generatePresignedPutUrl("minio:9000", "", "b", "k 1.bin", "ak", "sk", 3600);
+    EXPECT_EQ(put.rfind("http://minio:9000/b/k%201.bin?X-Amz-Algorithm=AWS4-HMAC-SHA256&", 0), 0u);
+    EXPECT_EQ(put.find("partNumber"), std::string::npos);
+    EXPECT_NE(put, generatePresignedUrl("minio:9000", "", "b", "k 1.bin", "ak", "sk", 3600));
+
+    auto part = generatePresignedPutUrl("minio:9000", "", "b", "k", "ak", "sk", 3600, 2, "id/1");
+    EXPECT_NE(part.find("X-Amz-SignedHeaders=host&partNumber=2&uploadId=id%2F1&X-Amz-Signature="),
+              std::string::npos);
+}
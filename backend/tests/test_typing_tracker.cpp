@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+#include "ws/TypingTracker.h"
+
+using namespace std::chrono_literals;
+
+TEST(TypingTracker, ThrottlesPublishesPerChatAndUser) {
+    TypingTracker t(3s, 6s);
+    auto t0 = TypingTracker::Clock::now();
+    EXPECT_TRUE(t.shouldPublish(1, 7, t0));
+    EXPECT_FALSE(t.shouldPublish(1, 7, t0 + 1s));
+    EXPECT_FALSE(t.shouldPublish(1, 7, t0 + 2999ms));
+    EXPECT_TRUE(t.shouldPublish(1, 8, t0 + 1s));   // other user
+    EXPECT_TRUE(t.shouldPublish(2, 7, t0 + 1s));   // other chat
+    EXPECT_TRUE(t.shouldPublish(1, 7, t0 + 3s));
+
+    t.stop(1, 7);
+    EXPECT_TRUE(t.shouldPublish(1, 7, t0 + 4s));   // sending a message resets the window
+}
+
+TEST(TypingTracker, CollectReportsChangedSetsOnce) {
+    TypingTracker t(3s, 6s);
+    auto t0 = TypingTracker::Clock::now();
+    t.observe(1, 8, "bob", t0);
+    t.observe(1, 7, "alice", t0);
+
+    auto sets = t.collect(t0);
+    ASSERT_EQ(sets.size(), 1u);
+    EXPECT_EQ(sets[0].first, 1);
+    ASSERT_EQ(sets[0].second.size(), 2u);
+    EXPECT_EQ(sets[0].second[0].userId, 7);
+    EXPECT_EQ(sets[0].second[0].username, "alice");
+
+    // Refreshing a typist who is already in the set is not a change
+    t.observe(1, 7, "alice", t0 + 4s);
+    EXPECT_TRUE(t.collect(t0 + 4s).empty());
+}
+
+TEST(TypingTracker, ExpiryAndStopEmitEmptySet) {
+    TypingTracker t(3s, 6s);
+    auto t0 = TypingTracker::Clock::now();
+    t.observe(1, 7, "alice", t0);
+    t.observe(2, 9, "carol", t0);
+    t.collect(t0);
+
+    t.stop(2, 9);
+    auto sets = t.collect(t0 + 1s);
+    ASSERT_EQ(sets.size(), 1u);
+    EXPECT_EQ(sets[0].first, 2);
+    EXPECT_TRUE(sets[0].second.empty());
+
+    EXPECT_TRUE(t.collect(t0 + 5s).empty());
+    sets = t.collect(t0 + 6s);
+    ASSERT_EQ(sets.size(), 1u);
+    EXPECT_EQ(sets[0].first, 1);
+    EXPECT_TRUE(sets[0].second.empty());
+    EXPECT_TRUE(t.collect(t0 + 7s).empty());
+}
@@ -1,13 +1,70 @@
 import api from './client'
 import type { FileUploadResult } from './types'
 
-export async function uploadFile(file: File): Promise<FileUploadResult> {
-  const fd = new FormData()
-  fd.append('file', file)
-  const { data } = await api.post<FileUploadResult>('/files', fd)
+interface UploadUrlResult extends FileUploadResult {
+  upload_url?: string
+  part_size?: number
+  part_urls?: string[]
+  deduplicated?: boolean
+}
+
+// Files hashed in the browser so known content skips the upload; larger
+// ones would have to be read into memory whole
+const HASH_MAX_BYTES = 64 * 1024 * 1024
+
+async function sha256Hex(file: File): Promise<string | undefined> {
+  if (file.size > HASH_MAX_BYTES || !globalThis.crypto?.subtle) return undefined
+  const digest = await crypto.subtle.digest('SHA-256', await file.arrayBuffer())
+  return Array.from(new Uint8Array(digest), (b) => b.toString(16).padStart(2, '0')).join('')
+}
+
+// PUT straight to a presigned storage URL; returns the ETag header
+async function putToStorage(url: string, body: Blob, contentType: string): Promise<string> {
+  const res = await fetch(url, { method: 'PUT', body, headers: { 'Content-Type': contentType } })
+  if (!res.ok) throw new Error(`storage upload failed: ${res.status}`)
+  return res.headers.get('ETag') ?? ''
+}
+
+// Upload directly to object storage, then let the API verify the object
+async function uploadDirect(file: File): Promise<FileUploadResult> {
+  const mimeType = file.type || 'application/octet-stream'
+  const { data: target } = await api.post<UploadUrlResult>('/files/upload-url', {
+    filename: file.name,
+    mime_type: mimeType,
+    size: file.size,
+    sha256: await sha256Hex(file),
+  })
+  if (target.deduplicated) return target
+
+  let body: { parts: { part_number: number; etag: string }[] } | undefined
+  if (target.upload_url) {
+    await putToStorage(target.upload_url, file, mimeType)
+  } else {
+    const partSize = target.part_size!
+    const parts = []
+    for (const [i, url] of target.part_urls!.entries()) {
+      const etag = await putToStorage(url, file.slice(i * partSize, (i + 1) * partSize), mimeType)
+      parts.push({ part_number: i + 1, etag })
+    }
+    body = { parts }
+  }
+
+  const { data } = await api.post<FileUploadResult>(`/files/${target.id}/complete`, body)
   return data
 }
 
+export async function uploadFile(file: File): Promise<FileUploadResult> {
+  try {
+    return await uploadDirect(file)
+  } catch {
+    // Storage not reachable from the browser (e.g. dev without CORS): go through the API
+    const fd = new FormData()
+    fd.append('file', file)
+    const { data } = await api.post<FileUploadResult>('/files', fd)
+    return data
+  }
+}
+
 export function getDownloadUrl(fileId: number): string {
   const base = import.meta.env.VITE_API_URL || '/api'
   return `${base}/files/${fileId}/download`
@@ -3,7 +3,12 @@ import type { Message } from './types'
 
 export async function listMessages(
   chatId: number,
-  params?: { after_id?: number; before?: string; limit?: number },
+  params?: {
+    after_cursor?: string
+    before_cursor?: string
+    after_id?: number
+    limit?: number
+  },
 ): Promise<Message[]> {
   const { data } = await api.get<Message[]>(`/chats/${chatId}/messages`, { params })
   return data
@@ -58,7 +63,7 @@ export async function getPinnedMessage(chatId: number) {
 export async function searchMessages(
   chatId: number,
   q: string,
-  params?: { limit?: number; before_id?: number },
+  params?: { limit?: number; before_cursor?: string; before_id?: number },
 ): Promise<Message[]> {
   const { data } = await api.get<Message[]>(`/chats/${chatId}/messages/search`, {
     params: { q, ...params },
@@ -4,6 +4,7 @@ export interface User {
   display_name: string
   bio: string
   avatar_url: string | null
+  avatar_thumb_url?: string | null
   email?: string
   is_admin: boolean
   is_active?: boolean
@@ -29,6 +30,7 @@ export interface Chat {
   other_username?: string
   other_display_name?: string
   other_avatar_url?: string | null
+  other_avatar_thumb_url?: string | null
   is_favorite: boolean
   is_muted: boolean
   is_pinned?: boolean
@@ -39,6 +41,7 @@ export interface Chat {
   updated_at: string
   member_count?: number
   avatar_url?: string | null
+  avatar_thumb_url?: string | null
   my_role?: string
 }
 
@@ -57,6 +60,7 @@ export interface Message {
   sender_username: string
   sender_display_name: string
   sender_avatar_url: string | null
+  sender_avatar_thumb_url?: string | null
   sender_is_admin: boolean
   content: string
   message_type: 'text' | 'sticker' | 'voice' | 'file'
@@ -64,6 +68,8 @@ export interface Message {
   sticker_url?: string
   sticker_label?: string
   attachment_url?: string
+  attachment_thumb_url?: string | null
+  attachment_preview_url?: string | null
   attachment_path?: string
   attachment_filename?: string
   attachment_mime_type?: string
@@ -81,6 +87,7 @@ export interface Message {
   is_edited?: boolean
   updated_at?: string
   created_at: string
+  cursor?: string
   reactions?: ReactionGroup[]
 }
 
@@ -129,6 +136,7 @@ export interface FileUploadResult {
 
 export interface AvatarResult {
   avatar_url: string
+  avatar_thumb_url?: string | null
 }
 
 export interface ChatMember {
@@ -136,6 +144,7 @@ export interface ChatMember {
   username: string
   display_name: string
   avatar_url: string | null
+  avatar_thumb_url?: string | null
   role: 'owner' | 'admin' | 'member'
   joined_at: string
 }
@@ -239,17 +239,13 @@ export function useWebSocket() {
       lastActivityRefreshSent = 0
       isPresenceActive = !document.hidden
 
-      // Send auth with current active state
+      // Send auth with current active state; the server subscribes us to all chats
       const token = localStorage.getItem('access_token')
       if (token) {
-        ws!.send(JSON.stringify({ type: 'auth', token, active: isPresenceActive }))
+        ws!.send(JSON.stringify({ type: 'auth', token, active: isPresenceActive, subscribe_all: true }))
       }
 
-      // Subscribe to all chats
       const chatsStore = useChatsStore()
-      for (const chat of chatsStore.chats) {
-        ws!.send(JSON.stringify({ type: 'subscribe', chat_id: chat.id }))
-      }
 
       // Resync on reconnect (not first connect) — one-shot fetch
       if (hasConnectedBefore) {
@@ -291,6 +287,24 @@ export function useWebSocket() {
     }
   }
 
+  function applyPresence(entry: Record<string, unknown>) {
+    const userId = entry.user_id as number
+    const status = entry.status as string
+    // Skip if this user's status hasn't actually changed
+    if (presenceCache.get(userId) === status) return
+    presenceCache.set(userId, status)
+
+    const lastSeenAt = entry.last_seen_at as string | undefined
+    const lastSeenBucket = entry.last_seen_bucket as string | undefined
+    const chatsStore = useChatsStore()
+    if (status === 'online') {
+      chatsStore.setUserOnline(userId)
+    } else if (status === 'offline') {
+      const effectiveLastSeenAt = lastSeenAt || new Date().toISOString()
+      chatsStore.setUserOffline(userId, effectiveLastSeenAt, lastSeenBucket)
+    }
+  }
+
   function handleMessage(data: Record<string, unknown>) {
     const messagesStore = useMessagesStore()
     const chatsStore = useChatsStore()
@@ -324,6 +338,13 @@ export function useWebSocket() {
       }
       case 'typing': {
         const chatId = data.chat_id as number
+        if (Array.isArray(data.users)) {
+          // Batched set of everyone typing in the chat (excluding ourselves)
+          const users = (data.users as { user_id: number; username: string }[])
+            .filter((u) => u.user_id !== authStore.user?.id)
+          chatsStore.setTypingSet(chatId, users)
+          break
+        }
         const userId = data.user_id as number
         // Don't show typing for ourselves
         if (userId !== authStore.user?.id) {
@@ -336,20 +357,19 @@ export function useWebSocket() {
       case 'pong':
         // heartbeat acknowledged
         break
+      case 'resync_required': {
+        // Server dropped frames while our connection was congested — refetch like a reconnect
+        chatsStore.loadChats()
+        if (chatsStore.activeChatId) {
+          messagesStore.loadNewer(chatsStore.activeChatId)
+        }
+        break
+      }
       case 'presence': {
-        const userId = data.user_id as number
-        const status = data.status as string
-        // Skip if this user's status hasn't actually changed
-        if (presenceCache.get(userId) === status) break
-        presenceCache.set(userId, status)
-
-        const lastSeenAt = data.last_seen_at as string | undefined
-        const lastSeenBucket = data.last_seen_bucket as string | undefined
-        if (status === 'online') {
-          chatsStore.setUserOnline(userId)
-        } else if (status === 'offline') {
-          const effectiveLastSeenAt = lastSeenAt || new Date().toISOString()
-          chatsStore.setUserOffline(userId, effectiveLastSeenAt, lastSeenBucket)
+        // Batched: one entry per user whose status changed since the last frame
+        const entries = Array.isArray(data.users) ? (data.users as Record<string, unknown>[]) : [data]
+        for (const entry of entries) {
+          applyPresence(entry)
         }
         break
       }
@@ -411,6 +431,7 @@ export function useWebSocket() {
           title: data.title as string | undefined,
           description: data.description as string | undefined,
           avatar_url: data.avatar_url as string | undefined,
+          avatar_thumb_url: data.avatar_thumb_url as string | null | undefined,
         })
         break
       }
@@ -438,10 +459,12 @@ export function useWebSocket() {
         const userId = data.user_id as number
         const displayName = data.display_name as string | undefined
         const avatarUrl = data.avatar_url as string | undefined
+        const avatarThumbUrl = data.avatar_thumb_url as string | null | undefined
         for (const chat of chatsStore.chats) {
           if (chat.type === 'direct' && (chat as Record<string, unknown>).other_user_id === userId) {
             if (displayName !== undefined) chat.title = displayName
             if (avatarUrl !== undefined) (chat as Record<string, unknown>).other_avatar_url = avatarUrl
+            if (avatarThumbUrl !== undefined) chat.other_avatar_thumb_url = avatarThumbUrl
           }
         }
         break
@@ -156,13 +156,14 @@ export const useChatsStore = defineStore('chats', () => {
 
   function updateChatMetadata(
     chatId: number,
-    fields: { title?: string; description?: string; avatar_url?: string },
+    fields: { title?: string; description?: string; avatar_url?: string; avatar_thumb_url?: string | null },
   ) {
     const chat = chats.value.find((c) => c.id === chatId)
     if (!chat) return
     if (fields.title !== undefined) chat.title = fields.title
     if (fields.description !== undefined) chat.description = fields.description
     if (fields.avatar_url !== undefined) (chat as Record<string, unknown>).avatar_url = fields.avatar_url
+    if (fields.avatar_thumb_url !== undefined) chat.avatar_thumb_url = fields.avatar_thumb_url
   }
 
   function removeChatLocal(chatId: number) {
@@ -195,6 +196,24 @@ export const useChatsStore = defineStore('chats', () => {
     typingUsers.value[chatId][userId] = { username, timer }
   }
 
+  // Replace the chat's typing set with the server's batched snapshot. The
+  // server sends an updated set when someone stops; the timers only guard
+  // against a lost frame.
+  function setTypingSet(chatId: number, users: { user_id: number; username: string }[]) {
+    const current = typingUsers.value[chatId] || {}
+    for (const entry of Object.values(current)) {
+      clearTimeout(entry.timer)
+    }
+    const next: Record<number, { username: string; timer: ReturnType<typeof setTimeout> }> = {}
+    for (const u of users) {
+      const timer = setTimeout(() => {
+        clearTyping(chatId, u.user_id)
+      }, 10000)
+      next[u.user_id] = { username: u.username || 'Someone', timer }
+    }
+    typingUsers.value[chatId] = next
+  }
+
   function clearTyping(chatId: number, userId: number) {
     if (typingUsers.value[chatId]) {
       const entry = typingUsers.value[chatId][userId]
@@ -271,6 +290,7 @@ export const useChatsStore = defineStore('chats', () => {
     removeChatLocal,
     incrementUnread,
     setTyping,
+    setTypingSet,
     clearTyping,
     getTypingUsernames,
     onlineUsers,
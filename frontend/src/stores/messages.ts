@@ -60,11 +60,13 @@ export const useMessagesStore = defineStore('messages', () => {
   async function loadNewer(chatId: number) {
     const afterId = lastMsgId.value[chatId] || 0
     if (afterId === 0) return []
+    const loaded = messagesByChat.value[chatId]
+    const newest = loaded && loaded.length > 0 ? loaded[loaded.length - 1] : undefined
     try {
-      const msgs = await messagesApi.listMessages(chatId, {
-        after_id: afterId,
-        limit: 50,
-      })
+      const msgs = await messagesApi.listMessages(
+        chatId,
+        newest?.cursor ? { after_cursor: newest.cursor, limit: 50 } : { after_id: afterId, limit: 50 },
+      )
       if (msgs.length > 0) {
         if (!messagesByChat.value[chatId]) {
           messagesByChat.value[chatId] = []
@@ -87,10 +89,10 @@ export const useMessagesStore = defineStore('messages', () => {
     const msgs = messagesByChat.value[chatId]
     if (!msgs || msgs.length === 0) return []
     const oldest = msgs[0]
-    if (!oldest) return []
+    if (!oldest?.cursor) return []
     try {
       const olderMsgs = await messagesApi.listMessages(chatId, {
-        before: oldest.created_at,
+        before_cursor: oldest.cursor,
         limit: 50,
       })
       if (olderMsgs.length > 0) {
@@ -0,0 +1,160 @@
+-- V22: Per-chat summary projection for the chat list
+-- listChats used correlated subqueries per chat row (last message, member
+-- count, unread COUNT(*) over messages). chat_summary keeps those values
+-- up to date from triggers, and unread counts become a difference of
+-- per-chat message sequence numbers.
+
+-- --------------------------------------------------------------------------
+-- Summary table (one row per chat)
+-- --------------------------------------------------------------------------
+CREATE TABLE chat_summary (
+    chat_id          BIGINT      PRIMARY KEY REFERENCES chats(id) ON DELETE CASCADE,
+    last_msg_id      BIGINT,
+    last_msg_preview TEXT,                      -- first 512 chars of content
+    last_msg_at      TIMESTAMPTZ,
+    member_count     INTEGER     NOT NULL DEFAULT 0,
+    msg_seq          BIGINT      NOT NULL DEFAULT 0   -- messages ever sent to the chat
+);
+
+-- Read position as a chat sequence number: unread = msg_seq - last_read_seq
+ALTER TABLE chat_last_read ADD COLUMN IF NOT EXISTS last_read_seq BIGINT NOT NULL DEFAULT 0;
+
+-- --------------------------------------------------------------------------
+-- Maintenance triggers
+-- --------------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION chat_summary_on_chat_insert()
+RETURNS TRIGGER AS $$
+BEGIN
+    INSERT INTO chat_summary (chat_id) VALUES (NEW.id) ON CONFLICT DO NOTHING;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER trg_chat_summary_chat_insert
+    AFTER INSERT ON chats
+    FOR EACH ROW EXECUTE FUNCTION chat_summary_on_chat_insert();
+
+CREATE OR REPLACE FUNCTION chat_summary_on_member_change()
+RETURNS TRIGGER AS $$
+BEGIN
+    IF TG_OP = 'INSERT' THEN
+        UPDATE chat_summary SET member_count = member_count + 1 WHERE chat_id = NEW.chat_id;
+    ELSE
+        UPDATE chat_summary SET member_count = GREATEST(member_count - 1, 0) WHERE chat_id = OLD.chat_id;
+    END IF;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER trg_chat_summary_member_change
+    AFTER INSERT OR DELETE ON chat_members
+    FOR EACH ROW EXECUTE FUNCTION chat_summary_on_member_change();
+
+-- New message: bump the sequence, move the preview, and mark the chat read
+-- for the sender up to their own message (previously done by the API after
+-- every send, so a sender's own messages never count as unread).
+CREATE OR REPLACE FUNCTION chat_summary_on_message_insert()
+RETURNS TRIGGER AS $$
+DECLARE
+    v_seq BIGINT;
+BEGIN
+    UPDATE chat_summary SET
+        msg_seq          = msg_seq + 1,
+        last_msg_id      = CASE WHEN last_msg_at IS NULL OR NEW.created_at >= last_msg_at
+                                THEN NEW.id ELSE last_msg_id END,
+        last_msg_preview = CASE WHEN last_msg_at IS NULL OR NEW.created_at >= last_msg_at
+                                THEN left(NEW.content, 512) ELSE last_msg_preview END,
+        last_msg_at      = GREATEST(last_msg_at, NEW.created_at)
+    WHERE chat_id = NEW.chat_id
+    RETURNING msg_seq INTO v_seq;
+
+    IF v_seq IS NULL THEN
+        RETURN NULL;
+    END IF;
+
+    INSERT INTO chat_last_read (user_id, chat_id, last_read_msg_id, last_read_seq, read_at)
+    VALUES (NEW.sender_id, NEW.chat_id, NEW.id, v_seq, NOW())
+    ON CONFLICT (user_id, chat_id) DO UPDATE SET
+        last_read_msg_id = GREATEST(chat_last_read.last_read_msg_id, EXCLUDED.last_read_msg_id),
+        last_read_seq    = GREATEST(chat_last_read.last_read_seq, EXCLUDED.last_read_seq),
+        read_at          = NOW();
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER trg_chat_summary_message_insert
+    AFTER INSERT ON messages
+    FOR EACH ROW EXECUTE FUNCTION chat_summary_on_message_insert();
+
+-- Edits to the latest message refresh the preview
+CREATE OR REPLACE FUNCTION chat_summary_on_message_update()
+RETURNS TRIGGER AS $$
+BEGIN
+    UPDATE chat_summary SET last_msg_preview = left(NEW.content, 512)
+    WHERE chat_id = NEW.chat_id AND last_msg_id = NEW.id;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER trg_chat_summary_message_update
+    AFTER UPDATE OF content ON messages
+    FOR EACH ROW
+    WHEN (OLD.content IS DISTINCT FROM NEW.content)
+    EXECUTE FUNCTION chat_summary_on_message_update();
+
+-- Hard delete of the latest message (retention, chat deletion) falls back to
+-- the previous one. The sequence is not rewound, so unread counts are an
+-- upper bound after hard deletes.
+CREATE OR REPLACE FUNCTION chat_summary_on_message_delete()
+RETURNS TRIGGER AS $$
+DECLARE
+    v_id      BIGINT;
+    v_content TEXT;
+    v_at      TIMESTAMPTZ;
+BEGIN
+    PERFORM 1 FROM chat_summary WHERE chat_id = OLD.chat_id AND last_msg_id = OLD.id;
+    IF NOT FOUND THEN
+        RETURN NULL;
+    END IF;
+
+    SELECT m.id, m.content, m.created_at INTO v_id, v_content, v_at
+    FROM messages m
+    WHERE m.chat_id = OLD.chat_id
+    ORDER BY m.created_at DESC, m.id DESC LIMIT 1;
+
+    UPDATE chat_summary SET
+        last_msg_id      = v_id,
+        last_msg_preview = left(v_content, 512),
+        last_msg_at      = v_at
+    WHERE chat_id = OLD.chat_id;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER trg_chat_summary_message_delete
+    AFTER DELETE ON messages
+    FOR EACH ROW EXECUTE FUNCTION chat_summary_on_message_delete();
+
+-- --------------------------------------------------------------------------
+-- Backfill
+-- --------------------------------------------------------------------------
+INSERT INTO chat_summary (chat_id, last_msg_id, last_msg_preview, last_msg_at, member_count, msg_seq)
+SELECT c.id, lm.id, left(lm.content, 512), lm.created_at,
+       (SELECT COUNT(*) FROM chat_members cm WHERE cm.chat_id = c.id),
+       (SELECT COUNT(*) FROM messages m WHERE m.chat_id = c.id)
+FROM chats c
+LEFT JOIN LATERAL (
+    SELECT m.id, m.content, m.created_at FROM messages m
+    WHERE m.chat_id = c.id
+    ORDER BY m.created_at DESC, m.id DESC LIMIT 1
+) lm ON TRUE
+ON CONFLICT (chat_id) DO NOTHING;
+
+-- Place each read pointer so that msg_seq - last_read_seq equals the unread
+-- count the old query produced (messages from others after last_read_msg_id).
+UPDATE chat_last_read clr SET last_read_seq = GREATEST(cs.msg_seq - (
+    SELECT COUNT(*) FROM messages m
+    WHERE m.chat_id = clr.chat_id AND m.id > clr.last_read_msg_id AND m.sender_id <> clr.user_id
+), 0)
+FROM chat_summary cs
+WHERE cs.chat_id = clr.chat_id;
@@ -0,0 +1,13 @@
+-- V23: Parent timestamp on replies
+-- messages is partitioned by created_at, so joining a reply to its parent
+-- by id alone probes every partition. Storing the parent's created_at next
+-- to reply_to_message_id lets the join (and any lookup of the parent) go to
+-- a single partition through the (id, created_at) primary key.
+
+ALTER TABLE messages ADD COLUMN IF NOT EXISTS reply_to_created_at TIMESTAMPTZ;
+
+UPDATE messages m SET reply_to_created_at = p.created_at
+FROM messages p
+WHERE m.reply_to_message_id IS NOT NULL
+  AND m.reply_to_created_at IS NULL
+  AND p.id = m.reply_to_message_id;
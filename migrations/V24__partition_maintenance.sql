@@ -0,0 +1,147 @@
+-- V24: Rolling monthly partitions for messages
+-- V1 created messages_2026_01..03 only, so later rows fall into
+-- messages_default. These functions are called periodically by the API's
+-- PartitionManager (one node at a time, via a Redis lock) and are safe to
+-- run by hand. Both take a transaction-level advisory lock and return 0
+-- without doing anything when another run holds it.
+
+-- Rows moved out of messages_default are deleted there and re-inserted into
+-- the new partition outside the parent, so the V22 delete trigger must not
+-- treat them as hard deletes. messages_ensure_partitions sets this flag for
+-- the duration of its transaction.
+CREATE OR REPLACE FUNCTION chat_summary_on_message_delete()
+RETURNS TRIGGER AS $$
+DECLARE
+    v_id      BIGINT;
+    v_content TEXT;
+    v_at      TIMESTAMPTZ;
+BEGIN
+    IF current_setting('messenger.partition_move', true) = 'on' THEN
+        RETURN NULL;
+    END IF;
+
+    PERFORM 1 FROM chat_summary WHERE chat_id = OLD.chat_id AND last_msg_id = OLD.id;
+    IF NOT FOUND THEN
+        RETURN NULL;
+    END IF;
+
+    SELECT m.id, m.content, m.created_at INTO v_id, v_content, v_at
+    FROM messages m
+    WHERE m.chat_id = OLD.chat_id
+    ORDER BY m.created_at DESC, m.id DESC LIMIT 1;
+
+    UPDATE chat_summary SET
+        last_msg_id      = v_id,
+        last_msg_preview = left(v_content, 512),
+        last_msg_at      = v_at
+    WHERE chat_id = OLD.chat_id;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+-- --------------------------------------------------------------------------
+-- Create partitions for the current month and p_months_ahead after it, and
+-- for every month that has rows stranded in messages_default (moving those
+-- rows into the new partition). Returns the number of partitions created.
+-- --------------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION messages_ensure_partitions(p_months_ahead INTEGER)
+RETURNS INTEGER AS $$
+DECLARE
+    v_month   DATE;
+    v_to      DATE;
+    v_name    TEXT;
+    v_created INTEGER := 0;
+BEGIN
+    IF NOT pg_try_advisory_xact_lock(hashtext('messages_partition_maintenance')) THEN
+        RETURN 0;
+    END IF;
+
+    FOR v_month IN
+        SELECT date_trunc('month', created_at)::DATE FROM messages_default
+        UNION
+        SELECT (date_trunc('month', NOW()) + make_interval(months => g))::DATE
+        FROM generate_series(0, GREATEST(p_months_ahead, 0)) g
+        ORDER BY 1
+    LOOP
+        v_name := 'messages_' || to_char(v_month, 'YYYY_MM');
+        IF to_regclass(v_name) IS NOT NULL THEN
+            CONTINUE;
+        END IF;
+        v_to := (v_month + INTERVAL '1 month')::DATE;
+
+        IF NOT EXISTS (SELECT 1 FROM messages_default
+                       WHERE created_at >= v_month AND created_at < v_to) THEN
+            EXECUTE format('CREATE TABLE %I PARTITION OF messages FOR VALUES FROM (%L) TO (%L)',
+                           v_name, v_month, v_to);
+        ELSE
+            -- Block writes to the default partition until the new partition
+            -- is attached, so no new row for this month can land there
+            -- in between; reads continue.
+            LOCK TABLE messages_default IN EXCLUSIVE MODE;
+            PERFORM set_config('messenger.partition_move', 'on', true);
+
+            EXECUTE format('CREATE TABLE %I (LIKE messages INCLUDING DEFAULTS INCLUDING CONSTRAINTS)',
+                           v_name);
+            EXECUTE format('WITH moved AS (DELETE FROM messages_default '
+                           'WHERE created_at >= %L AND created_at < %L RETURNING *) '
+                           'INSERT INTO %I SELECT * FROM moved',
+                           v_month, v_to, v_name);
+            EXECUTE format('ALTER TABLE messages ATTACH PARTITION %I FOR VALUES FROM (%L) TO (%L)',
+                           v_name, v_month, v_to);
+
+            PERFORM set_config('messenger.partition_move', 'off', true);
+        END IF;
+        v_created := v_created + 1;
+    END LOOP;
+    RETURN v_created;
+END;
+$$ LANGUAGE plpgsql;
+
+-- --------------------------------------------------------------------------
+-- Retire monthly partitions that ended more than p_retention_months ago.
+-- p_mode 'detach' detaches them and renames them messages_archive_YYYY_MM
+-- (for dumping or moving to cheaper storage); 'drop' drops them.
+-- chat_summary is not rewound for retired rows. Returns the number retired.
+-- --------------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION messages_retire_partitions(p_retention_months INTEGER, p_mode TEXT)
+RETURNS INTEGER AS $$
+DECLARE
+    v_cutoff  DATE;
+    v_part    RECORD;
+    v_retired INTEGER := 0;
+BEGIN
+    IF p_retention_months <= 0 OR p_mode NOT IN ('detach', 'drop') THEN
+        RETURN 0;
+    END IF;
+    IF NOT pg_try_advisory_xact_lock(hashtext('messages_partition_maintenance')) THEN
+        RETURN 0;
+    END IF;
+
+    v_cutoff := (date_trunc('month', NOW()) - make_interval(months => p_retention_months))::DATE;
+
+    FOR v_part IN
+        SELECT c.relname,
+               to_date(substr(c.relname, 10), 'YYYY_MM') AS month
+        FROM pg_inherits i
+        JOIN pg_class c ON c.oid = i.inhrelid
+        WHERE i.inhparent = 'messages'::regclass
+          AND c.relname ~ '^messages_[0-9]{4}_[0-9]{2}$'
+        ORDER BY 2
+    LOOP
+        EXIT WHEN v_part.month >= v_cutoff;
+
+        EXECUTE format('ALTER TABLE messages DETACH PARTITION %I', v_part.relname);
+        IF p_mode = 'drop' THEN
+            EXECUTE format('DROP TABLE %I', v_part.relname);
+        ELSE
+            EXECUTE format('ALTER TABLE %I RENAME TO %I', v_part.relname,
+                           'messages_archive_' || substr(v_part.relname, 10));
+        END IF;
+        v_retired := v_retired + 1;
+    END LOOP;
+    RETURN v_retired;
+END;
+$$ LANGUAGE plpgsql;
+
+-- Catch up immediately rather than waiting for the first maintenance tick
+SELECT messages_ensure_partitions(3);
@@ -0,0 +1,31 @@
+-- V25: Indexed search for messages and users
+-- Message search used content ILIKE '%q%', which reads every message of the
+-- chat; user search did the same over the whole users table.
+--
+-- Messages: word search over to_tsvector('simple', content), each query
+-- word matching as a prefix. The 'simple' configuration does not stem, so
+-- it behaves the same for every language. The GIN index leads with
+-- chat_id (btree_gin) so an in-chat search only reads that chat's entries.
+-- Queries must use the exact indexed expression:
+--     to_tsvector('simple', COALESCE(m.content, '')) @@ messages_search_query(q)
+--
+-- Users: trigram indexes make substring ILIKE on username/display_name
+-- index-backed (query username as username::text to match the index).
+
+CREATE EXTENSION IF NOT EXISTS pg_trgm;
+CREATE EXTENSION IF NOT EXISTS btree_gin;
+
+-- "hel wor" → 'hel':* & 'wor':*  (NULL when q has no words)
+CREATE OR REPLACE FUNCTION messages_search_query(p_q TEXT)
+RETURNS tsquery AS $$
+    SELECT to_tsquery('simple', string_agg(quote_literal(w) || ':*', ' & '))
+    FROM unnest(tsvector_to_array(to_tsvector('simple', p_q))) AS w
+$$ LANGUAGE sql IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE INDEX IF NOT EXISTS idx_messages_chat_fts ON messages
+    USING gin (chat_id, to_tsvector('simple', COALESCE(content, '')));
+
+CREATE INDEX IF NOT EXISTS idx_users_username_trgm ON users
+    USING gin ((username::text) gin_trgm_ops);
+CREATE INDEX IF NOT EXISTS idx_users_display_name_trgm ON users
+    USING gin (display_name gin_trgm_ops);
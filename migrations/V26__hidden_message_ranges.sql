@@ -0,0 +1,74 @@
+-- V26: Per-(user, chat) hidden message ranges for "delete for me"
+-- History and search filtered every candidate row with a NOT EXISTS probe
+-- into deleted_messages. deleted_messages stays the source of truth (now
+-- keyed by user, chat, message). A trigger folds it into one
+-- int8multirange per (user, chat), which a query reads once and checks
+-- each row against in memory:
+--     NOT COALESCE(m.id <@ (SELECT ranges FROM hidden_message_ranges
+--                           WHERE user_id = $viewer AND chat_id = $chat), FALSE)
+
+-- --------------------------------------------------------------------------
+-- deleted_messages gains chat_id
+-- --------------------------------------------------------------------------
+ALTER TABLE deleted_messages ADD COLUMN IF NOT EXISTS chat_id BIGINT;
+
+UPDATE deleted_messages dm SET chat_id = m.chat_id
+FROM messages m
+WHERE m.id = dm.message_id AND dm.chat_id IS NULL;
+
+-- Rows whose message is gone hide nothing
+DELETE FROM deleted_messages WHERE chat_id IS NULL;
+
+ALTER TABLE deleted_messages ALTER COLUMN chat_id SET NOT NULL;
+ALTER TABLE deleted_messages
+    ADD CONSTRAINT fk_deleted_messages_chat FOREIGN KEY (chat_id) REFERENCES chats(id) ON DELETE CASCADE;
+ALTER TABLE deleted_messages DROP CONSTRAINT deleted_messages_pkey;
+ALTER TABLE deleted_messages ADD PRIMARY KEY (user_id, chat_id, message_id);
+-- Covered by the primary key
+DROP INDEX IF EXISTS deleted_messages_user_id_idx;
+
+-- --------------------------------------------------------------------------
+-- Compact per-(user, chat) projection
+-- --------------------------------------------------------------------------
+CREATE TABLE hidden_message_ranges (
+    user_id BIGINT         NOT NULL REFERENCES users(id) ON DELETE CASCADE,
+    chat_id BIGINT         NOT NULL REFERENCES chats(id) ON DELETE CASCADE,
+    ranges  int8multirange NOT NULL,
+    PRIMARY KEY (user_id, chat_id)
+);
+
+-- Adjacent ids coalesce into one range ([5,6) + [6,7) = [5,7)).
+CREATE OR REPLACE FUNCTION hidden_ranges_on_insert()
+RETURNS TRIGGER AS $$
+BEGIN
+    INSERT INTO hidden_message_ranges (user_id, chat_id, ranges)
+    VALUES (NEW.user_id, NEW.chat_id, int8multirange(int8range(NEW.message_id, NEW.message_id, '[]')))
+    ON CONFLICT (user_id, chat_id) DO UPDATE
+        SET ranges = hidden_message_ranges.ranges + EXCLUDED.ranges;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER trg_hidden_ranges_insert
+    AFTER INSERT ON deleted_messages
+    FOR EACH ROW EXECUTE FUNCTION hidden_ranges_on_insert();
+
+CREATE OR REPLACE FUNCTION hidden_ranges_on_delete()
+RETURNS TRIGGER AS $$
+BEGIN
+    UPDATE hidden_message_ranges
+    SET ranges = ranges - int8multirange(int8range(OLD.message_id, OLD.message_id, '[]'))
+    WHERE user_id = OLD.user_id AND chat_id = OLD.chat_id;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER trg_hidden_ranges_delete
+    AFTER DELETE ON deleted_messages
+    FOR EACH ROW EXECUTE FUNCTION hidden_ranges_on_delete();
+
+-- Backfill
+INSERT INTO hidden_message_ranges (user_id, chat_id, ranges)
+SELECT user_id, chat_id, range_agg(int8range(message_id, message_id, '[]'))
+FROM deleted_messages
+GROUP BY user_id, chat_id;
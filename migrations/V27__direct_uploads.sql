@@ -0,0 +1,9 @@
+-- V27: Two-phase (presigned PUT) uploads
+-- POST /files/upload-url creates the row as 'pending' before any bytes
+-- exist; POST /files/{id}/complete HEADs the object, records its real size
+-- and flips it to 'ready'. Rows written by POST /files are ready at once.
+
+ALTER TABLE files
+    ADD COLUMN status    TEXT NOT NULL DEFAULT 'ready'
+                         CHECK (status IN ('pending', 'ready')),
+    ADD COLUMN upload_id TEXT;  -- S3 multipart upload id while a large upload is pending
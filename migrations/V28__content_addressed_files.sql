@@ -0,0 +1,48 @@
+-- V28: Content-addressed uploads
+-- POST /files hashes each upload (SHA-256) and stores new content once, under
+-- uploads/<sha256>, recorded in `blobs`. Every upload still gets its own files
+-- row (its own uploader, filename and type); rows with the same content point
+-- at the blob's object. Clients can skip uploading content they uploaded
+-- before via POST /files/upload-url { sha256 }. Only hashes the server
+-- computed itself are recorded; older rows and direct uploads keep sha256
+-- NULL and never match.
+-- blobs.ref_count is the number of files rows on the object, kept by trigger
+-- as rows are inserted and deleted; an object may only be removed from
+-- storage once its blob is unreferenced.
+
+CREATE TABLE blobs (
+    sha256      TEXT         PRIMARY KEY,
+    bucket      TEXT         NOT NULL,
+    object_key  TEXT         NOT NULL,
+    size_bytes  BIGINT       NOT NULL,
+    ref_count   INT          NOT NULL DEFAULT 0,
+    created_at  TIMESTAMPTZ  NOT NULL DEFAULT NOW()
+);
+
+ALTER TABLE files ADD COLUMN sha256 TEXT REFERENCES blobs(sha256);
+
+CREATE INDEX IF NOT EXISTS idx_files_sha256_uploader ON files (sha256, uploader_id)
+    WHERE sha256 IS NOT NULL;
+
+-- Many rows may share a blob's object; other uploads still own theirs
+ALTER TABLE files DROP CONSTRAINT IF EXISTS files_object_key_key;
+CREATE UNIQUE INDEX IF NOT EXISTS idx_files_object_key_owned ON files (object_key) WHERE sha256 IS NULL;
+CREATE INDEX IF NOT EXISTS idx_files_object_key ON files (object_key);
+
+CREATE OR REPLACE FUNCTION blobs_on_file_change()
+RETURNS TRIGGER AS $$
+BEGIN
+    IF TG_OP = 'INSERT' THEN
+        IF NEW.sha256 IS NOT NULL THEN
+            UPDATE blobs SET ref_count = ref_count + 1 WHERE sha256 = NEW.sha256;
+        END IF;
+    ELSIF OLD.sha256 IS NOT NULL THEN
+        UPDATE blobs SET ref_count = GREATEST(ref_count - 1, 0) WHERE sha256 = OLD.sha256;
+    END IF;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER trg_blobs_file_change
+    AFTER INSERT OR DELETE ON files
+    FOR EACH ROW EXECUTE FUNCTION blobs_on_file_change();
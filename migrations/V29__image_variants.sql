@@ -0,0 +1,11 @@
+-- V29: Derived image variants
+-- After an image upload becomes ready, ImagePipeline renders WebP copies of
+-- it and stores them next to the original (same bucket, key + suffix):
+--   thumb_key    small rendition for avatars and chat-list entries
+--   preview_key  screen-sized rendition for images in message history
+-- Both stay NULL until generated, for non-images, and when the server runs
+-- without libvips; clients then fall back to the original object.
+
+ALTER TABLE files
+    ADD COLUMN thumb_key   TEXT,
+    ADD COLUMN preview_key TEXT;
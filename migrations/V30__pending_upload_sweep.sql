@@ -0,0 +1,16 @@
+-- V30: Expiring direct uploads
+-- A pending files row now records when its presigned URLs expire
+-- (MINIO_UPLOAD_URL_TTL, longer for uploads with many parts). UploadSweeper
+-- deletes pending rows once they have been expired for a sweep interval,
+-- aborting any open multipart upload and removing a leftover object.
+-- Pending rows are few, so a partial index keeps the sweep from scanning
+-- every ready file.
+
+ALTER TABLE files ADD COLUMN upload_expires_at TIMESTAMPTZ;
+
+-- Rows pending before this migration: assume the default one-hour URLs
+UPDATE files SET upload_expires_at = created_at + INTERVAL '1 hour'
+WHERE status = 'pending';
+
+CREATE INDEX IF NOT EXISTS idx_files_pending_expires
+    ON files (upload_expires_at) WHERE status = 'pending';